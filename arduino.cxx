@@ -8,52 +8,539 @@
  * ============================================================================
  */
 
+#include <Arduino.h>
 #include <Servo.h>
 
+// ============================================================================
+// MACHINE LAYOUTS
+// ============================================================================
+
+// Everything that differs between physical machines (pins, gate poses, the
+// standard motion profile, which optional hardware is fitted) is a
+// compile-time constant of one layout. MACHINE_LAYOUT picks the layout this
+// build is for (-DMACHINE_LAYOUT=1, like PROTOCOL_UART); an unknown number
+// fails to compile. The configuration below copies the layout into the usual
+// constants, so they fold into the code like literals, and code for hardware
+// the layout lacks is dropped by the compiler.
+#ifndef MACHINE_LAYOUT
+#define MACHINE_LAYOUT 0
+#endif
+
+template <int Layout> struct MachineLayout;
+
+// 0: the original bench machine - sort gate, feeder servo and break-beam
+template <> struct MachineLayout<0> {
+  static constexpr int SERVO1_PIN = 12;        // Primary sorting servo
+  static constexpr int SERVO2_PIN = 13;        // Secondary servo (feeder)
+  static constexpr int CLEAR_SENSOR_PIN = 2;   // Break-beam below the gate
+  static constexpr int SYNC_PIN = 3;           // Shared sync line (external interrupt pin)
+  
+  static constexpr int LEFT_POSITION = 0;      // 0 degrees - for "safe to shred" items
+  static constexpr int RIGHT_POSITION = 180;   // 180 degrees - for "special handling" items
+  static constexpr int CENTER_POSITION = 90;   // 90 degrees - neutral/home position
+  static constexpr int SERVO2_ACTIVE = 90;     // Active position for servo 2
+  static constexpr int SERVO2_IDLE = 0;        // Idle position for servo 2
+  
+  static constexpr int MOVE_TIME = 800;        // Time to complete movement (milliseconds)
+  static constexpr int HOLD_TIME = 600;        // Time to hold position (milliseconds)
+  static constexpr int STEP_DELAY = 15;        // Delay between servo steps for smooth movement
+  static constexpr int SERVO2_SETTLE_TIME = 200; // Wait after activating servo 2 (milliseconds)
+  
+  static constexpr bool HAS_FEEDER = true;       // Servo 2 fitted
+  static constexpr bool HAS_CLEAR_SENSOR = true; // Break-beam fitted (adaptive hold)
+  static constexpr bool HAS_SYNC_LINE = false;   // Wired to the other stations' sync line
+};
+
+// 1: inline gate over the shredder belt - the belt feeds itself, no feeder
+// servo or break-beam, and a shorter throw between the chutes. Stations
+// along the belt share a sync line for hand-offs.
+template <> struct MachineLayout<1> : MachineLayout<0> {
+  static constexpr int SERVO1_PIN = 9;
+  static constexpr int LEFT_POSITION = 30;
+  static constexpr int RIGHT_POSITION = 150;
+  static constexpr bool HAS_FEEDER = false;
+  static constexpr bool HAS_CLEAR_SENSOR = false;
+  static constexpr bool HAS_SYNC_LINE = true;
+};
+
+typedef MachineLayout<MACHINE_LAYOUT> Machine;
+
 // ============================================================================
 // CONFIGURATION
 // ============================================================================
 
 // Pin definitions
-const int SERVO1_PIN = 12;       // Primary sorting servo
-const int SERVO2_PIN = 13;       // Secondary servo
+const int SERVO1_PIN = Machine::SERVO1_PIN;
+const int SERVO2_PIN = Machine::SERVO2_PIN;
 const int LED_PIN = LED_BUILTIN; // Built-in LED (pin 13 conflict - using software control)
 
-// Servo positions (adjust these for your physical setup)
-const int LEFT_POSITION = 0;     // 0 degrees - for "safe to shred" items
-const int RIGHT_POSITION = 180;  // 180 degrees - for "special handling" items  
-const int CENTER_POSITION = 90;  // 90 degrees - neutral/home position
+// Servo positions (adjust these for your physical setup in the layout)
+const int LEFT_POSITION = Machine::LEFT_POSITION;
+const int RIGHT_POSITION = Machine::RIGHT_POSITION;
+const int CENTER_POSITION = Machine::CENTER_POSITION;
+
+// Secondary servo positions
+const int SERVO2_ACTIVE = Machine::SERVO2_ACTIVE;
+const int SERVO2_IDLE = Machine::SERVO2_IDLE;
 
-// Secondary servo positions (customize based on your needs)
-const int SERVO2_ACTIVE = 90;    // Active position for servo 2
-const int SERVO2_IDLE = 0;       // Idle position for servo 2
+// Gates (servos) on this board, indexing the gate state tables
+const byte GATE_SORT = 0;                             // Servo 1
+const byte GATE_FEEDER = 1;                           // Servo 2, if the layout has one
+const byte GATE_COUNT = Machine::HAS_FEEDER ? 2 : 1;
+const byte GATE_PINS[] = {SERVO1_PIN, SERVO2_PIN};
+const byte GATE_HOME[] = {CENTER_POSITION, SERVO2_IDLE};  // Pose at startup and between sorts
+const byte GATE_MOVING = 0x01;    // gateFlags: a sorting movement is running
+const byte GATE_PREARMED = 0x02;  // gateFlags: leaning off home, waiting for a decision
 
 // Timing settings
-const int MOVE_TIME = 800;        // Time to complete movement (milliseconds)
-const int HOLD_TIME = 600;       // Time to hold position (milliseconds)
-const int STEP_DELAY = 15;       // Delay between servo steps for smooth movement
+const int MOVE_TIME = Machine::MOVE_TIME;
+const int HOLD_TIME = Machine::HOLD_TIME;
+const int STEP_DELAY = Machine::STEP_DELAY;
+const int SERVO2_SETTLE_TIME = Machine::SERVO2_SETTLE_TIME;
+
+// Pre-positioning (PREARM): while the host waits for a decision, servo 1 leans
+// toward the side the recent class mix favors, so the sort sweeps less
+const int PREARM_MAX_OFFSET = 45;          // Degrees from center when every recent item went one way
+const int PREARM_MIX_WEIGHT = 8;           // Each sort moves the running mix 1/8 of the way
+const unsigned long PREARM_TIMEOUT = 10000; // Back to center if no command follows (milliseconds)
+
+// Motion gestures for servo 1, picked per sort by name after the direction
+// ("LEFT FLICK #42"); no name means STANDARD. Keyframes are stored in flash
+// and positions are a percentage of the throw from center to the sort side.
+struct GestureKeyframe {
+  byte throwPercent;   // 0 = center, 100 = LEFT_POSITION / RIGHT_POSITION
+  byte stepDegrees;    // Profile: degrees per step
+  byte stepDelayMs;    // Profile: time per step
+  uint16_t settleMs;   // Wait after the final write of the move
+  uint16_t holdMs;     // Dwell at the keyframe before the next one
+};
+
+const int GESTURE_NAME_SIZE = 9;
+const int GESTURE_MAX_KEYFRAMES = 3;
+struct Gesture {
+  char name[GESTURE_NAME_SIZE];
+  byte keyframeCount;
+  GestureKeyframe keyframes[GESTURE_MAX_KEYFRAMES];
+};
+
+const Gesture GESTURES[] PROGMEM = {
+  // Full throw, hold, return: the original sort, for anything not classified
+  {"STANDARD", 2, {{100, 2, STEP_DELAY, MOVE_TIME, HOLD_TIME}, {0, 2, STEP_DELAY, MOVE_TIME, 0}}},
+  // Light items (cables, small boards): faster throw, short settle and dwell
+  // (step size and rate checked against sim/servo_sim's overshoot tolerance)
+  {"FLICK", 2, {{100, 3, 12, 60, 150}, {0, 3, 12, 60, 0}}},
+  // Heavy items (power supplies, drives): half throw to get the item moving,
+  // then a slow full throw and a long hold so it clears the gate
+  {"PUSH", 3, {{50, 2, STEP_DELAY, 200, 0}, {100, 1, 20, MOVE_TIME, 900}, {0, 2, STEP_DELAY, MOVE_TIME, 0}}}
+};
+const byte GESTURE_COUNT = sizeof(GESTURES) / sizeof(GESTURES[0]);
+const byte GESTURE_STANDARD = 0;
+
+// Servo pulse width for every setpoint, built at compile time. Servo::write()
+// converts degrees with map(), a 32-bit multiply and divide on every motion
+// tick; the gates write through writeServo() instead, which is one flash read.
+// Same formula as Servo::write() (default attach() limits), so the pulses
+// are identical.
+constexpr uint16_t servoPulseUs(int degrees) {
+  return MIN_PULSE_WIDTH + (long)degrees * (MAX_PULSE_WIDTH - MIN_PULSE_WIDTH) / 180;
+}
+#define SERVO_PULSES_4(d) servoPulseUs(d), servoPulseUs((d) + 1), servoPulseUs((d) + 2), servoPulseUs((d) + 3)
+#define SERVO_PULSES_20(d) SERVO_PULSES_4(d), SERVO_PULSES_4((d) + 4), SERVO_PULSES_4((d) + 8), \
+                           SERVO_PULSES_4((d) + 12), SERVO_PULSES_4((d) + 16)
+const uint16_t SERVO_PULSE_US[181] PROGMEM = {
+  SERVO_PULSES_20(0), SERVO_PULSES_20(20), SERVO_PULSES_20(40), SERVO_PULSES_20(60), SERVO_PULSES_20(80),
+  SERVO_PULSES_20(100), SERVO_PULSES_20(120), SERVO_PULSES_20(140), SERVO_PULSES_20(160), servoPulseUs(180)
+};
+static_assert(servoPulseUs(0) == MIN_PULSE_WIDTH && servoPulseUs(180) == MAX_PULSE_WIDTH, "pulse table ends");
+
+// Adaptive hold: a break-beam below the gate (LOW = beam blocked) times how
+// long items take to clear once the gate reaches the drop pose. After
+// HOLD_MIN_SAMPLES items of one direction and gesture, that class holds for
+// the learned HOLD_QUANTILE clear time plus HOLD_MARGIN instead of the
+// gesture's fixed hold. With no sensor fitted the input idles HIGH, no item
+// is ever seen and the fixed holds stay.
+// Layouts without the sensor keep no estimates and always use the fixed holds.
+const int CLEAR_SENSOR_PIN = Machine::CLEAR_SENSOR_PIN;
+const int HOLD_QUANTILE = 90;                // Percent of items that should clear within the hold
+const unsigned int HOLD_MARGIN = 100;        // Added to the learned quantile (milliseconds)
+const unsigned int HOLD_MIN = 100;           // Bounds for a learned hold (milliseconds)
+const unsigned int HOLD_MAX = 2000;
+const int HOLD_MIN_SAMPLES = 10;
+const int HOLD_EWMA_WEIGHT = 8;              // Each sample moves the average 1/8 of the way
+const unsigned int HOLD_QUANTILE_STEP = 20;  // Quantile estimator step per sample (milliseconds)
+
+// Background health check (replaces the blocking TEST at startup): once no
+// sort has run for HEALTH_IDLE_TIME, the firmware checks what it can observe,
+// the clear sensor: it must not read blocked while nothing is being sorted,
+// and it must have seen an item in at least one of the last
+// HEALTH_SILENT_SORTS sorts (a sensor that always reads clear is unplugged or
+// misaligned). The servos have no position feedback, so each gate only
+// twitches a few degrees out and back as a liveness sign an operator can see;
+// the firmware cannot tell whether it moved. A sort or STOP arriving
+// mid-check cancels it at the next step.
+const unsigned long HEALTH_INTERVAL = 60000;   // Between checks (milliseconds)
+const unsigned long HEALTH_IDLE_TIME = 3000;   // No sort this long before a check
+const int HEALTH_TWITCH_DEGREES = 4;
+const byte HEALTH_SILENT_SORTS = 5;            // Sorts in a row without an item in the beam
+const byte HEALTH_BEAM_BLOCKED = 0x01;         // Fault flags, reported by HEALTH and STATUS
+const byte HEALTH_BEAM_SILENT = 0x02;
+
+// Line clock: milliseconds on a time base shared by every controller on the
+// line, so hand-offs between stations can be scheduled ("LEFT AT <line ms>").
+// SYNC <line ms> from the host sets it, as precisely as the serial link
+// allows (about a millisecond over USB). With a sync line (HAS_SYNC_LINE) one
+// board, built with -DSYNC_SOURCE=1, raises SYNC_PIN at every SYNC_PERIOD_MS
+// boundary of its line clock; the others timestamp the rising edge in an
+// interrupt and snap their line clock to the nearest boundary, which keeps
+// them within a few microseconds of the source and cancels crystal drift.
+// SYNC then only picks the period, so its error must stay under half of
+// SYNC_PERIOD_MS.
+#ifndef SYNC_SOURCE
+#define SYNC_SOURCE 0
+#endif
+const int SYNC_PIN = Machine::SYNC_PIN;
+const unsigned long SYNC_PERIOD_MS = 100;
+const unsigned long SYNC_PULSE_US = 1000;          // Source: how long the line stays high
+const unsigned long SYNC_SPIN_US = 2000;           // Source: busy-wait the last stretch before an edge
+const unsigned long SYNC_LOCK_TIMEOUT_US = 3 * SYNC_PERIOD_MS * 1000UL;  // No edge this long = unlocked
+const unsigned long SCHEDULE_MAX_LEAD_MS = 10000;  // Start times further ahead are refused
+const unsigned long LINE_ANCHOR_MAX_US = 1000000000UL;  // Re-anchor before micros() differences overflow
+static_assert(!SYNC_SOURCE || Machine::HAS_SYNC_LINE, "SYNC_SOURCE needs a layout with a sync line");
+
+// Controller identity, reported by HELLO so one host can drive several lanes
+const int LANE_ID = 1;              // Give each board on the same host its own id
+const int PROTOCOL_VERSION = 4;     // 2: " @<seq>" sequence ids, answered with "READY @<seq>"
+                                    // 3: priority classes, so replies can come out of send order
+                                    // 4: line clock (SYNC, " AT <line ms>" start times)
 
 // Serial settings
-const long BAUD_RATE = 115200;
+const long BAUD_RATE = 115200;           // USB Serial
+const long PROTOCOL_BAUD_RATE = 1000000; // Protocol UART (1M and 2M divide 16 MHz exactly)
 const int SERIAL_TIMEOUT = 2000;
+// Rates the host may switch the protocol port to with BAUD (listed in HELLO).
+// A new rate reverts to the old one unless BAUD CONFIRM arrives within
+// BAUD_VERIFY_TIMEOUT, so a rate the cable can't carry never strands the link.
+const unsigned long BAUD_RATES[] = {250000, 500000, 1000000, 2000000};
+const int BAUD_RATE_COUNT = sizeof(BAUD_RATES) / sizeof(BAUD_RATES[0]);
+const unsigned long BAUD_VERIFY_TIMEOUT = 2000;
+const int MAX_COMMAND_LENGTH = 64;  // Longer lines are rejected with "ERROR: Command too long"
+const int SEQUENCE_TAG_MAX_LENGTH = 7;  // " @65535"
+// Payload of one ECHO line: "ECHO <hex> <crc16>" plus a sequence tag must fit
+// in MAX_COMMAND_LENGTH (23 bytes, 46 hex characters)
+const int ECHO_MAX_BYTES = (MAX_COMMAND_LENGTH - 10 - SEQUENCE_TAG_MAX_LENGTH) / 2;
+const int COMMAND_QUEUE_SIZE = 4;   // Sorts buffered while a movement runs (QUEUE in HELLO)
+const int URGENT_QUEUE_SIZE = 1;    // STOP / RESUME
+const int DIAGNOSTIC_QUEUE_SIZE = 2; // STATUS, TEST, HEALTH, ... (full = rejected, sorts unaffected)
+const int RECENT_RESULTS_SIZE = 8;  // Completed movements remembered for duplicate sequence ids
+
+// Machine protocol port. 0 keeps the protocol on USB Serial together with the
+// debug output; 1-3 move it to hardware UART Serial1-Serial3 (a USB-UART bridge
+// on TX1/RX1 = pins 18/19 for Serial1) at PROTOCOL_BAUD_RATE, so commands and
+// replies never wait behind debug text. USB Serial then carries debug only.
+#ifndef PROTOCOL_UART
+#define PROTOCOL_UART 0
+#endif
+
+#if PROTOCOL_UART == 1
+#define HostSerial Serial1
+#elif PROTOCOL_UART == 2
+#define HostSerial Serial2
+#elif PROTOCOL_UART == 3
+#define HostSerial Serial3
+#else
+#define HostSerial Serial
+#endif
+#define DebugSerial Serial
+
+// Binary frame settings (telemetry and other machine-readable output)
+// Wire format: FRAME_START, COBS(type + payload + CRC16), 0x00
+// FRAME_START is outside the ASCII range so frames never collide with text lines
+const byte FRAME_START = 0xA5;
+const byte FRAME_TYPE_TELEMETRY = 0x01;
+const byte FRAME_TYPE_TRACE_HEADER = 0x02;
+const byte FRAME_TYPE_TRACE_EVENTS = 0x03;
+const int FRAME_MAX_PAYLOAD = 104;
+const int FRAME_MAX_ENCODED = FRAME_MAX_PAYLOAD + 7;  // Start + COBS overhead + type + CRC + end
+
+// Telemetry settings (stream is off until the host sends TELEMETRY <hz>)
+const byte TELEMETRY_VERSION = 1;
+const int TELEMETRY_MAX_HZ = 50;
+
+// Event trace settings (ring buffer flushed by TRACE DUMP)
+const int TRACE_BUFFER_SIZE = 128;      // 5 bytes per event
+const int TRACE_EVENTS_PER_FRAME = 20;
+
+// Benchmark markers: BENCHMARK_MARKERS builds write a section id to GPIOR0
+// on entry and id | 0x80 on exit so sim/avr_bench can count cycles per section.
+// Normal builds compile the markers away.
+#ifdef BENCHMARK_MARKERS
+#define BENCH_MARK(id) (GPIOR0 = (id))
+#else
+#define BENCH_MARK(id)
+#endif
+#define BENCH_END 0x80
+#define BENCH_SERVICE 0x01
+#define BENCH_POLL 0x02
+#define BENCH_PARSE 0x03
+#define BENCH_MOTION_TICK 0x04
+#define BENCH_TELEMETRY 0x05
+
+// Command codes returned by parseCommand()
+enum CommandCode {
+  CMD_UNKNOWN = 0,
+  CMD_LEFT,
+  CMD_RIGHT,
+  CMD_CENTER,
+  CMD_TEST,
+  CMD_STATUS,
+  CMD_TELEMETRY,
+  CMD_TRACE,
+  CMD_HELLO,
+  CMD_PREARM,
+  CMD_BAUD,
+  CMD_ECHO,
+  CMD_HEALTH,
+  CMD_STOP,
+  CMD_RESUME,
+  CMD_SYNC
+};
+
+// Command queue classes, highest priority first. The next command is always
+// the oldest one in the highest non-empty class, so a STOP overtakes queued
+// sorts and monitoring traffic only runs when no sort is waiting. Each class
+// has its own slots: a burst of STATUS can't take a sort's place.
+enum CommandPriority {
+  PRIORITY_URGENT = 0,
+  PRIORITY_SORT,
+  PRIORITY_DIAGNOSTIC,
+  PRIORITY_COUNT
+};
+const byte QUEUE_CAPACITY[PRIORITY_COUNT] = {URGENT_QUEUE_SIZE, COMMAND_QUEUE_SIZE, DIAGNOSTIC_QUEUE_SIZE};
+const byte QUEUE_OFFSET[PRIORITY_COUNT] = {0, URGENT_QUEUE_SIZE, URGENT_QUEUE_SIZE + COMMAND_QUEUE_SIZE};
+const int QUEUE_SLOTS = URGENT_QUEUE_SIZE + COMMAND_QUEUE_SIZE + DIAGNOSTIC_QUEUE_SIZE;
+
+// Trace event ids - keep in sync with TRACE_EVENT_NAMES in finalanalyze.py
+// Phases are recorded twice: begin with the id, end with id | TRACE_END
+const byte TRACE_END = 0x80;
+const byte TRACE_TIME_EXTEND = 0x01;    // Instant: arg = upper 16 bits of the next delta
+const byte TRACE_COMMAND_QUEUED = 0x02; // Instant: arg = queue depth
+const byte TRACE_QUEUE_FULL = 0x03;     // Instant
+const byte TRACE_ITEM = 0x04;           // Instant: arg = host item id
+const byte TRACE_COMMAND = 0x10;        // Phase: arg = command code
+const byte TRACE_PARSE = 0x11;          // Phase: arg = command code (on end)
+const byte TRACE_SORT = 0x12;           // Phase: arg = target position
+const byte TRACE_SERVO2_ACTIVATE = 0x13;
+const byte TRACE_MOVE = 0x14;           // Phase: arg = target position
+const byte TRACE_HOLD = 0x15;
+const byte TRACE_RETURN = 0x16;
+const byte TRACE_PREARM = 0x17;         // Phase: arg = target position
+const byte TRACE_HEALTH = 0x18;         // Phase: arg = fault flags at the end
 
 // ============================================================================
 // GLOBAL VARIABLES
 // ============================================================================
 
-Servo servo1;                    // Primary sorting servo
-Servo servo2;                    // Secondary servo
+// Gate state, one column per gate. Poses are whole degrees (0-180) and the
+// flags are bits, so those fields are a byte; more gates means longer
+// columns, not more globals, and a pass over the gates reads one column at
+// a time.
+Servo gateServo[GATE_COUNT];
+byte gatePosition[GATE_COUNT];   // Last setpoint written
+byte gateTarget[GATE_COUNT];     // Where the gate is heading
+byte gateFlags[GATE_COUNT];      // GATE_MOVING, GATE_PREARMED
+unsigned long gatePrearmTime[GATE_COUNT];  // millis() when GATE_PREARMED was set
 String inputBuffer = "";         // Buffer for serial input
-int currentPosition1 = CENTER_POSITION;  // Track servo1 position
-int currentPosition2 = SERVO2_IDLE;      // Track servo2 position
+bool inputTooLong = false;       // Current line overran MAX_COMMAND_LENGTH
 bool systemReady = false;        // System ready flag
+bool stopped = false;            // STOP received; sorts are refused until RESUME
+
+// Clear time estimates, one per sort side and gesture (index: gesture * 2 + side)
+struct HoldEstimate {
+  unsigned int averageMs;   // EWMA of the clear time
+  unsigned int quantileMs;  // Streaming HOLD_QUANTILE estimate
+  unsigned int samples;
+};
+const int HOLD_CLASSES = Machine::HAS_CLEAR_SENSOR ? 2 * GESTURE_COUNT : 0;
+HoldEstimate holdEstimates[HOLD_CLASSES > 0 ? HOLD_CLASSES : 1];
+bool beamBlocked = false;        // Clear sensor state at the last poll
+bool beamItemSeen = false;       // Beam broken since the current sort started
+unsigned long beamClearedMs = 0; // When the beam last went from blocked to clear
+
+// Running class mix for PREARM: share of recent sorts that went LEFT, 0-256
+int leftShare = 128;
+
+// Background health check results
+struct HealthState {
+  unsigned long lastCheck;    // millis() of the last completed check
+  unsigned int checks;
+  unsigned int degraded;      // Checks that found a fault
+  unsigned int cancelled;     // Checks cut short by a command
+  byte faults;                // HEALTH_* flags from the last check
+  byte silentSorts;           // LEFT/RIGHT sorts in a row the clear sensor saw nothing
+  bool due;                   // Check at the next idle gap (startup, HEALTH NOW)
+};
+HealthState health = {0, 0, 0, 0, 0, 0, true};
+unsigned long lastCommandTime = 0;  // Last sort-class or urgent command
+
+// Command queue (filled by pollSerial, drained by loop): one ring per
+// priority class, each at QUEUE_OFFSET in the shared slots
+String commandQueue[QUEUE_SLOTS];
+unsigned long commandArrivedMicros[QUEUE_SLOTS];  // micros() when each queued line arrived
+unsigned long dequeuedArrivedMicros = 0;          // ... for the line last dequeued
+byte queueHead[PRIORITY_COUNT];
+byte queueCount[PRIORITY_COUNT];
+int commandQueueCount = 0;       // All classes
+
+// Results of recent movement commands by sequence id, so a host retry of a
+// command that already ran gets the same answer instead of a second sort
+struct RecentResult {
+  unsigned int sequence;   // 0 = empty slot
+  byte code;               // CommandCode
+  bool success;
+  unsigned int itemId;
+  unsigned long motionMs;
+};
+RecentResult recentResults[RECENT_RESULTS_SIZE];
+int recentResultsNext = 0;
+unsigned long lastSortMs = 0;    // Duration of the last sorting movement
+
+// Line clock: line time lineAnchorMs was at local micros() lineAnchorMicros
+unsigned long lineAnchorMs = 0;
+unsigned long lineAnchorMicros = 0;
+volatile unsigned long syncEdgeMicros = 0;  // Set by onSyncEdge()
+volatile byte syncEdgeCount = 0;
+byte syncEdgesTaken = 0;
+unsigned long syncEdges = 0;             // Edges applied (sent, on the source)
+unsigned long lastEdgeMicros = 0;
+long syncStepUs = 0;                     // Last correction (SYNC or edge)
+unsigned long nextPulseMs = SYNC_PERIOD_MS;  // Source: line time of the next edge
+bool pulseHigh = false;
+unsigned int lateStarts = 0;             // AT start times that had already passed
 
 // Statistics
 unsigned long totalMoves = 0;
 unsigned long leftMoves = 0;
 unsigned long rightMoves = 0;
+unsigned long errorCount = 0;
 unsigned long startTime = 0;
 
+// Protocol port rate (BAUD): pending switch after READY, and the rate to fall
+// back to while the new one is unconfirmed
+unsigned long protocolBaud = 0;
+unsigned long pendingBaud = 0;
+unsigned long fallbackBaud = 0;
+unsigned long baudSwitchTime = 0;
+bool baudUnconfirmed = false;
+
+// Telemetry
+unsigned long telemetryIntervalMs = 0;   // 0 = telemetry disabled
+unsigned long lastTelemetryTime = 0;
+unsigned int telemetrySequence = 0;
+
+// Event trace ring buffer
+struct TraceEvent {
+  byte id;
+  uint16_t deltaMicros;   // Time since the previous event
+  uint16_t arg;
+};
+TraceEvent traceBuffer[TRACE_BUFFER_SIZE];
+int traceHead = 0;                 // Index of the oldest event
+int traceCount = 0;
+unsigned int traceOverwritten = 0; // Events lost to wraparound since last dump
+unsigned long lastTraceMicros = 0;
+
+// Service loop timing (interval between serviceBackground calls)
+unsigned long lastServiceMicros = 0;
+unsigned long loopTimeMin = 0xFFFFFFFF;
+unsigned long loopTimeMax = 0;
+unsigned long loopTimeSum = 0;
+unsigned long loopTimeSamples = 0;
+
+// ============================================================================
+// FUNCTION PROTOTYPES
+// ============================================================================
+// Needed outside the Arduino IDE (which generates these for .ino sketches)
+
+void serviceBackground();
+void waitMs(unsigned long ms);
+void pollSerial();
+bool enqueueCommand(const String &line);
+bool dequeueCommand(String &command, byte &priority);
+bool dequeueFromClass(byte priority, String &command);
+CommandPriority commandPriority(const String &line);
+void stopSorting();
+bool initializeServos();
+bool executeSortingMovement(String direction, unsigned int itemId, byte gesture);
+void moveServoSmoothly(byte gate, int toPos, const GestureKeyframe &profile);
+void writeServo(byte gate, int degrees);
+int trajectoryStepCount(int fromPos, int toPos, int stepDegrees = 2);
+int trajectoryPosition(int fromPos, int toPos, int step, int stepDegrees = 2);
+int keyframePosition(int sidePosition, byte throwPercent);
+void prearmGate();
+bool gatePrearmed(byte gate);
+void setGateFlag(byte gate, byte flag, bool on);
+int prearmPosition();
+bool stepGateToward(int toPos);
+void updateClassMix(int targetPosition);
+void pollClearSensor();
+unsigned int learnedHoldMs(int holdClass, unsigned int fixedMs);
+void recordClearTime(int holdClass, unsigned long holdStart, unsigned int holdMs);
+void processCommand(String command);
+CommandCode parseCommandLine(String &command, unsigned int &itemId, byte &gesture, unsigned int &sequence,
+                             unsigned long &startAt);
+unsigned int extractSequence(String &command);
+unsigned int extractItemId(String &command);
+unsigned long extractStartTime(String &command);
+byte extractGesture(String &command);
+int findGesture(const String &name);
+CommandCode parseCommand(const String &command);
+void runCompleteTest();
+void runHealthCheckIfDue();
+bool twitchGate(byte gate);
+void printHealth(String argument);
+String healthFaultNames(byte faults);
+void printSystemStatus();
+void printHello();
+const RecentResult *findRecentResult(unsigned int sequence);
+void rememberResult(unsigned int sequence, CommandCode code, bool success, unsigned int itemId);
+void replayResult(const RecentResult &result);
+void clearRecentResults();
+void writeSystemStatus(Print &out);
+void serviceLineClock();
+void onSyncEdge();
+void applySyncEdge(unsigned long edgeMicros);
+void driveSyncLine();
+unsigned long nextSyncBoundary();
+bool lineClockLocked();
+void anchorLineClock(unsigned long lineMs, unsigned long localMicros);
+unsigned long lineTimeAt(unsigned long localMicros, long &remainderUs);
+unsigned long lineMillis();
+long lineMicrosUntil(unsigned long lineMs);
+void handleSyncCommand(String argument);
+bool waitForLineTime(unsigned long startAt);
+void handleBaudCommand(String argument);
+void switchBaudRate();
+void checkBaudConfirmed();
+void handleEchoCommand(String argument);
+int hexValue(char c);
+void configureTelemetry(String argument);
+void sendTelemetryIfDue();
+void traceEvent(byte id, uint16_t arg);
+void traceAppend(byte id, uint16_t delta, uint16_t arg);
+void handleTraceCommand(String argument);
+void dumpTrace();
+void clearTrace();
+void sendFrame(byte type, const byte *payload, int length);
+int encodeFrame(byte type, const byte *payload, int length, byte *out);
+int cobsEncode(const byte *data, int length, byte *out);
+unsigned int crc16(const byte *data, int length);
+int putUint16(byte *buffer, int offset, unsigned int value);
+int putUint32(byte *buffer, int offset, unsigned long value);
+unsigned int saturate16(unsigned long value);
+void performStartupSequence();
+void performErrorSequence();
+int freeMemory();
+
 // ============================================================================
 // SETUP FUNCTION
 // ============================================================================
@@ -61,7 +548,12 @@ unsigned long startTime = 0;
 void setup() {
   // Initialize serial communication
   Serial.begin(BAUD_RATE);
-  Serial.setTimeout(SERIAL_TIMEOUT);
+  protocolBaud = BAUD_RATE;
+#if PROTOCOL_UART != 0
+  protocolBaud = PROTOCOL_BAUD_RATE;
+  HostSerial.begin(protocolBaud);
+#endif
+  HostSerial.setTimeout(SERIAL_TIMEOUT);
   
   // Startup sequence
   performStartupSequence();
@@ -72,19 +564,41 @@ void setup() {
     startTime = millis();
     
     // Send startup message
-    Serial.println("============================================");
-    Serial.println("Arduino Dual Servo ML Sorting Controller");
-    Serial.println("Servo 1 (Pin 12): Primary sorting");
-    Serial.println("Servo 2 (Pin 13): Secondary control");
-    Serial.println("Commands: LEFT, RIGHT, CENTER, TEST, STATUS");
-    Serial.println("============================================");
-    Serial.println("System initialized successfully");
-    Serial.println("READY");
+    DebugSerial.println("============================================");
+    DebugSerial.println("Arduino Dual Servo ML Sorting Controller");
+    DebugSerial.println("Machine layout " + String(MACHINE_LAYOUT));
+    DebugSerial.println("Servo 1 (Pin " + String(SERVO1_PIN) + "): Primary sorting");
+    if (Machine::HAS_FEEDER) {
+      DebugSerial.println("Servo 2 (Pin " + String(SERVO2_PIN) + "): Secondary control");
+    }
+    DebugSerial.println("Commands: LEFT, RIGHT, CENTER, PREARM, TEST, STATUS, TELEMETRY, STOP, RESUME, SYNC");
+    DebugSerial.println("============================================");
+    DebugSerial.println("System initialized successfully");
+#if PROTOCOL_UART != 0
+    DebugSerial.println("Protocol on Serial" + String(PROTOCOL_UART) + " at " + String(PROTOCOL_BAUD_RATE) + " baud");
+#endif
+    HostSerial.println("READY");
   } else {
-    Serial.println("ERROR: Servo initialization failed!");
+    HostSerial.println("ERROR: Servo initialization failed!");
     performErrorSequence();
   }
   
+  // Break-beam for adaptive hold (idles HIGH when not fitted)
+  if (Machine::HAS_CLEAR_SENSOR) {
+    pinMode(CLEAR_SENSOR_PIN, INPUT_PULLUP);
+  }
+  
+  // Sync line: the source drives it, the other stations listen for edges
+  if (Machine::HAS_SYNC_LINE) {
+    if (SYNC_SOURCE) {
+      pinMode(SYNC_PIN, OUTPUT);
+    } else {
+      pinMode(SYNC_PIN, INPUT);
+      attachInterrupt(digitalPinToInterrupt(SYNC_PIN), onSyncEdge, RISING);
+    }
+  }
+  anchorLineClock(0, micros());
+  
   // Reserve string space for efficiency
   inputBuffer.reserve(100);
 }
@@ -94,15 +608,147 @@ void setup() {
 // ============================================================================
 
 void loop() {
-  // Process serial commands
-  if (Serial.available() > 0) {
-    String command = Serial.readStringUntil('\n');
-    command.trim();
+  // Read serial input, stream telemetry, track loop timing
+  serviceBackground();
+  
+  // Process the next queued command
+  String command;
+  byte priority;
+  if (dequeueCommand(command, priority)) {
     processCommand(command);
+    // Diagnostics (HEALTH, STATUS, SYNC, ...) don't postpone the health check
+    if (priority != PRIORITY_DIAGNOSTIC) lastCommandTime = millis();
+  } else if (gatePrearmed(GATE_SORT) && millis() - gatePrearmTime[GATE_SORT] > PREARM_TIMEOUT) {
+    // No decision came (e.g. the analysis failed); stop leaning
+    setGateFlag(GATE_SORT, GATE_PREARMED, !stepGateToward(CENTER_POSITION));
+  } else {
+    runHealthCheckIfDue();
+  }
+}
+
+// ============================================================================
+// BACKGROUND SERVICE
+// ============================================================================
+
+// Runs everything that must keep going while a movement is in progress.
+// Called from loop() and from waitMs() in place of delay().
+void serviceBackground() {
+  BENCH_MARK(BENCH_SERVICE);
+  unsigned long now = micros();
+  if (lastServiceMicros != 0) {
+    unsigned long interval = now - lastServiceMicros;
+    if (interval < loopTimeMin) loopTimeMin = interval;
+    if (interval > loopTimeMax) loopTimeMax = interval;
+    loopTimeSum += interval;
+    loopTimeSamples++;
   }
+  lastServiceMicros = now;
   
-  // Small delay to prevent overwhelming the processor
-  delay(10);
+  pollSerial();
+  if (Machine::HAS_CLEAR_SENSOR) pollClearSensor();
+  sendTelemetryIfDue();
+  checkBaudConfirmed();
+  serviceLineClock();
+  BENCH_MARK(BENCH_SERVICE | BENCH_END);
+}
+
+// Delay replacement that keeps serial input and telemetry serviced
+void waitMs(unsigned long ms) {
+  unsigned long start = millis();
+  while (millis() - start < ms) {
+    serviceBackground();
+  }
+}
+
+// Non-blocking read of serial input; complete lines go to the command queue
+void pollSerial() {
+  BENCH_MARK(BENCH_POLL);
+  while (HostSerial.available() > 0) {
+    char c = HostSerial.read();
+    
+    if (c == '\n') {
+      inputBuffer.trim();
+      if (inputTooLong) {
+        // Cut short, so running it could drop an argument or the sequence tag
+        HostSerial.println("ERROR: Command too long - " + inputBuffer);
+        errorCount++;
+        inputTooLong = false;
+      } else if (inputBuffer.length() > 0) {
+        if (enqueueCommand(inputBuffer)) {
+          traceEvent(TRACE_COMMAND_QUEUED, commandQueueCount);
+        } else {
+          HostSerial.println("ERROR: Command queue full - " + inputBuffer);
+          traceEvent(TRACE_QUEUE_FULL, 0);
+          errorCount++;
+        }
+      }
+      inputBuffer = "";
+    } else if (c != '\r') {
+      if (inputBuffer.length() < MAX_COMMAND_LENGTH) {
+        inputBuffer += c;
+      } else {
+        inputTooLong = true;
+      }
+    }
+  }
+  BENCH_MARK(BENCH_POLL | BENCH_END);
+}
+
+// Adds a line to the tail of its class's queue; false when that queue is full
+bool enqueueCommand(const String &line) {
+  byte priority = commandPriority(line);
+  if (queueCount[priority] >= QUEUE_CAPACITY[priority]) return false;
+  int tail = (queueHead[priority] + queueCount[priority]) % QUEUE_CAPACITY[priority];
+  commandQueue[QUEUE_OFFSET[priority] + tail] = line;
+  commandArrivedMicros[QUEUE_OFFSET[priority] + tail] = micros();  // SYNC's line time refers to this
+  queueCount[priority]++;
+  commandQueueCount++;
+  return true;
+}
+
+// Takes the oldest line of the highest-priority class that has one and
+// sets priority to that class, so the line isn't parsed again to find it;
+// false when every queue is empty
+bool dequeueCommand(String &command, byte &priority) {
+  for (priority = 0; priority < PRIORITY_COUNT; priority++) {
+    if (dequeueFromClass(priority, command)) return true;
+  }
+  return false;
+}
+
+bool dequeueFromClass(byte priority, String &command) {
+  if (queueCount[priority] == 0) return false;
+  String &slot = commandQueue[QUEUE_OFFSET[priority] + queueHead[priority]];
+  command = slot;
+  slot = "";
+  dequeuedArrivedMicros = commandArrivedMicros[QUEUE_OFFSET[priority] + queueHead[priority]];
+  queueHead[priority] = (queueHead[priority] + 1) % QUEUE_CAPACITY[priority];
+  queueCount[priority]--;
+  commandQueueCount--;
+  return true;
+}
+
+// Queue class of a raw command line. Unknown commands go with diagnostics,
+// where their error reply can't hold up a sort. So do BAUD and ECHO: STOP
+// cancels the sort class, and must not cancel a BAUD CONFIRM mid-switch.
+CommandPriority commandPriority(const String &line) {
+  String command = line;
+  unsigned int itemId;
+  byte gesture;
+  unsigned int sequence;
+  unsigned long startAt;
+  switch (parseCommandLine(command, itemId, gesture, sequence, startAt)) {
+    case CMD_STOP:
+    case CMD_RESUME:
+      return PRIORITY_URGENT;
+    case CMD_LEFT:
+    case CMD_RIGHT:
+    case CMD_CENTER:
+    case CMD_PREARM:
+      return PRIORITY_SORT;
+    default:
+      return PRIORITY_DIAGNOSTIC;
+  }
 }
 
 // ============================================================================
@@ -110,33 +756,40 @@ void loop() {
 // ============================================================================
 
 bool initializeServos() {
-  Serial.println("Initializing servos...");
+  DebugSerial.println("Initializing servos...");
   
-  try {
-    // Attach servos to pins
-    servo1.attach(SERVO1_PIN);
-    servo2.attach(SERVO2_PIN);
-    delay(500);  // Allow servos to initialize
-    
-    // Move to initial positions
-    servo1.write(CENTER_POSITION);
-    servo2.write(SERVO2_IDLE);
-    currentPosition1 = CENTER_POSITION;
-    currentPosition2 = SERVO2_IDLE;
-    delay(1000);
-    
-    Serial.println("Both servos initialized and positioned");
-    return true;
-    
-  } catch (...) {
-    Serial.println("ERROR: Servo initialization failed");
-    return false;
+  // Attach servos to pins (AVR builds have no exceptions; attach reports failure)
+  for (byte gate = 0; gate < GATE_COUNT; gate++) {
+    if (gateServo[gate].attach(GATE_PINS[gate]) == INVALID_SERVO) {
+      DebugSerial.println("ERROR: Servo initialization failed");
+      return false;
+    }
   }
+  delay(500);  // Allow servos to initialize
+  
+  // Move to initial positions
+  for (byte gate = 0; gate < GATE_COUNT; gate++) {
+    writeServo(gate, GATE_HOME[gate]);
+    gateTarget[gate] = GATE_HOME[gate];
+  }
+  delay(1000);
+  
+  DebugSerial.println("Both servos initialized and positioned");
+  return true;
 }
 
-bool executeSortingMovement(String direction) {
+// itemId is the host's per-item trace id (0 = none); when set, a
+// "DONE <id> <direction> <motion ms>" line reports completion.
+// gesture indexes GESTURES and sets the keyframes servo 1 runs through.
+bool executeSortingMovement(String direction, unsigned int itemId, byte gesture) {
   if (!systemReady) {
-    Serial.println("ERROR: System not ready");
+    HostSerial.println("ERROR: System not ready");
+    errorCount++;
+    return false;
+  }
+  if (stopped) {
+    HostSerial.println("ERROR: Stopped - send RESUME");
+    errorCount++;
     return false;
   }
   
@@ -153,70 +806,257 @@ bool executeSortingMovement(String direction) {
   } else if (direction == "CENTER") {
     targetPosition = CENTER_POSITION;
   } else {
-    Serial.println("ERROR: Invalid direction - " + direction);
+    HostSerial.println("ERROR: Invalid direction - " + direction);
+    errorCount++;
     return false;
   }
   
-  Serial.print("Executing sorting movement: ");
-  Serial.println(direction);
+  Gesture motion;
+  memcpy_P(&motion, &GESTURES[gesture < GESTURE_COUNT ? gesture : GESTURE_STANDARD], sizeof(motion));
   
-  try {
-    // Activate secondary servo (optional - for item feeding/conveyor)
-    if (direction != "CENTER") {
-      servo2.write(SERVO2_ACTIVE);
-      delay(200);
-    }
-    
-    // Move primary sorting servo smoothly
-    moveServoSmoothly(servo1, currentPosition1, targetPosition);
-    currentPosition1 = targetPosition;
-    
-    // Hold position
-    delay(HOLD_TIME);
+  DebugSerial.print("Executing sorting movement: ");
+  if (gesture != GESTURE_STANDARD) {
+    DebugSerial.println(direction + " " + motion.name);
+  } else {
+    DebugSerial.println(direction);
+  }
+  unsigned long sortStart = millis();
+  for (byte gate = 0; gate < GATE_COUNT; gate++) setGateFlag(gate, GATE_MOVING, true);
+  beamItemSeen = beamBlocked;
+  int holdClass = gesture * 2 + (targetPosition == RIGHT_POSITION ? 1 : 0);
+  if (itemId != 0) {
+    traceEvent(TRACE_ITEM, itemId);
+  }
+  traceEvent(TRACE_SORT, targetPosition);
+  
+  // Activate secondary servo (optional - for item feeding/conveyor)
+  if (Machine::HAS_FEEDER && direction != "CENTER") {
+    traceEvent(TRACE_SERVO2_ACTIVATE, SERVO2_ACTIVE);
+    gateTarget[GATE_FEEDER] = SERVO2_ACTIVE;
+    writeServo(GATE_FEEDER, SERVO2_ACTIVE);
+    waitMs(SERVO2_SETTLE_TIME);
+    traceEvent(TRACE_SERVO2_ACTIVATE | TRACE_END, SERVO2_ACTIVE);
+  }
+  
+  // Run the primary sorting servo through the gesture's keyframes
+  for (int k = 0; k < motion.keyframeCount; k++) {
+    const GestureKeyframe &frame = motion.keyframes[k];
+    int framePosition = keyframePosition(targetPosition, frame.throwPercent);
     
-    // Return primary servo to center (unless already there)
-    if (targetPosition != CENTER_POSITION) {
-      Serial.println("Returning to center position");
-      moveServoSmoothly(servo1, currentPosition1, CENTER_POSITION);
-      currentPosition1 = CENTER_POSITION;
+    if (framePosition == CENTER_POSITION && gatePosition[GATE_SORT] != CENTER_POSITION) {
+      DebugSerial.println("Returning to center position");
+      traceEvent(TRACE_RETURN, CENTER_POSITION);
+      moveServoSmoothly(GATE_SORT, CENTER_POSITION, frame);
+      traceEvent(TRACE_RETURN | TRACE_END, CENTER_POSITION);
+    } else {
+      moveServoSmoothly(GATE_SORT, framePosition, frame);
     }
     
-    // Return secondary servo to idle
-    servo2.write(SERVO2_IDLE);
-    currentPosition2 = SERVO2_IDLE;
-    
-    // Update statistics
-    totalMoves++;
-    if (direction == "LEFT") {
-      leftMoves++;
-    } else if (direction == "RIGHT") {
-      rightMoves++;
+    // The hold at the drop pose adapts to how long items take to clear
+    bool dropPose = frame.throwPercent == 100 && targetPosition != CENTER_POSITION;
+    unsigned int holdMs = dropPose ? learnedHoldMs(holdClass, frame.holdMs) : frame.holdMs;
+    if (holdMs > 0) {
+      unsigned long holdStart = millis();
+      traceEvent(TRACE_HOLD, holdMs);
+      waitMs(holdMs);
+      traceEvent(TRACE_HOLD | TRACE_END, holdMs);
+      if (dropPose) recordClearTime(holdClass, holdStart, holdMs);
     }
-    
-    Serial.println("Sorting movement completed successfully");
-    return true;
-    
-  } catch (...) {
-    Serial.println("ERROR: Servo movement failed");
-    return false;
   }
+  
+  // Return secondary servo to idle
+  if (Machine::HAS_FEEDER) {
+    gateTarget[GATE_FEEDER] = SERVO2_IDLE;
+    writeServo(GATE_FEEDER, SERVO2_IDLE);
+  }
+  
+  // Update statistics
+  totalMoves++;
+  if (direction == "LEFT") {
+    leftMoves++;
+  } else if (direction == "RIGHT") {
+    rightMoves++;
+  }
+  updateClassMix(targetPosition);
+  if (Machine::HAS_CLEAR_SENSOR && targetPosition != CENTER_POSITION) {
+    if (beamItemSeen) {
+      health.silentSorts = 0;
+    } else if (health.silentSorts < 255) {
+      health.silentSorts++;
+    }
+  }
+  
+  for (byte gate = 0; gate < GATE_COUNT; gate++) {
+    setGateFlag(gate, GATE_MOVING | GATE_PREARMED, false);
+  }
+  traceEvent(TRACE_SORT | TRACE_END, targetPosition);
+  DebugSerial.println("Sorting movement completed successfully");
+  lastSortMs = millis() - sortStart;
+  if (itemId != 0) {
+    HostSerial.println("DONE " + String(itemId) + " " + direction + " " + String(lastSortMs));
+  }
+  return true;
 }
 
-void moveServoSmoothly(Servo &servo, int fromPos, int toPos) {
-  if (fromPos == toPos) return;
-  
-  int step = (toPos > fromPos) ? 2 : -2;
+// Steps the gate toward toPos with the keyframe's profile, keeping its
+// position/target up to date so telemetry reports the live setpoint while
+// the movement runs
+void moveServoSmoothly(byte gate, int toPos, const GestureKeyframe &profile) {
+  gateTarget[gate] = toPos;
+  if (gatePosition[gate] == toPos) return;
+  traceEvent(TRACE_MOVE, toPos);
   
-  for (int pos = fromPos; 
-       (step > 0 ? pos <= toPos : pos >= toPos); 
-       pos += step) {
-    servo.write(pos);
-    delay(STEP_DELAY);
+  int fromPos = gatePosition[gate];
+  int steps = trajectoryStepCount(fromPos, toPos, profile.stepDegrees);
+  for (int i = 0; i < steps; i++) {
+    BENCH_MARK(BENCH_MOTION_TICK);
+    writeServo(gate, trajectoryPosition(fromPos, toPos, i, profile.stepDegrees));
+    BENCH_MARK(BENCH_MOTION_TICK | BENCH_END);
+    waitMs(profile.stepDelayMs);
   }
   
   // Ensure exact final position
-  servo.write(toPos);
-  delay(MOVE_TIME);
+  writeServo(gate, toPos);
+  waitMs(profile.settleMs);
+  traceEvent(TRACE_MOVE | TRACE_END, toPos);
+}
+
+// One setpoint to a gate's servo, recorded as the gate's position. Positions
+// outside 0-180 are clamped like Servo::write().
+void writeServo(byte gate, int degrees) {
+  degrees = constrain(degrees, 0, 180);
+  gateServo[gate].writeMicroseconds(pgm_read_word(&SERVO_PULSE_US[degrees]));
+  gatePosition[gate] = degrees;
+}
+
+// Linear profile in stepDegrees steps (2 for STANDARD), one step per step
+// delay, starting at the current position. The last step can fall short of
+// toPos; moveServoSmoothly() finishes with an exact write.
+int trajectoryStepCount(int fromPos, int toPos, int stepDegrees) {
+  return abs(toPos - fromPos) / stepDegrees + 1;
+}
+
+int trajectoryPosition(int fromPos, int toPos, int step, int stepDegrees) {
+  return (toPos > fromPos) ? fromPos + stepDegrees * step : fromPos - stepDegrees * step;
+}
+
+// Position throwPercent of the way from center to sidePosition
+int keyframePosition(int sidePosition, byte throwPercent) {
+  return CENTER_POSITION + (long)(sidePosition - CENTER_POSITION) * throwPercent / 100;
+}
+
+// Leans servo 1 toward the likely side. A sort that arrives meanwhile cuts
+// the lean short and moves on from wherever the gate has got to, finishing
+// the sweep if the guess was right and reversing if it was wrong.
+void prearmGate() {
+  if (!systemReady || stopped) {
+    HostSerial.println(stopped ? "ERROR: Stopped - send RESUME" : "ERROR: System not ready");
+    errorCount++;
+    return;
+  }
+  int toPos = prearmPosition();
+  DebugSerial.println("Prearm position: " + String(toPos));
+  traceEvent(TRACE_PREARM, toPos);
+  stepGateToward(toPos);
+  traceEvent(TRACE_PREARM | TRACE_END, gatePosition[GATE_SORT]);
+  setGateFlag(GATE_SORT, GATE_PREARMED, gatePosition[GATE_SORT] != CENTER_POSITION);
+  gatePrearmTime[GATE_SORT] = millis();
+}
+
+bool gatePrearmed(byte gate) {
+  return gateFlags[gate] & GATE_PREARMED;
+}
+
+void setGateFlag(byte gate, byte flag, bool on) {
+  if (on) {
+    gateFlags[gate] |= flag;
+  } else {
+    gateFlags[gate] &= ~flag;
+  }
+}
+
+// Offset from center grows with how one-sided the running mix is
+int prearmPosition() {
+  int bias = leftShare - 128;
+  int offset = (long)abs(bias) * PREARM_MAX_OFFSET / 128;
+  int likely = bias > 0 ? LEFT_POSITION : RIGHT_POSITION;
+  return likely < CENTER_POSITION ? CENTER_POSITION - offset : CENTER_POSITION + offset;
+}
+
+// Same profile as moveServoSmoothly() but without the settle time, and it
+// stops early (returning false) as soon as a sort or urgent command is
+// queued. Diagnostics wait anyway, so a STATUS poll doesn't cut it short.
+bool stepGateToward(int toPos) {
+  gateTarget[GATE_SORT] = toPos;
+  int fromPos = gatePosition[GATE_SORT];
+  int steps = trajectoryStepCount(fromPos, toPos);
+  for (int i = 1; i < steps; i++) {
+    if (queueCount[PRIORITY_URGENT] + queueCount[PRIORITY_SORT] > 0) {
+      gateTarget[GATE_SORT] = gatePosition[GATE_SORT];
+      return false;
+    }
+    writeServo(GATE_SORT, trajectoryPosition(fromPos, toPos, i));
+    waitMs(STEP_DELAY);
+  }
+  writeServo(GATE_SORT, toPos);
+  return true;
+}
+
+// Tracks break-beam edges; called from serviceBackground()
+void pollClearSensor() {
+  bool blocked = digitalRead(CLEAR_SENSOR_PIN) == LOW;
+  if (blocked == beamBlocked) return;
+  beamBlocked = blocked;
+  if (blocked) {
+    beamItemSeen = true;
+  } else {
+    beamClearedMs = millis();
+  }
+}
+
+// Hold for a sort class: learned once it has enough samples, else the gesture's
+unsigned int learnedHoldMs(int holdClass, unsigned int fixedMs) {
+  if (!Machine::HAS_CLEAR_SENSOR) return fixedMs;
+  const HoldEstimate &estimate = holdEstimates[holdClass];
+  if (estimate.samples < HOLD_MIN_SAMPLES) return fixedMs;
+  return constrain(estimate.quantileMs + HOLD_MARGIN, HOLD_MIN, HOLD_MAX);
+}
+
+// Clear time is measured from the start of the hold at the drop pose (0 if
+// the item was through before the gate settled). An item still in the beam
+// when the hold ends counts as needing the whole hold, which pushes the
+// quantile up. Sorts where the beam never broke are not counted.
+void recordClearTime(int holdClass, unsigned long holdStart, unsigned int holdMs) {
+  if (!Machine::HAS_CLEAR_SENSOR || !beamItemSeen) return;
+  unsigned int clearMs = holdMs;
+  if (!beamBlocked) {
+    long afterHoldStart = (long)(beamClearedMs - holdStart);
+    clearMs = afterHoldStart > 0 ? afterHoldStart : 0;
+  }
+  
+  HoldEstimate &estimate = holdEstimates[holdClass];
+  if (estimate.samples == 0) {
+    estimate.averageMs = clearMs;
+    estimate.quantileMs = clearMs;
+  } else {
+    estimate.averageMs += ((long)clearMs - (long)estimate.averageMs) / HOLD_EWMA_WEIGHT;
+    // Stochastic quantile: step up by q, down by (1 - q), so it settles where
+    // a fraction q of samples fall below it
+    if (clearMs > estimate.quantileMs) {
+      estimate.quantileMs += HOLD_QUANTILE_STEP * HOLD_QUANTILE / 100;
+    } else {
+      unsigned int down = HOLD_QUANTILE_STEP * (100 - HOLD_QUANTILE) / 100;
+      estimate.quantileMs = estimate.quantileMs > down ? estimate.quantileMs - down : 0;
+    }
+  }
+  if (estimate.samples < 0xFFFF) estimate.samples++;
+}
+
+// Exponentially weighted share of LEFT among LEFT/RIGHT sorts
+void updateClassMix(int targetPosition) {
+  if (targetPosition == CENTER_POSITION) return;
+  int sample = targetPosition == LEFT_POSITION ? 256 : 0;
+  leftShare += (sample - leftShare) / PREARM_MIX_WEIGHT;
 }
 
 // ============================================================================
@@ -224,75 +1064,944 @@ void moveServoSmoothly(Servo &servo, int fromPos, int toPos) {
 // ============================================================================
 
 void processCommand(String command) {
+  traceEvent(TRACE_COMMAND, 0);
+  traceEvent(TRACE_PARSE, 0);
+  BENCH_MARK(BENCH_PARSE);
+  unsigned int itemId = 0;
+  byte gesture = GESTURE_STANDARD;
+  unsigned int sequence = 0;
+  unsigned long startAt = 0;
+  CommandCode code = parseCommandLine(command, itemId, gesture, sequence, startAt);
+  BENCH_MARK(BENCH_PARSE | BENCH_END);
+  traceEvent(TRACE_PARSE | TRACE_END, code);
+  
+  String tag = sequence != 0 ? " @" + String(sequence) : String("");
+  HostSerial.println("Received command: " + command + tag);
+  
+  // A movement that already ran under this sequence id is answered from the cache
+  const RecentResult *previous = findRecentResult(sequence);
+  if (previous != NULL && previous->code == code) {
+    replayResult(*previous);
+    traceEvent(TRACE_COMMAND | TRACE_END, code);
+    HostSerial.println("READY" + tag);
+    return;
+  }
+  
+  bool success = true;
+  switch (code) {
+    case CMD_LEFT:
+      success = waitForLineTime(startAt) && executeSortingMovement("LEFT", itemId, gesture);
+      if (success) {
+        HostSerial.println("LEFT movement completed");
+      } else {
+        HostSerial.println("ERROR: LEFT movement failed");
+      }
+      rememberResult(sequence, code, success, itemId);
+      break;
+      
+    case CMD_RIGHT:
+      success = waitForLineTime(startAt) && executeSortingMovement("RIGHT", itemId, gesture);
+      if (success) {
+        HostSerial.println("RIGHT movement completed");
+      } else {
+        HostSerial.println("ERROR: RIGHT movement failed");
+      }
+      rememberResult(sequence, code, success, itemId);
+      break;
+      
+    case CMD_CENTER:
+      success = waitForLineTime(startAt) && executeSortingMovement("CENTER", itemId, gesture);
+      if (success) {
+        HostSerial.println("CENTER movement completed");
+      } else {
+        HostSerial.println("ERROR: CENTER movement failed");
+      }
+      rememberResult(sequence, code, success, itemId);
+      break;
+      
+    case CMD_TEST:
+      runCompleteTest();
+      rememberResult(sequence, code, true, 0);
+      break;
+      
+    case CMD_STATUS:
+      printSystemStatus();
+      break;
+      
+    case CMD_TELEMETRY:
+      configureTelemetry(command.substring(9));
+      break;
+      
+    case CMD_TRACE:
+      handleTraceCommand(command.substring(5));
+      break;
+      
+    case CMD_HELLO:
+      clearRecentResults();  // New host session: its sequence ids start over
+      printHello();
+      break;
+      
+    case CMD_PREARM:
+      prearmGate();
+      rememberResult(sequence, code, true, 0);
+      break;
+      
+    case CMD_BAUD:
+      handleBaudCommand(command.substring(4));
+      break;
+      
+    case CMD_ECHO:
+      handleEchoCommand(command.substring(4));
+      break;
+      
+    case CMD_HEALTH:
+      printHealth(command.substring(6));
+      break;
+      
+    case CMD_STOP:
+      stopSorting();
+      break;
+      
+    case CMD_RESUME:
+      stopped = false;
+      HostSerial.println("OK RESUMED");
+      break;
+      
+    case CMD_SYNC:
+      handleSyncCommand(command.substring(4));
+      break;
+      
+    default:
+      HostSerial.println("ERROR: Unknown command - " + command);
+      HostSerial.println("Valid commands: LEFT, RIGHT, CENTER, PREARM, TEST, STATUS, HELLO, TELEMETRY <hz>|OFF, TRACE DUMP|CLEAR, BAUD <rate>|CONFIRM, ECHO <hex> <crc>, HEALTH [NOW], STOP, RESUME, SYNC <line ms>");
+      errorCount++;
+      break;
+  }
+  
+  traceEvent(TRACE_COMMAND | TRACE_END, code);
+  
+  // Always send ready signal after processing (tagged with the sequence id if the command had one)
+  HostSerial.println("READY" + tag);
+  
+  // A BAUD switch takes effect once its READY has gone out at the old rate
+  if (pendingBaud != 0) switchBaudRate();
+}
+
+// STOP: drop every queued sort (the host gets "ERROR: Cancelled by STOP - <line>"
+// and no READY for each), bring a leaning gate back to center and refuse
+// sorts until RESUME. A movement already running finishes first; STOP only
+// has to wait for that one, not for the queue behind it.
+void stopSorting() {
+  stopped = true;
+  int cancelled = 0;
+  String line;
+  while (dequeueFromClass(PRIORITY_SORT, line)) {
+    HostSerial.println("ERROR: Cancelled by STOP - " + line);
+    cancelled++;
+  }
+  if (gatePrearmed(GATE_SORT)) {
+    setGateFlag(GATE_SORT, GATE_PREARMED, !stepGateToward(CENTER_POSITION));
+  }
+  HostSerial.println("OK STOPPED CANCELLED " + String(cancelled));
+}
+
+// Normalizes a raw command line in place (upper case, trimmed, sequence id,
+// item id suffix, start time and gesture name removed) and returns its command code
+CommandCode parseCommandLine(String &command, unsigned int &itemId, byte &gesture, unsigned int &sequence,
+                             unsigned long &startAt) {
   command.toUpperCase();
   command.trim();
+  sequence = extractSequence(command);
+  itemId = extractItemId(command);
+  startAt = extractStartTime(command);
+  gesture = extractGesture(command);
+  return parseCommand(command);
+}
+
+// Strips an optional " @<seq>" host sequence id (always last, e.g.
+// "LEFT #42 @17") and returns it, 0 if absent
+unsigned int extractSequence(String &command) {
+  int marker = command.indexOf('@');
+  if (marker < 0) return 0;
+  
+  unsigned int sequence = command.substring(marker + 1).toInt();
+  command = command.substring(0, marker);
+  command.trim();
+  return sequence;
+}
+
+// Strips an optional " #<id>" item id suffix (e.g. "LEFT #42") and returns it, 0 if absent
+unsigned int extractItemId(String &command) {
+  int marker = command.indexOf('#');
+  if (marker < 0) return 0;
   
-  Serial.println("Received command: " + command);
+  unsigned int itemId = command.substring(marker + 1).toInt();
+  command = command.substring(0, marker);
+  command.trim();
+  return itemId;
+}
+
+// Strips an optional " AT <line ms>" start time (before the item id, e.g.
+// "LEFT FLICK AT 120500 #42") and returns it, 0 if absent
+unsigned long extractStartTime(String &command) {
+  int marker = command.indexOf(" AT ");
+  if (marker < 0) return 0;
   
-  if (command == "LEFT") {
-    if (executeSortingMovement("LEFT")) {
-      Serial.println("LEFT movement completed");
-    } else {
-      Serial.println("ERROR: LEFT movement failed");
+  unsigned long startAt = strtoul(command.c_str() + marker + 4, NULL, 10);
+  command = command.substring(0, marker);
+  command.trim();
+  return startAt;
+}
+
+// Strips a trailing gesture name (e.g. "LEFT FLICK") and returns its index,
+// GESTURE_STANDARD if there is none. Other arguments ("TELEMETRY 10") stay.
+byte extractGesture(String &command) {
+  int space = command.indexOf(' ');
+  if (space < 0) return GESTURE_STANDARD;
+  
+  int gesture = findGesture(command.substring(space + 1));
+  if (gesture < 0) return GESTURE_STANDARD;
+  command = command.substring(0, space);
+  return gesture;
+}
+
+// Index of the named gesture in GESTURES, -1 if unknown
+int findGesture(const String &name) {
+  for (int i = 0; i < GESTURE_COUNT; i++) {
+    if (strcmp_P(name.c_str(), GESTURES[i].name) == 0) return i;
+  }
+  return -1;
+}
+
+// Maps an upper-cased, trimmed command line to its command code
+CommandCode parseCommand(const String &command) {
+  if (command == "LEFT") return CMD_LEFT;
+  if (command == "RIGHT") return CMD_RIGHT;
+  if (command == "CENTER") return CMD_CENTER;
+  if (command == "TEST") return CMD_TEST;
+  if (command == "STATUS") return CMD_STATUS;
+  if (command.startsWith("TELEMETRY")) return CMD_TELEMETRY;
+  if (command.startsWith("TRACE")) return CMD_TRACE;
+  if (command == "HELLO") return CMD_HELLO;
+  if (command == "PREARM") return CMD_PREARM;
+  if (command.startsWith("BAUD")) return CMD_BAUD;
+  if (command.startsWith("ECHO")) return CMD_ECHO;
+  if (command.startsWith("HEALTH")) return CMD_HEALTH;
+  if (command == "STOP") return CMD_STOP;
+  if (command == "RESUME") return CMD_RESUME;
+  if (command.startsWith("SYNC")) return CMD_SYNC;
+  return CMD_UNKNOWN;
+}
+
+void runCompleteTest() {
+  DebugSerial.println("Starting complete system test...");
+  
+  // Test sequence: CENTER -> LEFT -> CENTER -> RIGHT -> CENTER
+  String testSequence[] = {"CENTER", "LEFT", "CENTER", "RIGHT", "CENTER"};
+  
+  for (int i = 0; i < 5; i++) {
+    DebugSerial.println("Testing position: " + testSequence[i]);
+    executeSortingMovement(testSequence[i], 0, GESTURE_STANDARD);
+    waitMs(500);
+  }
+  
+  HostSerial.println("Complete system test finished");
+}
+
+void printSystemStatus() {
+  writeSystemStatus(HostSerial);
+}
+
+void writeSystemStatus(Print &out) {
+  unsigned long uptime = millis() - startTime;
+  
+  out.println("=== ARDUINO SYSTEM STATUS ===");
+  out.println("System Ready: " + String(systemReady ? "YES" : "NO"));
+  out.println("Stopped: " + String(stopped ? "YES" : "NO"));
+  out.println("Uptime: " + String(uptime / 1000) + " seconds");
+  out.println("Total Movements: " + String(totalMoves));
+  out.println("Left Movements: " + String(leftMoves));
+  out.println("Right Movements: " + String(rightMoves));
+  for (byte gate = 0; gate < GATE_COUNT; gate++) {
+    out.println("Servo " + String(gate + 1) + " Position: " + String(gatePosition[gate]));
+  }
+  out.println("Left Share: " + String(leftShare * 100L / 256) + "%");
+  char gestureName[GESTURE_NAME_SIZE];
+  for (int i = 0; i < HOLD_CLASSES; i++) {
+    const HoldEstimate &estimate = holdEstimates[i];
+    if (estimate.samples == 0) continue;
+    memcpy_P(gestureName, GESTURES[i / 2].name, GESTURE_NAME_SIZE);
+    String hold = estimate.samples >= HOLD_MIN_SAMPLES ? String(learnedHoldMs(i, 0)) + " ms" : String("fixed");
+    out.println("Hold " + String(i % 2 ? "RIGHT " : "LEFT ") + gestureName + ": " + hold +
+                " (clear avg " + String(estimate.averageMs) +
+                " ms, p" + String(HOLD_QUANTILE) + " " + String(estimate.quantileMs) + " ms, " +
+                String(estimate.samples) + " items)");
+  }
+  out.println("Health: " + healthFaultNames(health.faults) + " (" + String(health.checks) + " checks, " +
+              String(health.degraded) + " degraded, " + String(health.silentSorts) + " sorts without an item)");
+  out.println("Line Clock: " + String(lineMillis()) + " ms, " +
+              (SYNC_SOURCE ? "LINE source" : lineClockLocked() ? "LINE" : "SERIAL") +
+              ", last step " + String(syncStepUs) + " us, " + String(syncEdges) + " edges, " +
+              String(lateStarts) + " late starts");
+  out.println("Baud Rate: " + String(protocolBaud) + (baudUnconfirmed ? " (unconfirmed)" : ""));
+  out.println("Errors: " + String(errorCount));
+  out.println("Queued Commands: " + String(commandQueueCount) + " (urgent " + String(queueCount[PRIORITY_URGENT]) +
+              ", sort " + String(queueCount[PRIORITY_SORT]) + ", diagnostic " + String(queueCount[PRIORITY_DIAGNOSTIC]) + ")");
+  if (telemetryIntervalMs > 0) {
+    out.println("Telemetry: " + String(1000 / telemetryIntervalMs) + " Hz");
+  } else {
+    out.println("Telemetry: OFF");
+  }
+  out.println("Free Memory: " + String(freeMemory()) + " bytes");
+  out.println("============================");
+}
+
+// ============================================================================
+// BACKGROUND HEALTH CHECK
+// ============================================================================
+
+// Called from loop() when there was no command to run
+void runHealthCheckIfDue() {
+  if (!systemReady || stopped || gatePrearmed(GATE_SORT) || commandQueueCount > 0) return;
+  unsigned long now = millis();
+  if (now - lastCommandTime < HEALTH_IDLE_TIME) return;
+  if (!health.due && now - health.lastCheck < HEALTH_INTERVAL) return;
+  
+  traceEvent(TRACE_HEALTH, 0);
+  for (byte gate = 0; gate < GATE_COUNT; gate++) {
+    if (!twitchGate(gate)) {
+      health.cancelled++;  // Try again at the next idle gap
+      traceEvent(TRACE_HEALTH | TRACE_END, 0);
+      return;
     }
-    
-  } else if (command == "RIGHT") {
-    if (executeSortingMovement("RIGHT")) {
-      Serial.println("RIGHT movement completed");
+  }
+  
+  byte faults = 0;
+  if (Machine::HAS_CLEAR_SENSOR) {
+    if (beamBlocked) faults |= HEALTH_BEAM_BLOCKED;  // Jammed item or sensor fault
+    if (health.silentSorts >= HEALTH_SILENT_SORTS) faults |= HEALTH_BEAM_SILENT;
+  }
+  health.faults = faults;
+  health.checks++;
+  if (faults) health.degraded++;
+  health.lastCheck = millis();
+  health.due = false;
+  traceEvent(TRACE_HEALTH | TRACE_END, faults);
+}
+
+// Moves a gate HEALTH_TWITCH_DEGREES toward center and back on the step
+// profile. Returns false, with the gate back at its pose, if a sort or STOP
+// arrives; diagnostics wait the few steps until it is done.
+bool twitchGate(byte gate) {
+  int homePos = gatePosition[gate];
+  int twitchPos = homePos + (homePos >= CENTER_POSITION ? -HEALTH_TWITCH_DEGREES : HEALTH_TWITCH_DEGREES);
+  int steps = trajectoryStepCount(homePos, twitchPos);
+  
+  for (int leg = 0; leg < 2; leg++) {
+    int fromPos = leg == 0 ? homePos : twitchPos;
+    int toPos = leg == 0 ? twitchPos : homePos;
+    for (int i = 1; i <= steps; i++) {
+      if (queueCount[PRIORITY_URGENT] + queueCount[PRIORITY_SORT] > 0) {
+        writeServo(gate, homePos);
+        return false;
+      }
+      writeServo(gate, i < steps ? trajectoryPosition(fromPos, toPos, i) : toPos);
+      waitMs(STEP_DELAY);
+    }
+  }
+  return true;
+}
+
+// HEALTH reports the last check; HEALTH NOW also asks for one at the next
+// idle gap. Single line of KEY VALUE pairs, like HELLO.
+void printHealth(String argument) {
+  argument.trim();
+  if (argument == "NOW") health.due = true;
+  // Without a clear sensor the check has nothing to observe, so it can't pass
+  String state = !Machine::HAS_CLEAR_SENSOR ? "UNCHECKED" : health.faults ? "DEGRADED" : "OK";
+  HostSerial.println("HEALTH STATE " + state +
+                     " FAULTS " + healthFaultNames(health.faults) +
+                     " CHECKS " + String(health.checks) + " DEGRADED " + String(health.degraded) +
+                     " CANCELLED " + String(health.cancelled) + " SILENT_SORTS " + String(health.silentSorts) +
+                     " AGE_S " + String(health.checks ? (millis() - health.lastCheck) / 1000 : 0));
+}
+
+String healthFaultNames(byte faults) {
+  if (!Machine::HAS_CLEAR_SENSOR) return "UNCHECKED";
+  if (faults == 0) return "NONE";
+  String names = "";
+  if (faults & HEALTH_BEAM_BLOCKED) names += ",BEAM";
+  if (faults & HEALTH_BEAM_SILENT) names += ",BEAM_SILENT";
+  return names.substring(1);
+}
+
+// ============================================================================
+// DUPLICATE DETECTION
+// ============================================================================
+
+// Latest result recorded under this sequence id, NULL if none (or no id)
+const RecentResult *findRecentResult(unsigned int sequence) {
+  if (sequence == 0) return NULL;
+  for (int i = 0; i < RECENT_RESULTS_SIZE; i++) {
+    if (recentResults[i].sequence == sequence) return &recentResults[i];
+  }
+  return NULL;
+}
+
+void rememberResult(unsigned int sequence, CommandCode code, bool success, unsigned int itemId) {
+  if (sequence == 0) return;
+  RecentResult &slot = recentResults[recentResultsNext];
+  slot.sequence = sequence;
+  slot.code = code;
+  slot.success = success;
+  slot.itemId = itemId;
+  slot.motionMs = lastSortMs;
+  recentResultsNext = (recentResultsNext + 1) % RECENT_RESULTS_SIZE;
+}
+
+// Prints what the original command printed after "Received command", minus
+// the progress lines, without moving anything
+void replayResult(const RecentResult &result) {
+  HostSerial.println("DUPLICATE @" + String(result.sequence));
+  String direction = result.code == CMD_LEFT ? "LEFT" : result.code == CMD_RIGHT ? "RIGHT" : "CENTER";
+  switch (result.code) {
+    case CMD_LEFT:
+    case CMD_RIGHT:
+    case CMD_CENTER:
+      if (!result.success) {
+        HostSerial.println("ERROR: " + direction + " movement failed");
+        break;
+      }
+      if (result.itemId != 0) {
+        HostSerial.println("DONE " + String(result.itemId) + " " + direction + " " + String(result.motionMs));
+      }
+      HostSerial.println(direction + " movement completed");
+      break;
+      
+    case CMD_TEST:
+      HostSerial.println("Complete system test finished");
+      break;
+      
+    default:
+      break;
+  }
+}
+
+void clearRecentResults() {
+  for (int i = 0; i < RECENT_RESULTS_SIZE; i++) {
+    recentResults[i].sequence = 0;
+  }
+  recentResultsNext = 0;
+}
+
+// Discovery reply: the host keeps at most QUEUE commands in flight per lane,
+// may name any of GESTURES in a sort command and switch to any of BAUDS
+void printHello() {
+  String gestures = "";
+  char name[GESTURE_NAME_SIZE];
+  for (int i = 0; i < GESTURE_COUNT; i++) {
+    strcpy_P(name, GESTURES[i].name);
+    if (i > 0) gestures += ',';
+    gestures += name;
+  }
+  String bauds = "";
+  for (int i = 0; i < BAUD_RATE_COUNT; i++) {
+    if (i > 0) bauds += ',';
+    bauds += String(BAUD_RATES[i]);
+  }
+  HostSerial.println("HELLO LANE " + String(LANE_ID) + " QUEUE " + String(COMMAND_QUEUE_SIZE) +
+                 " PROTOCOL " + String(PROTOCOL_VERSION) + " GESTURES " + gestures +
+                 " BAUD " + String(protocolBaud) + " BAUDS " + bauds +
+                 " SYNC " + (Machine::HAS_SYNC_LINE ? "LINE" : "SERIAL"));
+}
+
+// ============================================================================
+// LINE CLOCK
+// ============================================================================
+
+// Called from serviceBackground(): takes the newest sync edge, drives the
+// line on the source, and moves the anchor forward before it gets too old
+void serviceLineClock() {
+  if (Machine::HAS_SYNC_LINE) {
+    if (SYNC_SOURCE) {
+      driveSyncLine();
     } else {
-      Serial.println("ERROR: RIGHT movement failed");
+      noInterrupts();
+      byte count = syncEdgeCount;
+      unsigned long edgeMicros = syncEdgeMicros;
+      interrupts();
+      if (count != syncEdgesTaken) {
+        syncEdgesTaken = count;  // Edges missed in between don't matter, the newest is enough
+        applySyncEdge(edgeMicros);
+      }
     }
-    
-  } else if (command == "CENTER") {
-    if (executeSortingMovement("CENTER")) {
-      Serial.println("CENTER movement completed");
+  }
+  
+  unsigned long now = micros();
+  if (now - lineAnchorMicros > LINE_ANCHOR_MAX_US) {
+    long remainderUs;
+    unsigned long lineMs = lineTimeAt(now, remainderUs);
+    anchorLineClock(lineMs, now - remainderUs);
+  }
+}
+
+// Rising edge on SYNC_PIN (interrupt context)
+void onSyncEdge() {
+  syncEdgeMicros = micros();
+  syncEdgeCount++;
+}
+
+// The edge marks a SYNC_PERIOD_MS boundary of the source's line clock: snap
+// to the nearest one
+void applySyncEdge(unsigned long edgeMicros) {
+  long remainderUs;
+  unsigned long lineMs = lineTimeAt(edgeMicros, remainderUs);
+  long phaseUs = (long)(lineMs % SYNC_PERIOD_MS) * 1000 + remainderUs;
+  unsigned long boundaryMs = lineMs - lineMs % SYNC_PERIOD_MS;
+  if (phaseUs >= (long)SYNC_PERIOD_MS * 500) {
+    boundaryMs += SYNC_PERIOD_MS;
+    syncStepUs = (long)SYNC_PERIOD_MS * 1000 - phaseUs;
+  } else {
+    syncStepUs = -phaseUs;
+  }
+  anchorLineClock(boundaryMs, edgeMicros);
+  lastEdgeMicros = edgeMicros;
+  syncEdges++;
+}
+
+// Source: raise the line on each period boundary, to within a few
+// microseconds when the loop comes round in time (busy-waits the last
+// SYNC_SPIN_US), and drop it SYNC_PULSE_US later
+void driveSyncLine() {
+  if (pulseHigh) {
+    if (micros() - lastEdgeMicros >= SYNC_PULSE_US) {
+      digitalWrite(SYNC_PIN, LOW);
+      pulseHigh = false;
+    }
+    return;
+  }
+  
+  long untilUs = lineMicrosUntil(nextPulseMs);
+  if (untilUs > (long)SYNC_SPIN_US) return;
+  if (untilUs < 0) {
+    // Loop came round too late: a late edge would pull the listeners off, skip it
+    nextPulseMs = nextSyncBoundary();
+    return;
+  }
+  while (lineMicrosUntil(nextPulseMs) > 0) {
+  }
+  digitalWrite(SYNC_PIN, HIGH);
+  lastEdgeMicros = micros();
+  pulseHigh = true;
+  syncEdges++;
+  nextPulseMs += SYNC_PERIOD_MS;
+}
+
+// First period boundary after the current line time
+unsigned long nextSyncBoundary() {
+  return (lineMillis() / SYNC_PERIOD_MS + 1) * SYNC_PERIOD_MS;
+}
+
+// True while a listener is taking edges from the sync line
+bool lineClockLocked() {
+  return Machine::HAS_SYNC_LINE && !SYNC_SOURCE && syncEdges > 0 &&
+         micros() - lastEdgeMicros < SYNC_LOCK_TIMEOUT_US;
+}
+
+// From now on the line clock reads lineMs at local time localMicros
+void anchorLineClock(unsigned long lineMs, unsigned long localMicros) {
+  lineAnchorMs = lineMs;
+  lineAnchorMicros = localMicros;
+}
+
+// Line time at a local micros() within LINE_ANCHOR_MAX_US of the anchor, as
+// whole milliseconds plus the microseconds past them
+unsigned long lineTimeAt(unsigned long localMicros, long &remainderUs) {
+  long sinceUs = (long)(localMicros - lineAnchorMicros);
+  long wholeMs = sinceUs / 1000;
+  remainderUs = sinceUs % 1000;
+  if (remainderUs < 0) {
+    remainderUs += 1000;
+    wholeMs--;
+  }
+  return lineAnchorMs + wholeMs;
+}
+
+unsigned long lineMillis() {
+  long remainderUs;
+  return lineTimeAt(micros(), remainderUs);
+}
+
+// Microseconds until the line clock reads lineMs, negative once it has
+// passed (lineMs within half an hour of the anchor)
+long lineMicrosUntil(unsigned long lineMs) {
+  return (long)(lineAnchorMicros + (lineMs - lineAnchorMs) * 1000UL - micros());
+}
+
+// SYNC <line ms>: the host's line clock when it sent the line (plus the
+// transfer time), taken as the time the line arrived. A listener locked to
+// the sync line only takes the whole periods, the edges keep the phase; the
+// source takes it all and the listeners follow at the next edge. SYNC alone
+// reports the clock.
+void handleSyncCommand(String argument) {
+  argument.trim();
+  if (argument.length() > 0) {
+    unsigned long hostMs = strtoul(argument.c_str(), NULL, 10);
+    long remainderUs;
+    unsigned long lineMs = lineTimeAt(dequeuedArrivedMicros, remainderUs);
+    long offsetMs = constrain((long)(hostMs - lineMs), -2000000L, 2000000L);
+    if (lineClockLocked()) {
+      long periods = (offsetMs + (offsetMs < 0 ? -1 : 1) * (long)SYNC_PERIOD_MS / 2) / (long)SYNC_PERIOD_MS;
+      lineAnchorMs += periods * SYNC_PERIOD_MS;
+      syncStepUs = periods * (long)SYNC_PERIOD_MS * 1000;
     } else {
-      Serial.println("ERROR: CENTER movement failed");
+      anchorLineClock(hostMs, dequeuedArrivedMicros);
+      syncStepUs = offsetMs * 1000 - remainderUs;
+      if (SYNC_SOURCE) nextPulseMs = nextSyncBoundary();
     }
-    
-  } else if (command == "TEST") {
-    runCompleteTest();
-    
-  } else if (command == "STATUS") {
-    printSystemStatus();
-    
+  }
+  HostSerial.println("OK SYNC " + String(lineMillis()) + " STEP_US " + String(syncStepUs));
+}
+
+// Holds a movement until its AT start time. A time that has already passed
+// starts at once (counted in lateStarts); one more than SCHEDULE_MAX_LEAD_MS
+// ahead is refused, as is the wait itself when an urgent command (STOP)
+// comes in. No start time (0) returns straight away.
+bool waitForLineTime(unsigned long startAt) {
+  if (startAt == 0) return true;
+  long aheadMs = (long)(startAt - lineMillis());
+  if (aheadMs > (long)SCHEDULE_MAX_LEAD_MS) {
+    HostSerial.println("ERROR: Start time too far ahead - AT " + String(startAt));
+    errorCount++;
+    return false;
+  }
+  if (aheadMs < 0) {
+    lateStarts++;
+    return true;
+  }
+  
+  while (lineMicrosUntil(startAt) > 0) {
+    if (queueCount[PRIORITY_URGENT] > 0) {
+      HostSerial.println("ERROR: Start cancelled - AT " + String(startAt));
+      return false;
+    }
+    serviceBackground();
+  }
+  return true;
+}
+
+// ============================================================================
+// BAUD RATE NEGOTIATION
+// ============================================================================
+
+// BAUD <rate> switches the protocol port after this command's READY; the host
+// then checks the link with ECHO and commits with BAUD CONFIRM. Without the
+// confirmation the port goes back to the previous rate after BAUD_VERIFY_TIMEOUT.
+// CONFIRM is idempotent: once the rate is committed it answers the same way,
+// so a host that lost the reply can ask again at the new rate.
+void handleBaudCommand(String argument) {
+  argument.trim();
+  if (argument == "CONFIRM") {
+    baudUnconfirmed = false;
+    HostSerial.println("OK BAUD " + String(protocolBaud) + " CONFIRMED");
+    return;
+  }
+  
+  unsigned long rate = argument.toInt();
+  bool supported = (rate == BAUD_RATE || rate == PROTOCOL_BAUD_RATE);
+  for (int i = 0; i < BAUD_RATE_COUNT; i++) {
+    if (BAUD_RATES[i] == rate) supported = true;
+  }
+  if (!supported || baudUnconfirmed) {
+    HostSerial.println("ERROR: Baud rate not available - " + argument);
+    errorCount++;
+    return;
+  }
+  pendingBaud = rate;
+  HostSerial.println("OK BAUD " + String(rate));
+}
+
+void switchBaudRate() {
+  HostSerial.flush();  // Let READY finish at the old rate
+  fallbackBaud = protocolBaud;
+  protocolBaud = pendingBaud;
+  pendingBaud = 0;
+  HostSerial.begin(protocolBaud);
+  inputBuffer = "";
+  baudSwitchTime = millis();
+  baudUnconfirmed = true;
+}
+
+// Background check: an unconfirmed rate reverts once BAUD_VERIFY_TIMEOUT passes
+void checkBaudConfirmed() {
+  if (!baudUnconfirmed || millis() - baudSwitchTime < BAUD_VERIFY_TIMEOUT) return;
+  baudUnconfirmed = false;
+  protocolBaud = fallbackBaud;
+  HostSerial.begin(protocolBaud);
+  inputBuffer = "";
+  errorCount++;
+  DebugSerial.println("Baud rate not confirmed, back to " + String(protocolBaud));
+}
+
+// ECHO <hex bytes> <crc16 hex>: answers "OK ECHO <crc>" if the payload arrived
+// intact, so the host can check both directions at the current rate
+void handleEchoCommand(String argument) {
+  argument.trim();
+  int space = argument.indexOf(' ');
+  String hex = space > 0 ? argument.substring(0, space) : String("");
+  unsigned int expected = 0;
+  bool valid = space > 0 && hex.length() % 2 == 0 && (int)hex.length() <= 2 * ECHO_MAX_BYTES;
+  
+  byte payload[ECHO_MAX_BYTES];
+  int length = hex.length() / 2;
+  for (int i = 0; valid && i < length; i++) {
+    int high = hexValue(hex.charAt(2 * i));
+    int low = hexValue(hex.charAt(2 * i + 1));
+    valid = high >= 0 && low >= 0;
+    payload[i] = (high << 4) | low;
+  }
+  String crcText = space > 0 ? argument.substring(space + 1) : String("");
+  for (unsigned int i = 0; valid && i < crcText.length(); i++) {
+    int digit = hexValue(crcText.charAt(i));
+    valid = digit >= 0 && crcText.length() <= 4;
+    expected = (expected << 4) | digit;
+  }
+  
+  if (!valid || crcText.length() == 0 || crc16(payload, length) != expected) {
+    HostSerial.println("ERROR: ECHO CRC mismatch");
+    errorCount++;
+    return;
+  }
+  HostSerial.println("OK ECHO " + crcText);
+}
+
+int hexValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+// ============================================================================
+// TELEMETRY
+// ============================================================================
+
+// TELEMETRY <hz> starts the binary stream, TELEMETRY OFF (or 0) stops it
+void configureTelemetry(String argument) {
+  argument.trim();
+  int hz = (argument == "OFF") ? 0 : argument.toInt();
+  
+  if (hz < 0 || hz > TELEMETRY_MAX_HZ || (hz == 0 && argument != "OFF" && argument != "0")) {
+    HostSerial.println("ERROR: Telemetry rate must be 1-" + String(TELEMETRY_MAX_HZ) + " Hz or OFF");
+    errorCount++;
+    return;
+  }
+  
+  telemetryIntervalMs = (hz > 0) ? 1000 / hz : 0;
+  lastTelemetryTime = millis();
+  if (hz > 0) {
+    HostSerial.println("OK TELEMETRY " + String(hz) + " HZ");
   } else {
-    Serial.println("ERROR: Unknown command - " + command);
-    Serial.println("Valid commands: LEFT, RIGHT, CENTER, TEST, STATUS");
+    HostSerial.println("OK TELEMETRY OFF");
   }
+}
+
+void sendTelemetryIfDue() {
+  if (telemetryIntervalMs == 0) return;
+  
+  unsigned long now = millis();
+  if (now - lastTelemetryTime < telemetryIntervalMs) return;
+  lastTelemetryTime = now;
+  BENCH_MARK(BENCH_TELEMETRY);
+  
+  // Fixed layout, little endian - keep in sync with TELEMETRY_FORMAT in finalanalyze.py
+  byte payload[FRAME_MAX_PAYLOAD];
+  int n = 0;
+  payload[n++] = TELEMETRY_VERSION;
+  n = putUint32(payload, n, now);
+  n = putUint16(payload, n, telemetrySequence++);
+  for (byte gate = 0; gate < 2; gate++) {  // Servo 2 reads as idle when not fitted
+    payload[n++] = gate < GATE_COUNT ? gatePosition[gate] : GATE_HOME[gate];
+    payload[n++] = gate < GATE_COUNT ? gateTarget[gate] : GATE_HOME[gate];
+  }
+  payload[n++] = (byte)commandQueueCount;
+  payload[n++] = (systemReady ? 0x01 : 0) | ((gateFlags[GATE_SORT] & GATE_MOVING) ? 0x02 : 0);
+  
+  unsigned long loopAvg = loopTimeSamples > 0 ? loopTimeSum / loopTimeSamples : 0;
+  n = putUint16(payload, n, saturate16(loopTimeSamples > 0 ? loopTimeMin : 0));
+  n = putUint16(payload, n, saturate16(loopAvg));
+  n = putUint16(payload, n, saturate16(loopTimeMax));
   
-  // Always send ready signal after processing
-  Serial.println("READY");
+  n = putUint32(payload, n, totalMoves);
+  n = putUint32(payload, n, leftMoves);
+  n = putUint32(payload, n, rightMoves);
+  n = putUint32(payload, n, errorCount);
+  
+  sendFrame(FRAME_TYPE_TELEMETRY, payload, n);
+  
+  // Loop timing is reported per frame interval
+  loopTimeMin = 0xFFFFFFFF;
+  loopTimeMax = 0;
+  loopTimeSum = 0;
+  loopTimeSamples = 0;
+  BENCH_MARK(BENCH_TELEMETRY | BENCH_END);
 }
 
-void runCompleteTest() {
-  Serial.println("Starting complete system test...");
+// ============================================================================
+// EVENT TRACE
+// ============================================================================
+
+// Appends an event to the ring, overwriting the oldest one when full.
+// Deltas are 16-bit microseconds; longer gaps get a TRACE_TIME_EXTEND first.
+void traceEvent(byte id, uint16_t arg) {
+  unsigned long now = micros();
+  unsigned long delta = (traceCount > 0 || traceOverwritten > 0) ? now - lastTraceMicros : 0;
+  lastTraceMicros = now;
   
-  // Test sequence: CENTER -> LEFT -> CENTER -> RIGHT -> CENTER
-  String testSequence[] = {"CENTER", "LEFT", "CENTER", "RIGHT", "CENTER"};
+  if (delta > 0xFFFF) {
+    traceAppend(TRACE_TIME_EXTEND, 0, delta >> 16);
+    delta &= 0xFFFF;
+  }
+  traceAppend(id, delta, arg);
+}
+
+void traceAppend(byte id, uint16_t delta, uint16_t arg) {
+  int index;
+  if (traceCount < TRACE_BUFFER_SIZE) {
+    index = (traceHead + traceCount) % TRACE_BUFFER_SIZE;
+    traceCount++;
+  } else {
+    index = traceHead;
+    traceHead = (traceHead + 1) % TRACE_BUFFER_SIZE;
+    traceOverwritten++;
+  }
+  traceBuffer[index].id = id;
+  traceBuffer[index].deltaMicros = delta;
+  traceBuffer[index].arg = arg;
+}
+
+// TRACE DUMP sends the ring as binary frames and empties it, TRACE CLEAR just empties it
+void handleTraceCommand(String argument) {
+  argument.trim();
   
-  for (int i = 0; i < 5; i++) {
-    Serial.println("Testing position: " + testSequence[i]);
-    executeSortingMovement(testSequence[i]);
-    delay(500);
+  if (argument == "DUMP") {
+    int dumped = traceCount;
+    dumpTrace();
+    HostSerial.println("OK TRACE DUMP " + String(dumped) + " EVENTS");
+  } else if (argument == "CLEAR") {
+    clearTrace();
+    HostSerial.println("OK TRACE CLEAR");
+  } else {
+    HostSerial.println("ERROR: Use TRACE DUMP or TRACE CLEAR");
+    errorCount++;
+  }
+}
+
+void dumpTrace() {
+  // Header lets the host anchor the deltas: the newest event happened at lastTraceMicros
+  byte payload[FRAME_MAX_PAYLOAD];
+  int n = 0;
+  n = putUint32(payload, n, micros());
+  n = putUint32(payload, n, lastTraceMicros);
+  n = putUint16(payload, n, traceCount);
+  n = putUint16(payload, n, traceOverwritten);
+  sendFrame(FRAME_TYPE_TRACE_HEADER, payload, n);
+  
+  // Events oldest first, TRACE_EVENTS_PER_FRAME per frame
+  n = 0;
+  for (int i = 0; i < traceCount; i++) {
+    const TraceEvent &event = traceBuffer[(traceHead + i) % TRACE_BUFFER_SIZE];
+    payload[n++] = event.id;
+    n = putUint16(payload, n, event.deltaMicros);
+    n = putUint16(payload, n, event.arg);
+    if (n >= TRACE_EVENTS_PER_FRAME * 5 || i == traceCount - 1) {
+      sendFrame(FRAME_TYPE_TRACE_EVENTS, payload, n);
+      n = 0;
+    }
   }
   
-  Serial.println("Complete system test finished");
+  clearTrace();
 }
 
-void printSystemStatus() {
-  unsigned long uptime = millis() - startTime;
+void clearTrace() {
+  traceHead = 0;
+  traceCount = 0;
+  traceOverwritten = 0;
+}
+
+// ============================================================================
+// BINARY FRAMING
+// ============================================================================
+
+void sendFrame(byte type, const byte *payload, int length) {
+  byte frame[FRAME_MAX_ENCODED];
+  int n = encodeFrame(type, payload, length, frame);
+  if (n > 0) HostSerial.write(frame, n);
+}
+
+// Builds FRAME_START, COBS(type + payload + CRC16), 0x00 into out
+// (FRAME_MAX_ENCODED bytes). Returns the frame length, 0 if payload is too long.
+int encodeFrame(byte type, const byte *payload, int length, byte *out) {
+  byte raw[FRAME_MAX_PAYLOAD + 3];
+  if (length > FRAME_MAX_PAYLOAD) return 0;
+  
+  raw[0] = type;
+  memcpy(raw + 1, payload, length);
+  unsigned int crc = crc16(raw, length + 1);
+  raw[length + 1] = crc & 0xFF;
+  raw[length + 2] = crc >> 8;
   
-  Serial.println("=== ARDUINO SYSTEM STATUS ===");
-  Serial.println("System Ready: " + String(systemReady ? "YES" : "NO"));
-  Serial.println("Uptime: " + String(uptime / 1000) + " seconds");
-  Serial.println("Total Movements: " + String(totalMoves));
-  Serial.println("Left Movements: " + String(leftMoves));
-  Serial.println("Right Movements: " + String(rightMoves));
-  Serial.println("Servo 1 Position: " + String(currentPosition1));
-  Serial.println("Servo 2 Position: " + String(currentPosition2));
-  Serial.println("Free Memory: " + String(freeMemory()) + " bytes");
-  Serial.println("============================");
+  out[0] = FRAME_START;
+  int n = 1 + cobsEncode(raw, length + 3, out + 1);
+  out[n++] = 0x00;
+  return n;
+}
+
+// COBS encoding for blocks shorter than 254 bytes (one code byte per zero).
+// out needs length + 1 bytes; returns the encoded length.
+int cobsEncode(const byte *data, int length, byte *out) {
+  int n = 0;
+  int blockStart = 0;
+  while (true) {
+    int blockEnd = blockStart;
+    while (blockEnd < length && data[blockEnd] != 0) {
+      blockEnd++;
+    }
+    out[n++] = (byte)(blockEnd - blockStart + 1);
+    memcpy(out + n, data + blockStart, blockEnd - blockStart);
+    n += blockEnd - blockStart;
+    if (blockEnd >= length) break;
+    blockStart = blockEnd + 1;
+  }
+  return n;
+}
+
+// CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF)
+unsigned int crc16(const byte *data, int length) {
+  unsigned int crc = 0xFFFF;
+  for (int i = 0; i < length; i++) {
+    crc ^= (unsigned int)data[i] << 8;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+    }
+  }
+  return crc & 0xFFFF;
+}
+
+int putUint16(byte *buffer, int offset, unsigned int value) {
+  buffer[offset] = value & 0xFF;
+  buffer[offset + 1] = (value >> 8) & 0xFF;
+  return offset + 2;
+}
+
+int putUint32(byte *buffer, int offset, unsigned long value) {
+  for (int i = 0; i < 4; i++) {
+    buffer[offset + i] = (value >> (8 * i)) & 0xFF;
+  }
+  return offset + 4;
+}
+
+unsigned int saturate16(unsigned long value) {
+  return value > 0xFFFF ? 0xFFFF : (unsigned int)value;
 }
 
 // ============================================================================
@@ -321,5 +2030,8 @@ void performErrorSequence() {
 
 int freeMemory() {
   char top;
-  return &top - reinterpret_cast<char*>(malloc(4));
+  char *probe = reinterpret_cast<char*>(malloc(4));
+  int gap = &top - probe;
+  free(probe);  // Release the probe so every STATUS does not leak heap
+  return gap;
 }
@@ -16,8 +16,13 @@ import time
 import serial
 import logging
 import base64
+import queue
+import struct
+import threading
+from collections import deque, OrderedDict
+from contextlib import contextmanager
 from pathlib import Path
-from typing import List, Dict, Optional
+from typing import Collection, List, Dict, Optional, Tuple
 from datetime import datetime
 from threading import Thread, Lock
 from flask import Flask, request, jsonify
@@ -49,7 +54,78 @@ genai.configure(api_key=API_KEY)
 
 # Arduino Configuration
 ARDUINO_PORT = 'COM3'  # Windows. For Mac/Linux: '/dev/ttyUSB0' or '/dev/ttyACM0'
-ARDUINO_BAUD = 115200
+# One sorting lane per controller: comma-separated ports, or "auto" to try every serial port
+ARDUINO_PORTS = [p.strip() for p in os.getenv("ARDUINO_PORTS", ARDUINO_PORT).split(',') if p.strip()]
+ARDUINO_BAUD = int(os.getenv("ARDUINO_BAUD", "115200"))  # PROTOCOL_BAUD_RATE when the protocol runs on a UART
+# Fastest rate to negotiate with BAUD after HELLO (0 = stay at ARDUINO_BAUD)
+ARDUINO_MAX_BAUD = int(os.getenv("ARDUINO_MAX_BAUD", "2000000"))
+BAUD_VERIFY_TIMEOUT = 2.0  # Firmware reverts an unconfirmed rate after this (BAUD_VERIFY_TIMEOUT in arduino.cxx)
+BAUD_ECHO_LINES = 3        # CRC-checked ECHO lines that must come back intact at a new rate
+BAUD_ECHO_TIMEOUT = 0.2
+ARDUINO_TELEMETRY_HZ = 5  # Binary telemetry stream rate (0 = off)
+ARDUINO_CAPTURE_FILE = os.getenv("ARDUINO_CAPTURE_FILE")  # Record serial traffic for sim/replay_sim
+COMMAND_TIMEOUT = 8      # Seconds for a command's READY (per command queued ahead of it, too)
+TEST_TIMEOUT = 30        # TEST runs five full movements
+HEALTH_POLL_INTERVAL = 60  # Seconds between HEALTH reads from idle lanes (the firmware checks itself when idle)
+HEALTH_STARTUP_TIMEOUT = 10  # Seconds to wait for the startup check (it runs after 3 s without a sort)
+SYNC_INTERVAL = 10       # Seconds between SYNCs of the lanes' line clocks (PROTOCOL 4 firmware)
+START_TIMEOUT = 1.0      # Seconds for the next queued command to start once the one ahead of it is READY
+COMMAND_RETRIES = 2      # Resends of a command that timed out (PROTOCOL 2 firmware runs each sequence id once)
+SEQUENCE_MAX = 65535     # Sequence ids are an unsigned int on the Mega; 0 means "no id"
+COMMAND_MAX_LENGTH = 64  # Longest line the firmware takes, tag included (MAX_COMMAND_LENGTH in arduino.cxx)
+# Payload per ECHO line: "ECHO <hex> <crc>" must fit with the longest sequence tag (ECHO_MAX_BYTES)
+BAUD_ECHO_BYTES = (COMMAND_MAX_LENGTH - len("ECHO  FFFF") - len(f" @{SEQUENCE_MAX}")) // 2
+LANE_WAIT_TIMEOUT = 30   # Seconds an item waits for a free lane before failing
+ARDUINO_PREARM = os.getenv("ARDUINO_PREARM", "1") != "0"  # Lean idle gates toward the likely side during ML
+PREARM_TIMEOUT = 10      # Firmware recenters a leaning gate after this (PREARM_TIMEOUT in arduino.cxx)
+QUEUE_FULL_PREFIX = "ERROR: Command queue full - "  # Firmware drops the command, no READY follows
+CANCELLED_PREFIX = "ERROR: Cancelled by STOP - "    # A STOP cleared the queued command, no READY follows
+TOO_LONG_PREFIX = "ERROR: Command too long - "      # Line over COMMAND_MAX_LENGTH, echoed cut short
+# Firmware queue classes (PROTOCOL 3, CommandPriority in arduino.cxx): urgent
+# commands run before queued sorts, sorts before everything else
+URGENT_COMMANDS = ('STOP', 'RESUME')
+SORT_COMMANDS = ('LEFT', 'RIGHT', 'CENTER', 'PREARM')
+
+# Sort gestures (GESTURES in arduino.cxx, listed by HELLO), picked from the ML item_name.
+# Hazardous items (Do Not Shred, Discard) are never flicked.
+GESTURE_LIGHT = 'FLICK'
+GESTURE_HEAVY = 'PUSH'
+LIGHT_ITEM_KEYWORDS = ['cable', 'cord', 'wire', 'charger', 'adapter', 'earbud', 'headphone', 'remote',
+                       'mouse', 'usb', 'memory card', 'sd card', 'circuit board', 'pcb', 'calculator']
+HEAVY_ITEM_KEYWORDS = ['power supply', 'psu', 'ups', 'hard drive', 'hdd', 'transformer', 'monitor',
+                       'printer', 'microwave', 'desktop', 'tower', 'amplifier', 'speaker']
+
+# Binary frame protocol (must match arduino.cxx)
+FRAME_START = 0xA5
+FRAME_TYPE_TELEMETRY = 0x01
+FRAME_TYPE_TRACE_HEADER = 0x02
+FRAME_TYPE_TRACE_EVENTS = 0x03
+TELEMETRY_FORMAT = '<BIHBBBBBBHHHIIII'
+TELEMETRY_FIELDS = [
+    'version', 'timestamp_ms', 'sequence',
+    'servo1_setpoint', 'servo1_target', 'servo2_setpoint', 'servo2_target',
+    'queue_depth', 'flags',
+    'loop_time_min_us', 'loop_time_avg_us', 'loop_time_max_us',
+    'total_moves', 'left_moves', 'right_moves', 'errors'
+]
+TRACE_HEADER_FORMAT = '<IIHH'
+TRACE_EVENT_FORMAT = '<BHH'
+TRACE_END = 0x80
+TRACE_TIME_EXTEND = 0x01
+TRACE_EVENT_NAMES = {
+    0x02: 'command_queued',
+    0x03: 'queue_full',
+    0x04: 'item',
+    0x10: 'command',
+    0x11: 'parse',
+    0x12: 'sort',
+    0x13: 'servo2_activate',
+    0x14: 'move',
+    0x15: 'hold',
+    0x16: 'return',
+    0x17: 'prearm',
+    0x18: 'health',
+}
 
 # Flask Configuration
 FLASK_HOST = '0.0.0.0'
@@ -58,6 +134,11 @@ FLASK_PORT = 5000
 # File Storage
 UPLOAD_FOLDER = 'received_images'
 os.makedirs(UPLOAD_FOLDER, exist_ok=True)
+ITEM_TRACE_LOG = 'item_traces.jsonl'  # Per-item stage timings, one JSON object per line
+
+# Pipeline: uploads are queued and answered with 202; ML runs on a fixed worker pool
+ML_WORKERS = 4           # Concurrent generate_content calls
+INGEST_QUEUE_SIZE = 32   # Uploads waiting for ML; more are rejected with 503
 
 # Logging Setup
 logging.basicConfig(
@@ -73,9 +154,18 @@ logger = logging.getLogger(__name__)
 # Flask App
 app = Flask(__name__)
 
+# Serial capture file format (read by sim/replay_sim.cpp)
+# Header CAPTURE_MAGIC, then records of: direction (u8), microseconds since
+# the previous record (u32), length (u16), raw bytes
+CAPTURE_MAGIC = b'CCCAP1\n'
+CAPTURE_TX = 0x01  # Host -> Arduino
+CAPTURE_RX = 0x02  # Arduino -> host
+
 # Global variables
-arduino_connection = None
-arduino_lock = Lock()
+lanes = None  # LaneRegistry
+pipeline = None  # SortingPipeline
+host_tracer = None
+item_traces = None
 ml_analyzer = None
 
 # Statistics
@@ -95,83 +185,751 @@ stats = {
 # ARDUINO CONTROLLER
 # ============================================================================
 
+LINE_EPOCH = time.monotonic()
+
+def line_ms() -> int:
+    """Line clock: milliseconds on the time base every lane is SYNCed to, for " AT <line ms>" start times"""
+    return int((time.monotonic() - LINE_EPOCH) * 1000)
+
+def command_priority(command: str) -> int:
+    """Firmware queue class of a command: 0 urgent, 1 sort, 2 diagnostic (commandPriority() in arduino.cxx)"""
+    words = command.upper().split()
+    name = words[0] if words else ''
+    if name in URGENT_COMMANDS:
+        return 0
+    if name in SORT_COMMANDS:
+        return 1
+    return 2
+
+def crc16_ccitt(data: bytes) -> int:
+    """CRC-16/CCITT-FALSE, same as crc16() in the firmware"""
+    crc = 0xFFFF
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+def cobs_decode(data: bytes) -> Optional[bytes]:
+    """Decode a COBS block (without the trailing zero). Returns None if malformed."""
+    output = bytearray()
+    index = 0
+    while index < len(data):
+        code = data[index]
+        if code == 0 or index + code > len(data):
+            return None
+        output.extend(data[index + 1:index + code])
+        index += code
+        if index < len(data) and code < 0xFF:
+            output.append(0)
+    return bytes(output)
+
+def decode_frame(encoded: bytes) -> Optional[tuple]:
+    """Turn a COBS-encoded frame into (type, payload), or None if the CRC fails"""
+    raw = cobs_decode(encoded)
+    if raw is None or len(raw) < 3:
+        return None
+    body, crc = raw[:-2], raw[-2] | (raw[-1] << 8)
+    if crc16_ccitt(body) != crc:
+        return None
+    return body[0], body[1:]
+
+def decode_telemetry(payload: bytes) -> Optional[Dict]:
+    """Unpack a telemetry frame payload into a dict"""
+    if len(payload) != struct.calcsize(TELEMETRY_FORMAT):
+        return None
+    telemetry = dict(zip(TELEMETRY_FIELDS, struct.unpack(TELEMETRY_FORMAT, payload)))
+    telemetry['system_ready'] = bool(telemetry['flags'] & 0x01)
+    telemetry['movement_active'] = bool(telemetry['flags'] & 0x02)
+    return telemetry
+
+def decode_trace(header: bytes, events: List[bytes], received_at: float) -> Dict:
+    """
+    Rebuild absolute times for a TRACE DUMP.
+    
+    The firmware stores 16-bit microsecond deltas; the header gives the
+    firmware clock at dump time and the time of the newest event, so we walk
+    backwards from the newest event and map onto the host clock at receipt.
+    """
+    dump_micros, last_event_micros, count, overwritten = struct.unpack(TRACE_HEADER_FORMAT, header)
+    raw = [struct.unpack(TRACE_EVENT_FORMAT, chunk[i:i + 5])
+           for chunk in events for i in range(0, len(chunk) - 4, 5)]
+    
+    decoded = []
+    event_micros = last_event_micros
+    for event_id, delta, arg in reversed(raw):
+        if event_id == TRACE_TIME_EXTEND:
+            event_micros = (event_micros - (arg << 16)) & 0xFFFFFFFF
+            continue
+        
+        age_seconds = ((dump_micros - event_micros) & 0xFFFFFFFF) / 1e6
+        base_id = event_id & ~TRACE_END
+        is_phase = base_id >= 0x10
+        decoded.append({
+            'name': TRACE_EVENT_NAMES.get(base_id, f'event_{base_id:#04x}'),
+            'phase': ('E' if event_id & TRACE_END else 'B') if is_phase else 'i',
+            'time': received_at - age_seconds,
+            'arg': arg
+        })
+        event_micros = (event_micros - delta) & 0xFFFFFFFF
+    
+    decoded.reverse()
+    return {'events': decoded, 'expected': count, 'overwritten': overwritten}
+
+class HostTracer:
+    """Records host-side spans so they can share a timeline with firmware traces"""
+    
+    def __init__(self, max_spans: int = 2000):
+        self.spans = deque(maxlen=max_spans)
+        self.lock = Lock()
+    
+    @contextmanager
+    def span(self, name: str, **args):
+        start = time.time()
+        try:
+            yield
+        finally:
+            with self.lock:
+                self.spans.append({
+                    'name': name,
+                    'start': start,
+                    'end': time.time(),
+                    'thread': threading.current_thread().name,
+                    'args': args
+                })
+    
+    def drain(self) -> List[Dict]:
+        with self.lock:
+            spans = list(self.spans)
+            self.spans.clear()
+        return spans
+
+@contextmanager
+def trace_span(name: str, **args):
+    """Record a host span if tracing is set up, otherwise do nothing"""
+    if host_tracer is None:
+        yield
+    else:
+        with host_tracer.span(name, **args):
+            yield
+
+class ItemTrace:
+    """Trace id and per-stage durations for one item's upload → ML → sort cycle"""
+    
+    def __init__(self, item_id: int):
+        self.item_id = item_id
+        self.started = time.time()
+        self.stages = {}
+    
+    @contextmanager
+    def stage(self, name: str):
+        start = time.time()
+        try:
+            with trace_span(name, item_id=self.item_id):
+                yield
+        finally:
+            self.record(name, time.time() - start)
+    
+    def record(self, name: str, seconds: float):
+        self.stages[name] = round(self.stages.get(name, 0.0) + seconds, 4)
+
+class ItemTraceLog:
+    """Hands out item ids and keeps finished item traces in memory and on disk"""
+    
+    def __init__(self, path: str, max_items: int = 500):
+        self.path = path
+        self.items = deque(maxlen=max_items)
+        self.lock = Lock()
+        self.next_id = 1
+    
+    def new_item(self) -> ItemTrace:
+        with self.lock:
+            item_id = self.next_id
+            # Ids travel to the firmware as 16-bit values; 0 means "no id"
+            self.next_id = self.next_id % 65535 + 1
+        return ItemTrace(item_id)
+    
+    def finish(self, trace: ItemTrace, **fields) -> Dict:
+        record = {
+            'item_id': trace.item_id,
+            'started': datetime.fromtimestamp(trace.started).isoformat(),
+            'total_seconds': round(time.time() - trace.started, 4),
+            'stages': dict(trace.stages),
+            **fields
+        }
+        with self.lock:
+            self.items.append(record)
+            try:
+                with open(self.path, 'a') as f:
+                    f.write(json.dumps(record) + '\n')
+            except OSError as e:
+                logger.warning(f"Could not write item trace: {e}")
+        return record
+    
+    def summary(self) -> Dict:
+        """Per-stage count, mean, p50, p95 and max over the items in memory"""
+        with self.lock:
+            items = list(self.items)
+        
+        durations = {}
+        for item in items:
+            for name, seconds in item['stages'].items():
+                durations.setdefault(name, []).append(seconds)
+            durations.setdefault('total', []).append(item['total_seconds'])
+        
+        summary = {}
+        for name, values in durations.items():
+            values.sort()
+            summary[name] = {
+                'count': len(values),
+                'mean': round(sum(values) / len(values), 4),
+                'p50': values[len(values) // 2],
+                'p95': values[min(len(values) - 1, int(len(values) * 0.95))],
+                'max': values[-1]
+            }
+        return summary
+    
+    def recent(self, limit: int) -> List[Dict]:
+        with self.lock:
+            return list(self.items)[-limit:]
+
+class SerialCapture:
+    """Records every byte to and from the Arduino with timestamps for offline replay"""
+    
+    def __init__(self, path: str):
+        self.file = open(path, 'wb')
+        self.file.write(CAPTURE_MAGIC)
+        self.lock = Lock()
+        self.last_time = time.monotonic()
+    
+    def record(self, direction: int, data: bytes):
+        with self.lock:
+            now = time.monotonic()
+            delta_us = min(int((now - self.last_time) * 1e6), 0xFFFFFFFF)
+            self.last_time = now
+            for offset in range(0, len(data), 0xFFFF):
+                chunk = data[offset:offset + 0xFFFF]
+                self.file.write(struct.pack('<BIH', direction, delta_us, len(chunk)) + chunk)
+                delta_us = 0
+            self.file.flush()
+
+class PendingCommand:
+    """A command written to the port whose READY has not come back yet"""
+    
+    def __init__(self, command: str, on_done=None, sequence: Optional[int] = None):
+        self.command = command
+        self.sequence = sequence  # Echoed as "READY @<seq>"; a resend with it is never run twice
+        self.wire = f"{command} @{sequence}" if sequence else command
+        self.priority = command_priority(command)
+        self.lines = []
+        self.sent_at = time.time()
+        self.started_at = None  # "Received command" seen: the firmware dequeued it
+        self.timeout = COMMAND_TIMEOUT  # Run time allowed once started
+        self.lead = 0.0  # Seconds an AT start time holds it in the firmware before it moves
+        self.timeout_at = None
+        self.attempts = 1
+        self.failed = False
+        self.done = threading.Event()
+        self.on_done = on_done  # Called from the reader thread when READY arrives or it fails
+    
+    def finish(self, failed: bool = False):
+        self.failed = failed
+        self.done.set()
+        if self.on_done:
+            self.on_done(self)
+
 class ArduinoController:
-    def __init__(self, port: str, baud_rate: int):
+    def __init__(self, port: str, baud_rate: int, telemetry_hz: int = 0,
+                 capture_path: Optional[str] = None):
         self.port = port
         self.baud_rate = baud_rate
+        self.telemetry_hz = telemetry_hz
         self.connection = None
         self.connected = False
+        self.capture = SerialCapture(capture_path) if capture_path else None
+        if self.capture:
+            logger.info(f"Capturing Arduino serial traffic on {port} to {capture_path}")
+        
+        # Filled in from the HELLO reply; firmware without HELLO gets one credit
+        self.lane_id = None
+        self.credits = 1
+        self.gestures = set()  # Gesture names from HELLO; empty = STANDARD only
+        self.protocol = 1
+        self.next_sequence = 1
+        self.baud_rates = []  # Rates offered by HELLO for BAUD; empty = fixed rate
+        self.health = None    # Last HEALTH report, None until read (or firmware without HEALTH)
+        self.sync_line = False  # HELLO "SYNC LINE": wired to a hardware sync line, SYNC only picks the period
+        self.line_clock = None  # Last SYNC reply, None until synced (or firmware before PROTOCOL 4)
+        
+        # Commands sent but not yet answered with READY, oldest first. The
+        # firmware runs them in order (by queue class, then oldest, from
+        # PROTOCOL 3), so output belongs to the command whose "Received command"
+        # line came last (the head, unless a resend or a class jumped it).
+        self.lock = Lock()
+        self.in_flight = deque()
+        self.current = None
+        
+        # Reader thread splits the incoming byte stream into text lines and binary frames
+        self.reader_thread = None
+        self.reader_running = False
+        self.telemetry = None
+        self.telemetry_received_at = None
+        self.frame_errors = 0
+        self.trace_header = None
+        self.trace_chunks = []
+        self.trace_received_at = None
+    
+    @property
+    def name(self) -> str:
+        return f"lane {self.lane_id}" if self.lane_id is not None else self.port
     
-    def connect(self) -> bool:
-        """Connect to Arduino with retry logic"""
-        max_retries = 5
+    def connect(self, max_retries: int = 5) -> bool:
+        """Connect to Arduino with retry logic and identify it with HELLO"""
         for attempt in range(max_retries):
             try:
-                self.connection = serial.Serial(self.port, self.baud_rate, timeout=3)
+                self.connection = serial.Serial(self.port, self.baud_rate, timeout=0.1)
                 time.sleep(3)  # Wait for Arduino to initialize
+                self._start_reader()
+                self.connected = True
                 
-                # Test connection
-                response = self.send_command("STATUS", wait_for_ready=True)
-                if response and "OK" in response:
-                    self.connected = True
-                    logger.info(f"Arduino connected successfully on {self.port}")
+                # Test connection (older firmware answers HELLO with an error, then READY)
+                response = self.send_command("HELLO", wait_for_ready=True)
+                if response and "READY" in response:
+                    self._parse_hello(response)
+                    if self.baud_rates and ARDUINO_MAX_BAUD > self.baud_rate:
+                        self.negotiate_baud(ARDUINO_MAX_BAUD)
+                    logger.info(f"Arduino connected successfully on {self.port} "
+                                f"({self.name}, {self.credits} queue credits, {self.baud_rate} baud)")
+                    if self.telemetry_hz > 0:
+                        self.set_telemetry_rate(self.telemetry_hz)
                     return True
+                
+                self.disconnect()
                     
             except serial.SerialException as e:
-                logger.warning(f"Arduino connection attempt {attempt + 1} failed: {e}")
+                logger.warning(f"Arduino connection attempt {attempt + 1} on {self.port} failed: {e}")
+                self.disconnect()
                 if attempt < max_retries - 1:
                     time.sleep(2)
         
-        logger.error("Failed to connect to Arduino after all retries")
+        logger.error(f"Failed to connect to Arduino on {self.port} after all retries")
         return False
     
-    def send_command(self, command: str, wait_for_ready: bool = True) -> Optional[str]:
-        """Send command to Arduino and get response"""
+    def _parse_hello(self, response: str):
+        """Read "HELLO LANE <id> QUEUE <n> PROTOCOL <v> [GESTURES <a,b>] [BAUD <rate> BAUDS <a,b>]
+        [SYNC LINE|SERIAL]" into lane_id, credits, protocol, gestures, baud_rates and sync_line"""
+        for line in response.split('\n'):
+            parts = line.split()
+            if not parts or parts[0] != 'HELLO':
+                continue
+            fields = dict(zip(parts[1::2], parts[2::2]))
+            try:
+                self.lane_id = int(fields['LANE'])
+                self.credits = max(1, int(fields['QUEUE']))
+                self.protocol = int(fields.get('PROTOCOL', 1))
+                self.gestures = set(fields.get('GESTURES', '').split(',')) - {''}
+                self.baud_rates = [int(rate) for rate in fields.get('BAUDS', '').split(',') if rate]
+                self.sync_line = fields.get('SYNC') == 'LINE'
+            except (KeyError, ValueError):
+                logger.warning(f"Unexpected HELLO reply on {self.port}: {line}")
+    
+    def negotiate_baud(self, max_baud: int) -> int:
+        """Move the link to the fastest offered rate up to max_baud that passes an echo check"""
+        for rate in sorted((r for r in self.baud_rates if self.baud_rate < r <= max_baud), reverse=True):
+            if self._try_baud(rate):
+                logger.info(f"{self.name} on {self.port} switched to {rate} baud")
+                break
+            logger.warning(f"{self.name} on {self.port}: {rate} baud failed the echo check")
+        return self.baud_rate
+    
+    def _try_baud(self, rate: int) -> bool:
+        """Switch both ends to rate; on a failed check go back and let the firmware revert"""
+        response = self.send_command(f"BAUD {rate}")
+        if response is None:
+            # The lost reply may have been the OK: the firmware could be at rate
+            # now, and refuses the next BAUD until it has gone back
+            self._rejoin_after_revert(time.time())
+            return False
+        if f"OK BAUD {rate}" not in response:
+            return False
+        switched_at = time.time()
+        self.connection.baudrate = rate
+        
+        if self._echo_check() and (self._confirm_baud(rate) or self._probe_baud(rate)):
+            self.baud_rate = rate
+            return True
+        
+        self.connection.baudrate = self.baud_rate
+        self._rejoin_after_revert(switched_at)
+        return False
+    
+    def _confirm_baud(self, rate: int) -> bool:
+        """BAUD CONFIRM; the firmware answers it again once committed, so it can be resent"""
+        response = self.send_command("BAUD CONFIRM", timeout=BAUD_ECHO_TIMEOUT)
+        return response is not None and f"OK BAUD {rate} CONFIRMED" in response
+    
+    def _probe_baud(self, rate: int) -> bool:
+        """After a lost CONFIRM reply: if HELLO still answers at rate the firmware is
+        there, and may have committed, so confirm again rather than strand it"""
+        response = self.send_command("HELLO", timeout=BAUD_ECHO_TIMEOUT)
+        if response is None or f" BAUD {rate} " not in response + ' ':
+            return False
+        return self._confirm_baud(rate)
+    
+    def _rejoin_after_revert(self, switched_at: float):
+        """Wait until the firmware is back at our rate without a confirmation, then resync"""
+        time.sleep(max(0.0, switched_at + BAUD_VERIFY_TIMEOUT + 0.2 - time.time()))
+        self.connection.reset_input_buffer()
+        self.send_command("HELLO")  # Back in step at the old rate
+    
+    def _echo_check(self) -> bool:
+        """Random payloads with their CRC16 must come back as "OK ECHO <crc>" """
+        with self.lock:
+            self.connection.write(b'\n')  # Ends whatever arrived garbled during the switch
+            if self.capture:
+                self.capture.record(CAPTURE_TX, b'\n')
+        for _ in range(BAUD_ECHO_LINES):
+            payload = os.urandom(BAUD_ECHO_BYTES)
+            crc = f"{crc16_ccitt(payload):04X}"
+            response = self.send_command(f"ECHO {payload.hex().upper()} {crc}", timeout=BAUD_ECHO_TIMEOUT)
+            if response is None or f"OK ECHO {crc}" not in response:
+                return False
+        return True
+    
+    def _start_reader(self):
+        """Start the background thread that owns all reads from the port"""
+        self.reader_running = True
+        self.reader_thread = Thread(target=self._reader_loop, daemon=True,
+                                    name=f"reader-{os.path.basename(self.port)}")
+        self.reader_thread.start()
+    
+    def _reader_loop(self):
+        line = bytearray()
+        frame = None  # bytearray while inside a binary frame
+        
+        while self.reader_running:
+            try:
+                data = self.connection.read(self.connection.in_waiting or 1)
+            except Exception as e:
+                if self.reader_running:
+                    logger.error(f"Error reading from Arduino on {self.port}: {e}")
+                    self.connected = False
+                    self._fail_in_flight()
+                break
+            
+            if self.capture and data:
+                self.capture.record(CAPTURE_RX, data)
+            
+            for byte in data:
+                if frame is not None:
+                    if byte == 0:
+                        self._handle_frame(bytes(frame))
+                        frame = None
+                    else:
+                        frame.append(byte)
+                        if len(frame) > 255:
+                            self.frame_errors += 1
+                            frame = None
+                elif byte == FRAME_START:
+                    frame = bytearray()
+                elif byte == ord('\n'):
+                    text = line.decode('utf-8', errors='replace').strip()
+                    line.clear()
+                    if text:
+                        self._handle_line(text)
+                elif byte != ord('\r'):
+                    line.append(byte)
+    
+    def _handle_line(self, text: str):
+        """Attach a text line to the command it answers"""
+        logger.info(f"Arduino ({self.name}): {text}")
+        with self.lock:
+            if text.startswith(TOO_LONG_PREFIX):
+                # Echoed as far as the firmware kept it; nothing ran and no READY follows
+                kept = text[len(TOO_LONG_PREFIX):]
+                for pending in reversed(self.in_flight):
+                    if pending.wire.startswith(kept) and pending.started_at is None:
+                        pending.lines.append(text)
+                        self.in_flight.remove(pending)
+                        pending.finish(failed=True)
+                        break
+                return
+            
+            if text.startswith(QUEUE_FULL_PREFIX) or text.startswith(CANCELLED_PREFIX):
+                # The firmware dropped a command without running it; no READY follows
+                cancelled = text.startswith(CANCELLED_PREFIX)
+                rejected = text[len(CANCELLED_PREFIX if cancelled else QUEUE_FULL_PREFIX):]
+                for pending in reversed(self.in_flight):
+                    if pending.wire == rejected:
+                        pending.lines.append(text)
+                        if pending.attempts == 1 or cancelled:  # STOP clears every queued copy
+                            self.in_flight.remove(pending)
+                            pending.finish(failed=True)
+                        # else: an earlier copy may still run; the deadline decides
+                        break
+                return
+            
+            if not self.in_flight:
+                return  # Boot banner or output nobody is waiting for
+            
+            if text.startswith("Received command:"):
+                # None for a replayed duplicate of a command that already finished
+                self.current = self._find_in_flight(text)
+                if self.current is not None and self.current.started_at is None:
+                    self.current.started_at = time.time()
+                    if self.current.sequence:
+                        self.current.timeout_at = self.current.started_at + self.current.timeout
+            elif self.current is None and not self.in_flight[0].sequence:
+                self.current = self.in_flight[0]  # Older firmware: output always belongs to the head
+            
+            if text == "READY" or text.startswith("READY @"):
+                pending = self._find_in_flight(text)
+                self.current = None
+                if pending is None:
+                    return
+                pending.lines.append(text)
+                self.in_flight.remove(pending)
+                pending.finish()
+                # The next queued command should start right away; if the firmware
+                # never got it, find out in START_TIMEOUT rather than a full COMMAND_TIMEOUT
+                for waiting in self._execution_order():
+                    if waiting.started_at is None:
+                        if waiting.sequence:
+                            waiting.timeout_at = min(waiting.timeout_at, time.time() + START_TIMEOUT)
+                        break
+            elif self.current is not None:
+                self.current.lines.append(text)
+    
+    def _find_in_flight(self, text: str) -> Optional[PendingCommand]:
+        """The in-flight command a "... @<seq>" line refers to (the head for untagged lines)"""
+        head, _, tag = text.rpartition(' @')
+        if not head or not tag.isdigit():
+            return self.in_flight[0] if self.in_flight and not self.in_flight[0].sequence else None
+        sequence = int(tag)
+        return next((p for p in self.in_flight if p.sequence == sequence), None)
+    
+    def _execution_order(self) -> List[PendingCommand]:
+        """In-flight commands in the order the firmware will run them (lock held)"""
+        if self.protocol < 3:
+            return list(self.in_flight)
+        return sorted(self.in_flight, key=lambda p: p.priority)  # Stable: FIFO within a class
+    
+    def _queued_ahead(self, pending: PendingCommand) -> float:
+        """Seconds to allow for the in-flight commands that run before a newly queued one,
+        including the time their AT start times hold them (lock held)"""
+        if self.protocol < 3:
+            ahead = list(self.in_flight)
+        else:
+            ahead = [p for p in self.in_flight if p.priority <= pending.priority]
+        return sum(COMMAND_TIMEOUT + p.lead for p in ahead)
+    
+    def _fail_in_flight(self):
+        """Give up on every outstanding command (timeout or lost port)"""
+        with self.lock:
+            self.current = None
+            while self.in_flight:
+                self.in_flight.popleft().finish(failed=True)
+    
+    def _handle_frame(self, encoded: bytes):
+        decoded = decode_frame(encoded)
+        if decoded is None:
+            self.frame_errors += 1
+            return
+        
+        frame_type, payload = decoded
+        if frame_type == FRAME_TYPE_TELEMETRY:
+            telemetry = decode_telemetry(payload)
+            if telemetry is None:
+                self.frame_errors += 1
+                return
+            self.telemetry = telemetry
+            self.telemetry_received_at = time.time()
+        elif frame_type == FRAME_TYPE_TRACE_HEADER:
+            if len(payload) != struct.calcsize(TRACE_HEADER_FORMAT):
+                self.frame_errors += 1
+                return
+            self.trace_header = payload
+            self.trace_chunks = []
+            self.trace_received_at = time.time()
+        elif frame_type == FRAME_TYPE_TRACE_EVENTS:
+            self.trace_chunks.append(payload)
+    
+    def get_telemetry(self) -> Optional[Dict]:
+        """Latest decoded telemetry frame plus its age, or None if none received"""
+        telemetry = self.telemetry
+        if telemetry is None:
+            return None
+        result = dict(telemetry)
+        result['age_seconds'] = round(time.time() - self.telemetry_received_at, 3)
+        result['frame_errors'] = self.frame_errors
+        return result
+    
+    def set_telemetry_rate(self, hz: int) -> bool:
+        """Start (hz > 0) or stop (hz == 0) the firmware telemetry stream"""
+        argument = str(hz) if hz > 0 else "OFF"
+        response = self.send_command(f"TELEMETRY {argument}", wait_for_ready=True)
+        return response is not None and "OK TELEMETRY" in response
+    
+    def dump_trace(self) -> Optional[Dict]:
+        """Flush the firmware trace ring and return its events on the host clock"""
+        self.trace_header = None
+        response = self.send_command("TRACE DUMP", wait_for_ready=True)
+        if response is None or "OK TRACE DUMP" not in response or self.trace_header is None:
+            return None
+        return decode_trace(self.trace_header, self.trace_chunks, self.trace_received_at)
+    
+    def send_command(self, command: str, wait_for_ready: bool = True,
+                     timeout: float = COMMAND_TIMEOUT) -> Optional[str]:
+        """Send command to Arduino and get response (None if it never answered)"""
+        pending = self._send(command, timeout)
+        if pending is None:
+            return None
+        if not wait_for_ready:
+            return ''
+        return '\n'.join(pending.lines) if self._wait(pending) else None
+    
+    def _send(self, command: str, timeout: float = COMMAND_TIMEOUT,
+              on_done=None, lead: float = 0.0) -> Optional[PendingCommand]:
+        """Write a command and register it in the in-flight table. None if it could not be
+        written; on_done then never fires, so the caller cleans up in exactly one place.
+        lead is how long an AT start time holds it after it starts, on top of timeout."""
         if not self.connected or not self.connection:
-            logger.error("Arduino not connected")
+            logger.error(f"Arduino on {self.port} not connected")
             return None
         
+        with self.lock:
+            sequence = None
+            if self.protocol >= 2:
+                sequence = self.next_sequence
+                self.next_sequence = sequence % SEQUENCE_MAX + 1
+            pending = PendingCommand(command, on_done, sequence)
+            if len(pending.wire) > COMMAND_MAX_LENGTH:
+                logger.error(f"Command too long for the firmware ({self.name}): {pending.wire}")
+                return None
+            pending.lead = lead
+            pending.timeout = timeout + lead
+            # Commands ahead of this one in the firmware queue run first
+            pending.timeout_at = pending.sent_at + pending.timeout + self._queued_ahead(pending)
+            if not self._write(pending):  # Not registered yet, so the failure does not finish it
+                return None
+            self.in_flight.append(pending)
+        
+        logger.info(f"Sent to Arduino ({self.name}): {pending.wire}")
+        return pending
+    
+    def _write(self, pending: PendingCommand) -> bool:
+        """Put a command on the wire (lock held); on a port error fail everything"""
         try:
-            with arduino_lock:
-                # Send command
-                command_bytes = (command + '\n').encode('utf-8')
-                self.connection.write(command_bytes)
-                self.connection.flush()
-                
-                logger.info(f"Sent to Arduino: {command}")
-                
-                # Read response
-                response_lines = []
-                timeout_start = time.time()
-                
-                while time.time() - timeout_start < 8:  # 8 second timeout
-                    if self.connection.in_waiting:
-                        line = self.connection.readline().decode('utf-8').strip()
-                        if line:
-                            response_lines.append(line)
-                            logger.info(f"Arduino: {line}")
-                            
-                            # Check if Arduino is ready
-                            if wait_for_ready and line == "READY":
-                                break
-                    time.sleep(0.1)
-                
-                return '\n'.join(response_lines)
-                
+            command_bytes = (pending.wire + '\n').encode('utf-8')
+            self.connection.write(command_bytes)
+            self.connection.flush()
+            if self.capture:
+                self.capture.record(CAPTURE_TX, command_bytes)
+            return True
         except Exception as e:
-            logger.error(f"Error communicating with Arduino: {e}")
+            logger.error(f"Error communicating with Arduino on {self.port}: {e}")
             self.connected = False
-            return None
+            self.current = None
+            while self.in_flight:
+                self.in_flight.popleft().finish(failed=True)
+            return False
     
-    def move_servo(self, direction: str) -> bool:
-        """Move servo to specified direction"""
+    def _wait(self, pending: PendingCommand) -> bool:
+        """Block until the command's READY; False if it timed out"""
+        with trace_span('serial_command', command=pending.command, lane=self.name):
+            # Wake at least every START_TIMEOUT: a READY for another command can pull the deadline in
+            while not pending.done.wait(max(0.0, min(pending.timeout_at - time.time(), START_TIMEOUT))):
+                if time.time() >= pending.timeout_at and not self.expire(pending):
+                    return pending.done.is_set() and not pending.failed
+        return True
+    
+    def expire(self, pending: PendingCommand) -> bool:
+        """Handle a command that missed its deadline; True if it was sent again"""
+        if not pending.sequence:
+            # Later output can no longer be matched to commands; start over with an empty table
+            logger.error(f"No READY from {self.name} for {pending.command}")
+            self._fail_in_flight()
+            return False
+        
+        with self.lock:
+            if pending not in self.in_flight:
+                return False  # Answered meanwhile
+            if pending.attempts <= COMMAND_RETRIES and self.connected:
+                # Safe to resend: if the first copy did run, the firmware replays its result
+                logger.warning(f"No READY from {self.name} for {pending.wire}, sending it again")
+                pending.attempts += 1
+                pending.started_at = None
+                pending.lines.clear()
+                self.in_flight.remove(pending)
+                pending.timeout_at = time.time() + pending.timeout + self._queued_ahead(pending)
+                self.in_flight.append(pending)
+                return self._write(pending)
+            
+            # Only this command is lost; the sequence ids keep the rest matched
+            logger.error(f"No READY from {self.name} for {pending.wire} after {pending.attempts} attempts")
+            self.in_flight.remove(pending)
+            if self.current is pending:
+                self.current = None
+            pending.finish(failed=True)
+            return False
+    
+    def move_servo(self, direction: str, item_trace: Optional[ItemTrace] = None,
+                   start_at: Optional[int] = None) -> bool:
+        """Move servo to specified direction, tagging the command with the item's trace id"""
         direction = direction.upper()
         if direction not in ['LEFT', 'RIGHT', 'CENTER']:
             logger.error(f"Invalid servo direction: {direction}")
             return False
+        pending = self.start_move(direction, item_trace, start_at=start_at)
+        if pending is not None:
+            self._wait(pending)
+        return self.finish_move(direction, pending, item_trace)
+    
+    def start_move(self, direction: str, item_trace: Optional[ItemTrace] = None,
+                   on_done=None, gesture: Optional[str] = None,
+                   start_at: Optional[int] = None) -> Optional[PendingCommand]:
+        """Send a movement without waiting for it; on_done(pending) fires on completion.
+        start_at (line_ms()) holds it until then on firmware with a line clock."""
+        direction = direction.upper()
+        if direction not in ['LEFT', 'RIGHT', 'CENTER']:
+            logger.error(f"Invalid servo direction: {direction}")
+            return None
+        command = direction
+        if gesture and gesture in self.gestures:
+            command += f" {gesture}"
+        lead = 0.0
+        if start_at is not None and self.protocol >= 4:
+            command += f" AT {start_at}"
+            lead = max(0, start_at - line_ms()) / 1000.0  # Up to SYNC_INTERVAL, past COMMAND_TIMEOUT
+        if item_trace:
+            command += f" #{item_trace.item_id}"
+        return self._send(command, on_done=on_done, lead=lead)
+    
+    def prearm(self, on_done=None) -> Optional[PendingCommand]:
+        """Lean the gate toward the side the firmware's running class mix favors"""
+        return self._send('PREARM', on_done=on_done)
+    
+    def finish_move(self, direction: str, pending: Optional[PendingCommand],
+                    item_trace: Optional[ItemTrace] = None) -> bool:
+        """Record the outcome of a completed (or failed) movement"""
+        success = pending is not None and not pending.failed and \
+            not any("ERROR" in line for line in pending.lines)
         
-        response = self.send_command(direction, wait_for_ready=True)
-        success = response is not None and "ERROR" not in response
+        if item_trace and pending is not None and not pending.failed:
+            # Firmware reports "DONE <id> <direction> <motion ms>"; the rest is
+            # time spent behind other commands in the firmware queue plus serial overhead
+            round_trip = time.time() - pending.sent_at
+            queued = pending.started_at - pending.sent_at if pending.started_at else 0.0
+            motion = 0.0
+            for line in pending.lines:
+                parts = line.split()
+                if len(parts) == 4 and parts[0] == 'DONE' and parts[1] == str(item_trace.item_id) \
+                        and parts[3].isdigit():  # A garbled line must not take down the actuation thread
+                    motion = int(parts[3]) / 1000.0
+            item_trace.record('firmware_queue', queued)
+            item_trace.record('motion', motion)
+            item_trace.record('serial_send', max(0.0, round_trip - queued - motion))
         
         if success:
             logger.info(f"Servo moved to {direction} successfully")
@@ -186,26 +944,312 @@ class ArduinoController:
             
         return success
     
+    def check_health(self, now: bool = False) -> Optional[Dict]:
+        """Read the firmware's background health check; now=True asks for a fresh one at the next idle gap"""
+        response = self.send_command("HEALTH NOW" if now else "HEALTH")
+        return self._parse_health(response)
+    
+    def wait_for_health_check(self, checks: int, timeout: float = HEALTH_STARTUP_TIMEOUT) -> Optional[Dict]:
+        """Poll HEALTH until a check after the first `checks` has completed; None if none did in time"""
+        deadline = time.time() + timeout
+        while time.time() < deadline:
+            time.sleep(1.0)
+            health = self.check_health()
+            if health is not None and health['checks'] > checks:
+                return health
+        return None
+    
+    def poll_health(self, on_done=None) -> Optional[PendingCommand]:
+        """Send HEALTH without waiting; the report lands in self.health"""
+        def done(pending: PendingCommand):
+            if not pending.failed:
+                self._parse_health('\n'.join(pending.lines))
+            if on_done:
+                on_done(pending)
+        return self._send("HEALTH", on_done=done)
+    
+    def _parse_health(self, response: Optional[str]) -> Optional[Dict]:
+        """Read "HEALTH STATE <s> FAULTS <a,b> CHECKS <n> ..." into self.health, warning on a new fault.
+        STATE is OK, DEGRADED, or UNCHECKED on a machine without a clear sensor."""
+        for line in (response or '').split('\n'):
+            parts = line.split()
+            if not parts or parts[0] != 'HEALTH':
+                continue
+            fields = dict(zip(parts[1::2], parts[2::2]))
+            try:
+                health = {
+                    'state': fields['STATE'],
+                    'faults': [f for f in fields.get('FAULTS', 'NONE').split(',') if f not in ('NONE', 'UNCHECKED')],
+                    'checks': int(fields['CHECKS']),
+                    'degraded': int(fields['DEGRADED']),
+                    'cancelled': int(fields['CANCELLED']),
+                    'silent_sorts': int(fields['SILENT_SORTS']),
+                    'age_seconds': int(fields['AGE_S']),
+                }
+            except (KeyError, ValueError):
+                logger.warning(f"Unexpected HEALTH reply from {self.name}: {line}")
+                return None
+            previous = self.health['degraded'] if self.health else 0
+            self.health = health
+            if health['degraded'] > previous:
+                logger.warning(f"{self.name} health check degraded: {', '.join(health['faults']) or 'recovered'} "
+                               f"({health['silent_sorts']} sorts in a row without an item at the clear sensor)")
+            return health
+        return None
+    
+    def sync_clock(self, on_done=None) -> Optional[PendingCommand]:
+        """Send SYNC with the host's line clock without waiting; the reply lands in self.line_clock.
+        The firmware takes the time the line arrived, so the value includes the transfer time."""
+        if self.protocol < 4:
+            return None
+        line_bytes = len(f"SYNC {line_ms()} @{SEQUENCE_MAX}\n")
+        transfer_ms = round(line_bytes * 10 * 1000 / self.baud_rate)
+        
+        def done(pending: PendingCommand):
+            if not pending.failed:
+                self._parse_sync('\n'.join(pending.lines))
+            if on_done:
+                on_done(pending)
+        return self._send(f"SYNC {line_ms() + transfer_ms}", on_done=done)
+    
+    def _parse_sync(self, response: str) -> Optional[Dict]:
+        """Read "OK SYNC <line ms> STEP_US <us>" into self.line_clock"""
+        for line in response.split('\n'):
+            parts = line.split()
+            if parts[:2] != ['OK', 'SYNC']:
+                continue
+            fields = dict(zip(parts[1::2], parts[2::2]))
+            try:
+                self.line_clock = {
+                    'line_ms': int(fields['SYNC']),
+                    'step_us': int(fields['STEP_US']),
+                    'sync_line': self.sync_line,
+                    'synced_at': time.time(),
+                }
+            except (KeyError, ValueError):
+                logger.warning(f"Unexpected SYNC reply from {self.name}: {line}")
+                return None
+            return self.line_clock
+        return None
+    
+    def stop(self) -> bool:
+        """STOP: let the running movement finish, cancel queued sorts and refuse new ones until resume()"""
+        response = self.send_command("STOP")
+        return response is not None and "OK STOPPED" in response
+    
+    def resume(self) -> bool:
+        """Accept sorts again after stop()"""
+        response = self.send_command("RESUME")
+        return response is not None and "OK RESUMED" in response
+    
     def test_servo(self) -> bool:
         """Test servo movement"""
         logger.info("Testing Arduino servo...")
-        response = self.send_command("TEST", wait_for_ready=True)
+        response = self.send_command("TEST", wait_for_ready=True, timeout=TEST_TIMEOUT)
         return response is not None and "ERROR" not in response
     
     def disconnect(self):
         """Disconnect from Arduino"""
+        self.reader_running = False
+        self._fail_in_flight()
         if self.connection:
             try:
                 self.connection.close()
                 self.connected = False
-                logger.info("Arduino disconnected")
+                logger.info(f"Arduino on {self.port} disconnected")
             except:
                 pass
 
+class LaneRegistry:
+    """
+    Sorting lanes, one per controller found with HELLO on the configured ports.
+    
+    Each lane has its own port, reader thread and in-flight table, so lanes
+    never wait on each other. Items go to the connected lane with the most
+    free queue credits (the firmware queue size from HELLO); when every
+    lane is full, callers wait until one frees up.
+    """
+    
+    def __init__(self):
+        self.lanes: List[ArduinoController] = []
+        self.outstanding = {}  # Lane -> items assigned and not yet finished
+        self.available = threading.Condition()
+    
+    def discover(self, ports: List[str], baud_rate: int, telemetry_hz: int = 0,
+                 capture_path: Optional[str] = None) -> int:
+        """Connect to every port in parallel and keep the ones that answer"""
+        if ports == ['auto']:
+            from serial.tools import list_ports
+            ports = [info.device for info in list_ports.comports()]
+            logger.info(f"Scanning serial ports for controllers: {', '.join(ports) or 'none found'}")
+            max_retries = 1  # Most scanned ports are not sorters
+        else:
+            max_retries = 5
+        
+        candidates = []
+        for index, port in enumerate(ports):
+            # One capture file per port so each can be replayed on its own
+            path = capture_path
+            if capture_path and len(ports) > 1:
+                path = f"{capture_path}.{index}"
+            candidates.append(ArduinoController(port, baud_rate, telemetry_hz, path))
+        
+        threads = [Thread(target=c.connect, kwargs={'max_retries': max_retries}, daemon=True)
+                   for c in candidates]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+        
+        with self.available:
+            for controller in candidates:
+                if not controller.connected:
+                    continue
+                if any(lane.lane_id == controller.lane_id for lane in self.lanes):
+                    logger.warning(f"Two controllers report {controller.name}; set a unique LANE_ID in arduino.cxx")
+                self.lanes.append(controller)
+                self.outstanding[controller] = 0
+        
+        logger.info(f"{len(self.lanes)} sorting lane(s) ready: "
+                    f"{', '.join(f'{lane.name} on {lane.port}' for lane in self.lanes)}")
+        self.sync_clocks(wait=True)
+        return len(self.lanes)
+    
+    def sync_clocks(self, wait: bool = False) -> List[Tuple[ArduinoController, PendingCommand]]:
+        """SYNC every connected lane's line clock to line_ms(); returns the commands sent"""
+        sent = []
+        for lane in self.connected():
+            pending = lane.sync_clock()
+            if pending is not None:
+                sent.append((lane, pending))
+        if wait:
+            for lane, pending in sent:
+                if lane._wait(pending) and lane.line_clock:
+                    logger.info(f"{lane.name} line clock synced over "
+                                f"{'the sync line' if lane.sync_line else 'serial'}")
+        return sent
+    
+    def connected(self) -> List[ArduinoController]:
+        return [lane for lane in self.lanes if lane.connected]
+    
+    def acquire(self, timeout: float = LANE_WAIT_TIMEOUT,
+                prefer: Collection[ArduinoController] = ()) -> Optional[ArduinoController]:
+        """Reserve a queue credit on the least busy connected lane. A lane in
+        prefer (its gate leans for this item) counts one command less, for
+        its PREARM, and wins ties."""
+        deadline = time.time() + timeout
+        with self.available:
+            while True:
+                free = [lane for lane in self.connected() if self.outstanding[lane] < lane.credits]
+                if free:
+                    lane = min(free, key=lambda l: ((self.outstanding[l] - (l in prefer)) / l.credits,
+                                                    l not in prefer))
+                    self.outstanding[lane] += 1
+                    return lane
+                remaining = deadline - time.time()
+                if remaining <= 0 or not self.connected():
+                    return None
+                self.available.wait(remaining)
+    
+    def acquire_next_idle(self, skip: Collection[ArduinoController] = ()) -> Optional[ArduinoController]:
+        """Reserve a credit on the idle lane acquire() would give the next item
+        (the first one: idle lanes tie), leaving out those in skip"""
+        with self.available:
+            for lane in self.connected():
+                if self.outstanding[lane] == 0 and lane not in skip:
+                    self.outstanding[lane] += 1
+                    return lane
+        return None
+    
+    def acquire_idle(self) -> List[ArduinoController]:
+        """Reserve a credit on every connected lane with nothing outstanding"""
+        with self.available:
+            idle = [lane for lane in self.connected() if self.outstanding[lane] == 0]
+            for lane in idle:
+                self.outstanding[lane] += 1
+        return idle
+    
+    def release(self, lane: ArduinoController):
+        with self.available:
+            self.outstanding[lane] -= 1
+            self.available.notify()
+    
+    def status(self) -> List[Dict]:
+        with self.available:
+            outstanding = dict(self.outstanding)
+        return [{
+            'lane': lane.lane_id,
+            'port': lane.port,
+            'connected': lane.connected,
+            'credits': lane.credits,
+            'outstanding': outstanding.get(lane, 0),
+            'health': lane.health,
+            'line_clock': lane.line_clock,
+            'telemetry': lane.get_telemetry()
+        } for lane in self.lanes]
+    
+    def disconnect_all(self):
+        for lane in self.lanes:
+            lane.disconnect()
+        with self.available:
+            self.available.notify_all()
+
 # ============================================================================
 # ML ANALYZER (Your existing code adapted)
 # ============================================================================
 
+class StreamingJsonFields:
+    """
+    Pulls completed top-level fields out of a JSON object while its text is
+    still streaming in, so early fields can be acted on before the rest
+    arrives. Nested values are returned whole once they close.
+    """
+    
+    def __init__(self):
+        self.text = ''
+        self.fields = {}
+        self.pos = 0
+        self.depth = 0
+        self.in_string = False
+        self.escape = False
+        self.key_start = None    # Offset of the current key's opening quote
+        self.key = None
+        self.value_start = None  # Offset just after the ':' of the current field
+    
+    def feed(self, chunk: str) -> Dict:
+        """Add streamed text; returns the fields completed by this chunk"""
+        self.text += chunk
+        completed = {}
+        while self.pos < len(self.text):
+            c = self.text[self.pos]
+            if self.in_string:
+                if self.escape:
+                    self.escape = False
+                elif c == '\\':
+                    self.escape = True
+                elif c == '"':
+                    self.in_string = False
+                    if self.key_start is not None:
+                        self.key = json.loads(self.text[self.key_start:self.pos + 1])
+                        self.key_start = None
+            elif c == '"':
+                self.in_string = True
+                if self.depth == 1 and self.value_start is None:
+                    self.key_start = self.pos
+            elif c in '{[':
+                self.depth += 1
+            elif c in '}]' or (c == ',' and self.depth == 1):
+                if self.depth == 1 and self.value_start is not None:
+                    value = json.loads(self.text[self.value_start:self.pos])
+                    self.fields[self.key] = completed[self.key] = value
+                    self.key = self.value_start = None
+                if c != ',':
+                    self.depth -= 1
+            elif c == ':' and self.depth == 1 and self.key is not None:
+                self.value_start = self.pos + 1
+            self.pos += 1
+        return completed
+
 class MLSortingAnalyzer:
     """Enhanced version of your E-waste analyzer for real-time sorting"""
     
@@ -260,18 +1304,27 @@ class MLSortingAnalyzer:
                     "description": "Any warnings or special instructions"
                 }
             },
-            "required": ["item_name", "safety_level", "sorting_direction", "confidence", "hazards", "notes"]
+            "required": ["item_name", "safety_level", "sorting_direction", "confidence", "hazards", "notes"],
+            # Generate in this order (the default is alphabetical) so the decision
+            # streams in before the long hazards and notes fields
+            "propertyOrdering": ["item_name", "safety_level", "sorting_direction", "confidence", "hazards", "notes"]
         }
     
-    def analyze_image_for_sorting(self, image_path: str) -> Dict:
+    def analyze_image_for_sorting(self, image_path: str, item_trace: Optional[ItemTrace] = None,
+                                  on_decision=None) -> Dict:
         """
         Analyze image and return sorting decision
         
         Args:
             image_path: Path to the image file
+            item_trace: Optional per-item trace that receives stage durations
+            on_decision: Optional callback, called with the fields received so
+                far as soon as sorting_direction and confidence have streamed
+                in; the hazards and notes keep arriving after it returns
             
         Returns:
-            Dictionary with ML analysis and sorting decision
+            Dictionary with ML analysis and sorting decision ('decided_early'
+            is True if on_decision was called)
         """
         result = {
             "filename": os.path.basename(image_path),
@@ -282,14 +1335,16 @@ class MLSortingAnalyzer:
             "confidence": 0.0,
             "hazards": [],
             "notes": "Analysis failed",
-            "error": None
+            "error": None,
+            "decided_early": False
         }
         
         try:
             logger.info(f"Analyzing image: {image_path}")
             
             # Upload image to Google AI
-            uploaded_image = genai.upload_file(image_path)
+            with self._stage(item_trace, 'upload_file'):
+                uploaded_image = genai.upload_file(image_path)
             
             # Enhanced prompt for sorting decisions
             sorting_prompt = f"""
@@ -302,21 +1357,35 @@ class MLSortingAnalyzer:
             Consider safety as the top priority. When in doubt, choose RIGHT for safer handling.
             """
             
-            # Generate analysis
-            response = self.ai_model.generate_content(
-                [sorting_prompt, uploaded_image],
-                generation_config=genai.GenerationConfig(
-                    response_mime_type="application/json",
-                    response_schema=self.response_format,
-                    temperature=0.1
-                )
-            )
-            
-            # Parse response
-            ai_result = json.loads(response.text)
+            # Stream the analysis: generate_content ends once the decision has arrived,
+            # generate_tail covers the hazards and notes that follow it
+            fields = StreamingJsonFields()
+            with self._stage(item_trace, 'generate_content'):
+                chunks = iter(self.ai_model.generate_content(
+                    [sorting_prompt, uploaded_image],
+                    generation_config=genai.GenerationConfig(
+                        response_mime_type="application/json",
+                        response_schema=self.response_format,
+                        temperature=0.1
+                    ),
+                    stream=True
+                ))
+                for chunk in chunks:
+                    fields.feed(self._chunk_text(chunk))
+                    if on_decision and 'sorting_direction' in fields.fields and 'confidence' in fields.fields:
+                        result['decided_early'] = True
+                        on_decision({**result, **fields.fields})
+                        break
+            
+            with self._stage(item_trace, 'generate_tail'):
+                for chunk in chunks:
+                    fields.feed(self._chunk_text(chunk))
+            
+            # Parse the complete response
+            ai_result = json.loads(fields.text)
             result.update(ai_result)
             
-            logger.info(f"ML Analysis complete: {result['item_name']} -> {result['sorting_direction']} (confidence: {result['confidence']:.2f})")
+            logger.info(f"ML Analysis complete for {image_path}: {result['item_name']} -> {result['sorting_direction']} (confidence: {result['confidence']:.2f})")
             
             # Update statistics
             stats['total_processed'] += 1
@@ -336,6 +1405,316 @@ class MLSortingAnalyzer:
             stats['errors'] += 1
         
         return result
+    
+    @staticmethod
+    def _chunk_text(chunk) -> str:
+        try:
+            return chunk.text
+        except ValueError:
+            return ''  # Chunks with no text part (e.g. only a finish reason)
+    
+    @staticmethod
+    def _stage(item_trace: Optional[ItemTrace], name: str):
+        return item_trace.stage(name) if item_trace else trace_span(name)
+
+# ============================================================================
+# SORTING PIPELINE
+# ============================================================================
+
+def choose_gesture(ml_result: Dict) -> Optional[str]:
+    """Sort gesture for an analyzed item; None runs the standard sweep"""
+    item_name = str(ml_result.get('item_name', '')).lower()
+    if any(keyword in item_name for keyword in HEAVY_ITEM_KEYWORDS):
+        return GESTURE_HEAVY
+    if ml_result.get('safety_level') in ('Do Not Shred', 'Discard'):
+        return None
+    if any(keyword in item_name for keyword in LIGHT_ITEM_KEYWORDS):
+        return GESTURE_LIGHT
+    return None
+
+class SortingItem:
+    """One uploaded image on its way through ML and actuation"""
+    
+    FINAL_STATES = ('success', 'ml_error', 'servo_error', 'lane_timeout')
+    
+    def __init__(self, trace: ItemTrace, filename: str, image_path: str):
+        self.trace = trace
+        self.filename = filename
+        self.image_path = image_path
+        self.status = 'queued'
+        self.message = None
+        self.ml_result = None
+        self.direction = None
+        self.gesture = None
+        self.lane = None
+        self.pending = None
+        self.enqueued_at = time.time()
+        self.decided_at = None
+        self.backlogged_at = None  # Joined the actuation loop's backlog (fails after LANE_WAIT_TIMEOUT)
+        self.ml_streaming = False  # Decided early, rest of the ML response still arriving
+        self.outcome = None        # (status, message) from actuation, held until ML is done
+        self.record = None  # ItemTraceLog record once finished
+    
+    def to_dict(self) -> Dict:
+        result = {
+            'item_id': self.trace.item_id,
+            'status': self.status,
+            'done': self.status in self.FINAL_STATES,
+            'filename': self.filename,
+            'direction': self.direction,
+            'gesture': self.gesture,
+            'lane': self.lane.lane_id if self.lane else None,
+            'message': self.message,
+            'stage_timings': dict(self.trace.stages)
+        }
+        if self.ml_result and not self.ml_result.get('error'):
+            result['ml_analysis'] = {key: self.ml_result[key] for key in
+                                     ('item_name', 'safety_level', 'sorting_direction',
+                                      'confidence', 'hazards', 'notes')}
+        if self.record:
+            result['total_seconds'] = self.record['total_seconds']
+        return result
+
+class SortingPipeline:
+    """
+    Upload → bounded ingest queue → ML worker pool → single actuation stage.
+    
+    Uploads return 202 as soon as the image is saved and clients poll
+    /api/items/<id>. A fixed number of ML workers drain the ingest queue, so
+    a burst of photos waits in the queue instead of tying up request
+    threads. One actuation thread owns lane assignment: it sends each
+    decided item to a lane without waiting for the movement and picks up
+    completions as the lanes' reader threads report them.
+    
+    The ML response is streamed, so an item is decided as soon as its
+    direction and confidence arrive; the gate moves while the hazards and
+    notes are still generating, and the item finishes when both are done.
+    While an analysis runs, the idle lane the item will most likely go to
+    gets PREARM so its gate is already part of the way toward the likely
+    side when the decision comes; that lane then takes the item.
+    """
+    
+    def __init__(self, ml_workers: int, queue_size: int, keep_items: int = 500):
+        self.ingest = queue.Queue(maxsize=queue_size)
+        self.events = queue.Queue()  # ('analyzing'|'decided', item) from ML workers, ('moved', item) from lanes
+        self.items = OrderedDict()   # item_id -> SortingItem, oldest first
+        self.keep_items = keep_items
+        self.lock = Lock()
+        self.running = False
+        self.threads = [Thread(target=self._ml_worker, daemon=True, name=f"ml-worker-{i + 1}")
+                        for i in range(ml_workers)]
+        self.threads.append(Thread(target=self._actuation_loop, daemon=True, name="actuation"))
+    
+    def start(self):
+        self.running = True
+        for thread in self.threads:
+            thread.start()
+        logger.info(f"Sorting pipeline started: {len(self.threads) - 1} ML workers, "
+                    f"ingest queue of {self.ingest.maxsize}")
+    
+    def stop(self):
+        self.running = False
+        for _ in self.threads:
+            try:
+                self.ingest.put_nowait(None)  # Wake idle ML workers
+            except queue.Full:
+                break
+    
+    def submit(self, item: SortingItem) -> bool:
+        """Queue an item for ML; False when the ingest queue is full"""
+        try:
+            self.ingest.put_nowait(item)
+        except queue.Full:
+            return False
+        with self.lock:
+            self.items[item.trace.item_id] = item
+            while len(self.items) > self.keep_items:
+                self.items.popitem(last=False)
+        return True
+    
+    def get(self, item_id: int) -> Optional[SortingItem]:
+        with self.lock:
+            return self.items.get(item_id)
+    
+    def status(self) -> Dict:
+        with self.lock:
+            states = [item.status for item in self.items.values()]
+        return {
+            'ingest_queue': self.ingest.qsize(),
+            'ingest_capacity': self.ingest.maxsize,
+            'ml_workers': len(self.threads) - 1,
+            'in_progress': {state: states.count(state) for state in set(states)
+                            if state not in SortingItem.FINAL_STATES}
+        }
+    
+    def _ml_worker(self):
+        while self.running:
+            item = self.ingest.get()
+            if item is None:
+                break
+            item.trace.record('ingest_queue', time.time() - item.enqueued_at)
+            item.status = 'analyzing'
+            if ARDUINO_PREARM:
+                self.events.put(('analyzing', item))
+            
+            def decide(ml_result, item=item):
+                item.ml_streaming = True
+                self._decide(item, ml_result)
+            
+            try:
+                ml_result = ml_analyzer.analyze_image_for_sorting(item.image_path, item.trace,
+                                                                  on_decision=decide)
+            except Exception as e:
+                ml_result = {'error': str(e)}
+            
+            if not item.ml_streaming:
+                item.ml_result = ml_result
+                if ml_result.get('error'):
+                    self._finish(item, 'ml_error', f"ML analysis failed: {ml_result['error']}")
+                else:
+                    self._decide(item, ml_result)
+                continue
+            
+            # Decided early: keep the partial result if the tail went wrong
+            with self.lock:
+                if ml_result.get('error'):
+                    logger.warning(f"Item {item.trace.item_id}: ML response incomplete after decision: "
+                                   f"{ml_result['error']}")
+                else:
+                    item.ml_result = ml_result
+                item.ml_streaming = False
+                outcome = item.outcome
+            if outcome:
+                self._finish(item, *outcome)
+    
+    def _decide(self, item: SortingItem, ml_result: Dict):
+        item.ml_result = ml_result
+        item.direction = ml_result['sorting_direction'].upper()
+        item.gesture = choose_gesture(ml_result)
+        item.status = 'waiting_for_lane'
+        item.decided_at = time.time()
+        self.events.put(('decided', item))
+    
+    def _actuation_loop(self):
+        backlog = deque()  # Decided items waiting for a lane credit, in decision order
+        moving = []        # Items whose movement has been sent
+        background = []    # (lane, PendingCommand) for PREARM, HEALTH and SYNC awaiting READY
+        leaning = {}       # Lane -> when it was sent PREARM, until an item goes to it
+        next_health_poll = time.time() + HEALTH_POLL_INTERVAL
+        next_sync = time.time() + SYNC_INTERVAL
+        
+        while self.running:
+            try:
+                kind, item = self.events.get(timeout=0.5)
+            except queue.Empty:
+                kind, item = None, None
+            
+            # Earlier analyses keep their lanes; one lane per item leans
+            leaning = {lane: at for lane, at in leaning.items() if time.time() - at < PREARM_TIMEOUT}
+            if kind == 'analyzing' and not backlog and lanes:
+                lane = lanes.acquire_next_idle(skip=leaning)
+                if lane is not None:
+                    pending = lane.prearm(on_done=lambda _, done=lane: lanes.release(done))
+                    if pending is None:
+                        lanes.release(lane)
+                    else:
+                        background.append((lane, pending))
+                        leaning[lane] = time.time()
+            elif kind == 'decided':
+                item.backlogged_at = time.time()
+                backlog.append(item)
+            elif kind == 'moved' and item in moving:
+                moving.remove(item)
+                success = item.lane.finish_move(item.direction, item.pending, item.trace)
+                lanes.release(item.lane)
+                self._complete(item, 'success' if success else 'servo_error',
+                             None if success else 'Servo movement failed')
+            
+            # Commands that never got their READY; failing them reports 'moved' events
+            now = time.time()
+            for waiting in moving:
+                if not waiting.pending.done.is_set() and now > waiting.pending.timeout_at:
+                    waiting.lane.expire(waiting.pending)
+            background = [(lane, pending) for lane, pending in background if not pending.done.is_set()]
+            for lane, pending in background:
+                if now > pending.timeout_at:
+                    lane.expire(pending)
+            
+            # Pick up the firmware's idle-time health checks from lanes with nothing to do
+            if lanes and not backlog and now >= next_health_poll:
+                next_health_poll = now + HEALTH_POLL_INTERVAL
+                for lane in lanes.acquire_idle():
+                    if lane.health is None:  # Firmware without HEALTH (see check_health at startup)
+                        lanes.release(lane)
+                        continue
+                    pending = lane.poll_health(on_done=lambda _, done=lane: lanes.release(done))
+                    if pending is None:
+                        lanes.release(lane)
+                    else:
+                        background.append((lane, pending))
+            
+            # Keep the line clocks together; SYNC needs no credit, the firmware stamps it on arrival
+            if lanes and now >= next_sync:
+                next_sync = now + SYNC_INTERVAL
+                background.extend(lanes.sync_clocks())
+            
+            # Oldest first: an item that found no lane credit in LANE_WAIT_TIMEOUT fails
+            while backlog and now - backlog[0].backlogged_at > LANE_WAIT_TIMEOUT:
+                stats['errors'] += 1
+                self._complete(backlog.popleft(), 'lane_timeout',
+                               f"No lane free within {LANE_WAIT_TIMEOUT} s")
+            
+            while backlog:
+                lane = lanes.acquire(timeout=0, prefer=leaning) if lanes else None
+                if lane is None:
+                    if not lanes or not lanes.connected():
+                        while backlog:
+                            stats['errors'] += 1
+                            self._complete(backlog.popleft(), 'servo_error', 'Arduino not connected')
+                    break
+                
+                item = backlog.popleft()
+                leaning.pop(lane, None)
+                item.trace.record('lane_wait', time.time() - item.decided_at)
+                item.lane = lane
+                item.status = 'sorting'
+                moving.append(item)
+                item.pending = lane.start_move(item.direction, item.trace,
+                                               on_done=lambda _, done=item: self.events.put(('moved', done)),
+                                               gesture=item.gesture)
+                if item.pending is None:
+                    moving.remove(item)
+                    lanes.release(lane)
+                    stats['errors'] += 1
+                    self._complete(item, 'servo_error', 'Could not send to Arduino')
+    
+    def _complete(self, item: SortingItem, status: str, message: Optional[str] = None):
+        """Actuation is over; finish now unless the ML response is still streaming"""
+        with self.lock:
+            if item.ml_streaming:
+                item.outcome = (status, message)
+                item.status = 'finishing_analysis'
+                return
+        self._finish(item, status, message)
+    
+    def _finish(self, item: SortingItem, status: str, message: Optional[str] = None):
+        item.message = message
+        ml_result = item.ml_result or {}
+        item.record = item_traces.finish(
+            item.trace,
+            filename=item.filename,
+            direction=item.direction,
+            gesture=item.gesture,
+            safety_level=ml_result.get('safety_level'),
+            lane=item.lane.lane_id if item.lane else None,
+            status=status
+        )
+        item.status = status
+        if status == 'success':
+            logger.info(f"Complete sorting cycle successful: item {item.trace.item_id} "
+                        f"{ml_result.get('item_name')} -> {item.direction} ({item.lane.name})")
+        else:
+            logger.error(f"Item {item.trace.item_id} failed: {message}")
 
 # ============================================================================
 # FLASK WEB API
@@ -344,9 +1723,13 @@ class MLSortingAnalyzer:
 @app.route('/api/upload_image', methods=['POST'])
 def upload_image():
     """Main endpoint for phone to upload images"""
+    with trace_span('upload_image'):
+        return _upload_image()
+
+def _upload_image():
     try:
         # Check Arduino connection
-        if not arduino_connection or not arduino_connection.connected:
+        if not lanes or not lanes.connected():
             return jsonify({
                 'status': 'error',
                 'message': 'Arduino not connected'
@@ -366,55 +1749,34 @@ def upload_image():
                 'message': 'No image selected'
             }), 400
         
+        # Per-item trace id follows the item through ML and the firmware
+        item_trace = item_traces.new_item()
+        
         # Save uploaded image
         timestamp = datetime.now().strftime('%Y%m%d_%H%M%S_%f')[:-3]  # milliseconds
         filename = f"ewaste_{timestamp}_{image_file.filename}"
         image_path = os.path.join(UPLOAD_FOLDER, filename)
         
-        image_file.save(image_path)
-        logger.info(f"Image saved: {filename}")
-        
-        # Analyze with ML
-        ml_result = ml_analyzer.analyze_image_for_sorting(image_path)
+        with item_trace.stage('save'):
+            image_file.save(image_path)
+        logger.info(f"Image saved: {filename} (item {item_trace.item_id})")
         
-        if ml_result.get('error'):
+        # ML and the servo move happen in the pipeline; the client polls for the result
+        if not pipeline.submit(SortingItem(item_trace, filename, image_path)):
+            logger.warning(f"Ingest queue full, rejected item {item_trace.item_id}")
             return jsonify({
                 'status': 'error',
-                'message': f"ML analysis failed: {ml_result['error']}",
+                'message': 'Sorting queue full, retry shortly',
                 'filename': filename
-            }), 500
-        
-        # Execute servo movement based on ML decision
-        direction = ml_result['sorting_direction'].upper()
-        servo_success = arduino_connection.move_servo(direction)
-        
-        if servo_success:
-            response = {
-                'status': 'success',
-                'filename': filename,
-                'ml_analysis': {
-                    'item_name': ml_result['item_name'],
-                    'safety_level': ml_result['safety_level'],
-                    'sorting_direction': ml_result['sorting_direction'],
-                    'confidence': ml_result['confidence'],
-                    'hazards': ml_result['hazards'],
-                    'notes': ml_result['notes']
-                },
-                'servo_action': f"Moved servo {direction}",
-                'timestamp': ml_result['timestamp'],
-                'stats': stats.copy()
-            }
-            
-            logger.info(f"Complete sorting cycle successful: {ml_result['item_name']} -> {direction}")
-            return jsonify(response), 200
-        else:
-            stats['errors'] += 1
-            return jsonify({
-                'status': 'partial_success',
-                'message': 'ML analysis completed but servo movement failed',
-                'ml_analysis': ml_result,
-                'filename': filename
-            }), 207  # Multi-status
+            }), 503, {'Retry-After': '2'}
+        
+        return jsonify({
+            'status': 'accepted',
+            'item_id': item_trace.item_id,
+            'filename': filename,
+            'status_url': f"/api/items/{item_trace.item_id}",
+            'queue_depth': pipeline.ingest.qsize()
+        }), 202
             
     except Exception as e:
         logger.error(f"Error in upload_image: {e}")
@@ -424,6 +1786,17 @@ def upload_image():
             'message': f'Server error: {str(e)}'
         }), 500
 
+@app.route('/api/items/<int:item_id>', methods=['GET'])
+def get_item(item_id):
+    """Progress of one uploaded item: queued, analyzing, waiting_for_lane, sorting, finishing_analysis, then a final status"""
+    item = pipeline.get(item_id) if pipeline else None
+    if item is None:
+        return jsonify({
+            'status': 'error',
+            'message': f'Unknown item {item_id}'
+        }), 404
+    return jsonify(item.to_dict()), 200
+
 @app.route('/api/status', methods=['GET'])
 def get_status():
     """Get system status and statistics"""
@@ -431,19 +1804,53 @@ def get_status():
     
     return jsonify({
         'status': 'online',
-        'arduino_connected': arduino_connection.connected if arduino_connection else False,
+        'arduino_connected': bool(lanes and lanes.connected()),
         'uptime_seconds': uptime.total_seconds(),
         'ml_analyzer_ready': ml_analyzer is not None,
+        'arduino_telemetry': {lane.lane_id: lane.get_telemetry() for lane in lanes.lanes} if lanes else {},
+        'lanes': lanes.status() if lanes else [],
+        'line_ms': line_ms(),
+        'pipeline': pipeline.status() if pipeline else None,
         'stats': stats,
         'timestamp': datetime.now().isoformat()
     }), 200
 
+@app.route('/api/trace', methods=['GET'])
+def get_trace():
+    """Flush firmware and host traces (convert with tools/trace_to_chrome.py)"""
+    firmware_events = []
+    firmware_overwritten = 0
+    for lane in (lanes.connected() if lanes else []):
+        firmware_trace = lane.dump_trace()
+        if firmware_trace:
+            firmware_events.extend(dict(event, lane=lane.name) for event in firmware_trace['events'])
+            firmware_overwritten += firmware_trace['overwritten']
+    
+    return jsonify({
+        'firmware_events': firmware_events,
+        'firmware_overwritten': firmware_overwritten,
+        'host_spans': host_tracer.drain() if host_tracer else [],
+        'timestamp': datetime.now().isoformat()
+    }), 200
+
+@app.route('/api/item_traces', methods=['GET'])
+def get_item_traces():
+    """Per-item stage durations (save, upload_file, generate_content, generate_tail, serial_send, motion)"""
+    limit = request.args.get('limit', 50, type=int)
+    return jsonify({
+        'summary': item_traces.summary() if item_traces else {},
+        'items': item_traces.recent(limit) if item_traces else [],
+        'log_file': ITEM_TRACE_LOG,
+        'timestamp': datetime.now().isoformat()
+    }), 200
+
 @app.route('/api/manual_sort', methods=['POST'])
 def manual_sort():
-    """Manual servo control for testing"""
+    """Manual servo control for testing; optional start_at (line ms, see /api/status) schedules the move"""
     try:
         data = request.get_json()
         direction = data.get('direction', '').upper()
+        start_at = data.get('start_at')
         
         if direction not in ['LEFT', 'RIGHT', 'CENTER']:
             return jsonify({
@@ -451,17 +1858,27 @@ def manual_sort():
                 'message': 'Invalid direction. Use LEFT, RIGHT, or CENTER'
             }), 400
         
-        if not arduino_connection or not arduino_connection.connected:
+        if not lanes or not lanes.connected():
             return jsonify({
                 'status': 'error',
                 'message': 'Arduino not connected'
             }), 503
         
-        success = arduino_connection.move_servo(direction)
+        lane = lanes.acquire()
+        if lane is None:
+            return jsonify({
+                'status': 'error',
+                'message': 'All sorting lanes busy'
+            }), 503
+        try:
+            success = lane.move_servo(direction, start_at=int(start_at) if start_at is not None else None)
+        finally:
+            lanes.release(lane)
         
         return jsonify({
             'status': 'success' if success else 'error',
             'direction': direction,
+            'lane': lane.lane_id,
             'message': f"Servo {'moved' if success else 'failed to move'} {direction}"
         }), 200 if success else 500
         
@@ -478,11 +1895,14 @@ def test_system():
     try:
         results = []
         
-        # Test Arduino connection
-        if arduino_connection and arduino_connection.connected:
-            servo_test = arduino_connection.test_servo()
-            results.append(f"Arduino servo test: {'PASSED' if servo_test else 'FAILED'}")
-        else:
+        # Test every lane's controller
+        for lane in (lanes.lanes if lanes else []):
+            if lane.connected:
+                servo_test = lane.test_servo()
+                results.append(f"Arduino ({lane.name}) servo test: {'PASSED' if servo_test else 'FAILED'}")
+            else:
+                results.append(f"Arduino ({lane.name}): NOT CONNECTED")
+        if not lanes or not lanes.lanes:
             results.append("Arduino: NOT CONNECTED")
         
         # Test ML analyzer
@@ -504,6 +1924,40 @@ def test_system():
             'message': str(e)
         }), 500
 
+@app.route('/api/stop', methods=['POST'])
+def stop_sorting():
+    """Stop every lane: queued sorts are cancelled and new ones refused until /api/resume"""
+    return _set_lanes_stopped(True)
+
+@app.route('/api/resume', methods=['POST'])
+def resume_sorting():
+    """Let stopped lanes sort again"""
+    return _set_lanes_stopped(False)
+
+def _set_lanes_stopped(stop: bool):
+    try:
+        if not lanes or not lanes.connected():
+            return jsonify({
+                'status': 'error',
+                'message': 'Arduino not connected'
+            }), 503
+        
+        # Not through lanes.acquire(): STOP must not wait behind the sorts it cancels
+        results = {lane.name: lane.stop() if stop else lane.resume() for lane in lanes.connected()}
+        success = all(results.values())
+        return jsonify({
+            'status': 'success' if success else 'error',
+            'lanes': results,
+            'message': f"{'Stopped' if stop else 'Resumed'} {sum(results.values())} of {len(results)} lanes"
+        }), 200 if success else 500
+        
+    except Exception as e:
+        logger.error(f"Error in {'stop' if stop else 'resume'}: {e}")
+        return jsonify({
+            'status': 'error',
+            'message': str(e)
+        }), 500
+
 @app.route('/', methods=['GET'])
 def index():
     """Simple web interface showing system info"""
@@ -528,8 +1982,8 @@ def index():
             <h1>🤖 ML E-Waste Sorting System</h1>
             <p>Automated electronic waste sorting using AI analysis and servo control</p>
             
-            <div class="status {'online' if arduino_connection and arduino_connection.connected else 'offline'}">
-                Arduino Status: {'Connected ✅' if arduino_connection and arduino_connection.connected else 'Disconnected ❌'}
+            <div class="status {'online' if lanes and lanes.connected() else 'offline'}">
+                Arduino Status: {f'{len(lanes.connected())} lane(s) connected ✅' if lanes and lanes.connected() else 'Disconnected ❌'}
             </div>
             
             <div class="status {'online' if ml_analyzer else 'offline'}">
@@ -557,10 +2011,15 @@ def index():
             </div>
             
             <h3>📱 Phone App Endpoints</h3>
-            <div class="endpoint">POST /api/upload_image - Upload image for analysis and sorting</div>
+            <div class="endpoint">POST /api/upload_image - Upload image for analysis and sorting (returns 202 + item_id)</div>
+            <div class="endpoint">GET /api/items/&lt;item_id&gt; - Progress and result of an uploaded item</div>
             <div class="endpoint">GET /api/status - Get system status</div>
+            <div class="endpoint">GET /api/trace - Flush firmware and host event traces</div>
+            <div class="endpoint">GET /api/item_traces - Per-item stage timings</div>
             <div class="endpoint">POST /api/manual_sort - Manual servo control</div>
             <div class="endpoint">POST /api/test_system - Test all components</div>
+            <div class="endpoint">POST /api/stop - Cancel queued sorts on every lane and refuse new ones</div>
+            <div class="endpoint">POST /api/resume - Accept sorts again after a stop</div>
             
             <h3>🔧 Setup Instructions</h3>
             <ol>
@@ -580,9 +2039,11 @@ def index():
 
 def initialize_system():
     """Initialize all system components"""
-    global arduino_connection, ml_analyzer
+    global lanes, ml_analyzer, host_tracer, item_traces, pipeline
     
     logger.info("Initializing ML E-Waste Sorting System...")
+    host_tracer = HostTracer()
+    item_traces = ItemTraceLog(ITEM_TRACE_LOG)
     
     # Initialize ML Analyzer
     try:
@@ -594,13 +2055,28 @@ def initialize_system():
     
     # Initialize Arduino
     try:
-        arduino_connection = ArduinoController(ARDUINO_PORT, ARDUINO_BAUD)
-        if arduino_connection.connect():
-            # Test the servo
-            if arduino_connection.test_servo():
-                logger.info("Arduino servo system ready")
-            else:
-                logger.warning("Arduino connected but servo test failed")
+        lanes = LaneRegistry()
+        if lanes.discover(ARDUINO_PORTS, ARDUINO_BAUD, ARDUINO_TELEMETRY_HZ, ARDUINO_CAPTURE_FILE):
+            # Check the servos: the firmware tests itself in idle gaps; older firmware runs the blocking TEST
+            requested = [(lane, lane.check_health(now=True)) for lane in lanes.lanes]  # All lanes at once
+            for lane, health in requested:
+                if health is not None:
+                    health = lane.wait_for_health_check(health['checks'])
+                    if health is None:
+                        logger.warning(f"Arduino ({lane.name}) connected but its health check did not complete "
+                                       f"within {HEALTH_STARTUP_TIMEOUT} s")
+                    elif health['state'] == 'OK':
+                        logger.info(f"Arduino servo system ready ({lane.name}, {health['checks']} health checks)")
+                    elif health['state'] == 'UNCHECKED':
+                        logger.warning(f"Arduino ({lane.name}) connected; it has no clear sensor, so its health "
+                                       f"check cannot confirm the servos")
+                    else:
+                        logger.warning(f"Arduino ({lane.name}) connected but health check reports "
+                                       f"{', '.join(health['faults'])}")
+                elif lane.test_servo():
+                    logger.info(f"Arduino servo system ready ({lane.name})")
+                else:
+                    logger.warning(f"Arduino ({lane.name}) connected but servo test failed")
         else:
             logger.error("Failed to connect to Arduino")
             return False
@@ -608,6 +2084,8 @@ def initialize_system():
         logger.error(f"Arduino initialization error: {e}")
         return False
     
+    pipeline = SortingPipeline(ML_WORKERS, INGEST_QUEUE_SIZE)
+    pipeline.start()
     return True
 
 def main():
@@ -645,8 +2123,10 @@ def main():
         return 1
     finally:
         # Cleanup
-        if arduino_connection:
-            arduino_connection.disconnect()
+        if pipeline:
+            pipeline.stop()
+        if lanes:
+            lanes.disconnect_all()
         logger.info("System shutdown complete")
     
     return 0
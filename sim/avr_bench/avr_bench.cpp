@@ -0,0 +1,304 @@
+/*
+ * ============================================================================
+ * CYCLE-ACCURATE FIRMWARE BENCHMARK (simavr)
+ * ============================================================================
+ * Runs the real AVR build of arduino.cxx (compiled with -DBENCHMARK_MARKERS)
+ * on a simulated ATmega2560 at 16 MHz and drives it over UART0 with a fixed
+ * command script. The firmware writes BENCH_* section ids to GPIOR0; this
+ * harness timestamps those writes in CPU cycles and reports count/min/mean/
+ * max cycles per section: command parse, motion tick, telemetry frame,
+ * serial poll and one background service pass.
+ *
+ * Memory: static RAM (.data + .bss) from the ELF symbols, peak stack from
+ * the lowest SP seen, peak heap from __brkval, and the smallest gap between
+ * heap and stack over the run.
+ *
+ * Usage: avr_bench FIRMWARE.elf [--verbose] [COMMAND ...]
+ * Commands default to TELEMETRY 50, LEFT, STATUS, BOGUS, TRACE DUMP and are
+ * sent one at a time on READY.
+ * ============================================================================
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <gelf.h>
+#include <unistd.h>
+
+#include <avr_uart.h>
+#include <sim_avr.h>
+#include <sim_elf.h>
+#include <sim_io.h>
+
+namespace {
+
+// Must match BENCH_* in arduino.cxx
+const uint8_t BENCH_END = 0x80;
+const char *const SECTION_NAMES[] = {"", "service", "poll", "parse", "motion_tick", "telemetry"};
+const int SECTION_COUNT = sizeof(SECTION_NAMES) / sizeof(SECTION_NAMES[0]);
+
+const uint32_t CPU_HZ = 16000000;
+const avr_io_addr_t GPIOR0_ADDR = 0x3E;  // Data-space address on the ATmega2560
+const uint16_t RAM_START = 0x0200;
+const uint16_t RAM_END = 0x21FF;
+const uint32_t DATA_SPACE_OFFSET = 0x800000;  // avr-gcc places SRAM symbols here
+const avr_cycle_count_t STEP_CYCLE_LIMIT = 30ULL * CPU_HZ;  // Per command, waiting for READY
+
+struct Section {
+  uint64_t count = 0;
+  uint64_t total = 0;
+  uint64_t min = UINT64_MAX;
+  uint64_t max = 0;
+  avr_cycle_count_t startedAt = 0;
+  bool open = false;
+};
+
+struct Bench {
+  avr_t *avr = nullptr;
+  avr_irq_t *uartInput = nullptr;
+  bool xon = true;
+  bool verbose = false;
+
+  Section sections[SECTION_COUNT];
+
+  std::string line;
+  bool inFrame = false;
+  int readyCount = 0;
+  std::deque<uint8_t> pendingInput;
+};
+
+// ============================================================================
+// FIRMWARE HOOKS
+// ============================================================================
+
+void onMarker(avr_t *avr, avr_io_addr_t addr, uint8_t value, void *param) {
+  avr->data[addr] = value;  // Keep GPIOR0 behaving like a plain register
+  Bench *bench = static_cast<Bench *>(param);
+  int id = value & ~BENCH_END;
+  if (id <= 0 || id >= SECTION_COUNT) return;
+
+  Section &s = bench->sections[id];
+  if (!(value & BENCH_END)) {
+    s.startedAt = avr->cycle;
+    s.open = true;
+  } else if (s.open) {
+    uint64_t cycles = avr->cycle - s.startedAt;
+    s.count++;
+    s.total += cycles;
+    s.min = std::min(s.min, cycles);
+    s.max = std::max(s.max, cycles);
+    s.open = false;
+  }
+}
+
+// Text lines only; binary frames (FRAME_START 0xA5 ... 0x00) are skipped
+void onUartOutput(avr_irq_t *, uint32_t value, void *param) {
+  Bench *bench = static_cast<Bench *>(param);
+  uint8_t c = static_cast<uint8_t>(value);
+  if (bench->inFrame) {
+    if (c == 0x00) bench->inFrame = false;
+    return;
+  }
+  if (c == 0xA5) {
+    bench->inFrame = true;
+  } else if (c == '\n') {
+    if (!bench->line.empty() && bench->line.back() == '\r') bench->line.pop_back();
+    if (bench->verbose) std::printf("[%12.3f ms] %s\n", bench->avr->cycle * 1000.0 / CPU_HZ, bench->line.c_str());
+    if (bench->line == "READY") bench->readyCount++;
+    bench->line.clear();
+  } else {
+    bench->line += static_cast<char>(c);
+  }
+}
+
+void onUartXon(avr_irq_t *, uint32_t, void *param) {
+  static_cast<Bench *>(param)->xon = true;
+}
+
+void onUartXoff(avr_irq_t *, uint32_t, void *param) {
+  static_cast<Bench *>(param)->xon = false;
+}
+
+// ============================================================================
+// ELF SYMBOLS
+// ============================================================================
+
+// Fills in symbol addresses from the ELF symtab; missing symbols stay 0
+bool readSymbols(const char *path, std::vector<std::pair<std::string, uint32_t>> &symbols) {
+  if (elf_version(EV_CURRENT) == EV_NONE) return false;
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return false;
+  Elf *elf = elf_begin(fd, ELF_C_READ, nullptr);
+  if (!elf) {
+    close(fd);
+    return false;
+  }
+
+  Elf_Scn *scn = nullptr;
+  while ((scn = elf_nextscn(elf, scn)) != nullptr) {
+    GElf_Shdr shdr;
+    if (!gelf_getshdr(scn, &shdr) || shdr.sh_type != SHT_SYMTAB) continue;
+    Elf_Data *data = elf_getdata(scn, nullptr);
+    size_t count = shdr.sh_entsize ? shdr.sh_size / shdr.sh_entsize : 0;
+    for (size_t i = 0; i < count; i++) {
+      GElf_Sym sym;
+      if (!gelf_getsym(data, static_cast<int>(i), &sym)) continue;
+      const char *name = elf_strptr(elf, shdr.sh_link, sym.st_name);
+      if (!name) continue;
+      for (auto &s : symbols) {
+        if (s.first == name) s.second = static_cast<uint32_t>(sym.st_value);
+      }
+    }
+  }
+  elf_end(elf);
+  close(fd);
+  return true;
+}
+
+uint32_t symbolAddress(const std::vector<std::pair<std::string, uint32_t>> &symbols, const char *name) {
+  for (const auto &s : symbols) {
+    if (s.first == name) return s.second >= DATA_SPACE_OFFSET ? s.second - DATA_SPACE_OFFSET : s.second;
+  }
+  return 0;
+}
+
+void printUsage() {
+  std::fprintf(stderr, "Usage: avr_bench FIRMWARE.elf [--verbose] [COMMAND ...]\n");
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  const char *firmwarePath = nullptr;
+  bool verbose = false;
+  std::vector<std::string> commands;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--verbose") {
+      verbose = true;
+    } else if (arg.rfind("--", 0) == 0) {
+      printUsage();
+      return 2;
+    } else if (!firmwarePath) {
+      firmwarePath = argv[i];
+    } else {
+      commands.push_back(arg);
+    }
+  }
+  if (!firmwarePath) {
+    printUsage();
+    return 2;
+  }
+  if (commands.empty()) commands = {"TELEMETRY 50", "LEFT", "STATUS", "BOGUS", "TRACE DUMP"};
+
+  elf_firmware_t firmware;
+  std::memset(&firmware, 0, sizeof(firmware));
+  if (elf_read_firmware(firmwarePath, &firmware) != 0) {
+    std::fprintf(stderr, "avr_bench: cannot read %s\n", firmwarePath);
+    return 2;
+  }
+
+  Bench bench;
+  bench.verbose = verbose;
+  bench.avr = avr_make_mcu_by_name("atmega2560");
+  if (!bench.avr) {
+    std::fprintf(stderr, "avr_bench: simavr has no atmega2560 core\n");
+    return 2;
+  }
+  avr_t *avr = bench.avr;
+  avr_init(avr);
+  avr_load_firmware(avr, &firmware);
+  avr->frequency = CPU_HZ;
+  avr->log = verbose ? LOG_WARNING : LOG_ERROR;
+
+  // UART0 is the firmware's Serial; take it away from simavr's stdout echo
+  uint32_t uartFlags = 0;
+  avr_ioctl(avr, AVR_IOCTL_UART_GET_FLAGS('0'), &uartFlags);
+  uartFlags &= ~AVR_UART_FLAG_STDIO;
+  avr_ioctl(avr, AVR_IOCTL_UART_SET_FLAGS('0'), &uartFlags);
+  avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUTPUT), onUartOutput, &bench);
+  avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUT_XON), onUartXon, &bench);
+  avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUT_XOFF), onUartXoff, &bench);
+  bench.uartInput = avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_INPUT);
+
+  avr_register_io_write(avr, GPIOR0_ADDR, onMarker, &bench);
+
+  std::vector<std::pair<std::string, uint32_t>> symbols = {{"__data_start", 0}, {"__bss_end", 0}, {"__heap_start", 0},
+                                                           {"__brkval", 0}};
+  readSymbols(firmwarePath, symbols);
+  uint16_t heapStart = symbolAddress(symbols, "__heap_start");
+  uint16_t brkvalAddr = symbolAddress(symbols, "__brkval");
+  if (!heapStart) heapStart = symbolAddress(symbols, "__bss_end");
+
+  uint16_t minSp = RAM_END;
+  uint16_t maxHeapTop = heapStart;
+  int minGap = RAM_END;
+
+  // One command per READY; the first READY is the boot banner
+  size_t nextCommand = 0;
+  int readyWanted = 1;
+  avr_cycle_count_t stepDeadline = avr->cycle + STEP_CYCLE_LIMIT;
+  bool timedOut = false;
+
+  while (true) {
+    int state = avr_run(avr);
+    if (state == cpu_Done || state == cpu_Crashed) {
+      std::fprintf(stderr, "avr_bench: simulated CPU stopped (state %d)\n", state);
+      return 1;
+    }
+
+    uint16_t sp = avr->data[R_SPL] | (avr->data[R_SPH] << 8);
+    if (sp < minSp) minSp = sp;
+    if (brkvalAddr) {
+      uint16_t brk = avr->data[brkvalAddr] | (avr->data[brkvalAddr + 1] << 8);
+      uint16_t heapTop = brk ? brk : heapStart;
+      if (heapTop > maxHeapTop) maxHeapTop = heapTop;
+      if (sp > heapTop) minGap = std::min(minGap, static_cast<int>(sp - heapTop));
+    }
+
+    if (!bench.pendingInput.empty() && bench.xon) {
+      avr_raise_irq(bench.uartInput, bench.pendingInput.front());
+      bench.pendingInput.pop_front();
+    }
+
+    if (bench.readyCount >= readyWanted) {
+      if (nextCommand == commands.size()) break;
+      for (char c : commands[nextCommand]) bench.pendingInput.push_back(static_cast<uint8_t>(c));
+      bench.pendingInput.push_back('\n');
+      nextCommand++;
+      readyWanted++;
+      stepDeadline = avr->cycle + STEP_CYCLE_LIMIT;
+    } else if (avr->cycle > stepDeadline) {
+      timedOut = true;
+      break;
+    }
+  }
+
+  // Report
+  std::printf("%-12s %8s %10s %10s %10s %10s\n", "section", "count", "min_cyc", "mean_cyc", "max_cyc", "mean_us");
+  for (int id = 1; id < SECTION_COUNT; id++) {
+    const Section &s = bench.sections[id];
+    if (s.count == 0) {
+      std::printf("%-12s %8d %10s %10s %10s %10s\n", SECTION_NAMES[id], 0, "-", "-", "-", "-");
+      continue;
+    }
+    double mean = static_cast<double>(s.total) / s.count;
+    std::printf("%-12s %8llu %10llu %10.0f %10llu %10.1f\n", SECTION_NAMES[id], (unsigned long long)s.count,
+                (unsigned long long)s.min, mean, (unsigned long long)s.max, mean * 1e6 / CPU_HZ);
+  }
+
+  std::printf("\nSRAM %u bytes: static %u, peak heap %u, peak stack %u, min heap/stack gap %d\n",
+              RAM_END - RAM_START + 1, heapStart > RAM_START ? heapStart - RAM_START : 0,
+              maxHeapTop > heapStart ? maxHeapTop - heapStart : 0, RAM_END - minSp, minGap);
+  std::printf("%zu/%zu commands completed in %.3f s simulated\n", timedOut ? nextCommand - 1 : nextCommand,
+              commands.size(), avr->cycle / static_cast<double>(CPU_HZ));
+
+  return timedOut ? 1 : 0;
+}
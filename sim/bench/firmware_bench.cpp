@@ -0,0 +1,201 @@
+/*
+ * ============================================================================
+ * FIRMWARE MICROBENCHMARKS (Google Benchmark)
+ * ============================================================================
+ * Host-side timings for the pure-logic units of arduino.cxx: command line
+ * parsing vs decoding the same command as a binary frame, the command queue,
+ * the trajectory generator, status formatting, CRC16 and COBS encode/decode.
+ * Absolute numbers are for the host CPU, not the ATmega2560 (see avr_bench
+ * for cycle counts); use them to compare one build against another.
+ *
+ * Usage: firmware_bench [--benchmark_filter=REGEX] [other Google Benchmark flags]
+ * ============================================================================
+ */
+
+// Compiled into this binary (rather than linked from firmware_host) so the
+// benchmarks can call the firmware's internal functions directly
+#include "../../arduino.cxx"
+
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+#include "frame_decode.h"
+
+namespace {
+
+// Print sink that only counts bytes, so status formatting is measured alone
+class NullPrint : public Print {
+public:
+  size_t write(uint8_t) override {
+    bytes++;
+    return 1;
+  }
+  size_t write(const uint8_t *, size_t length) override {
+    bytes += length;
+    return length;
+  }
+  size_t bytes = 0;
+};
+
+// Payload with zeros spread through it, like telemetry (small counters)
+std::vector<byte> samplePayload(int length) {
+  std::vector<byte> payload(length);
+  for (int i = 0; i < length; i++) payload[i] = (i % 5 == 0) ? 0 : (byte)(i * 37);
+  return payload;
+}
+
+// ============================================================================
+// COMMAND PARSING
+// ============================================================================
+
+const char *const TEXT_COMMANDS[] = {"LEFT", "right #1234", "LEFT FLICK #1234 @77", "LEFT AT 120500 #1234 @77",
+                                     "  TELEMETRY 50  ", "BOGUS"};
+
+void BM_ParseTextCommand(benchmark::State &state) {
+  const String line = TEXT_COMMANDS[state.range(0)];
+  for (auto _ : state) {
+    String command = line;
+    unsigned int itemId = 0;
+    byte gesture = GESTURE_STANDARD;
+    unsigned int sequence = 0;
+    unsigned long startAt = 0;
+    CommandCode code = parseCommandLine(command, itemId, gesture, sequence, startAt);
+    benchmark::DoNotOptimize(code);
+    benchmark::DoNotOptimize(itemId);
+    benchmark::DoNotOptimize(gesture);
+    benchmark::DoNotOptimize(sequence);
+    benchmark::DoNotOptimize(startAt);
+  }
+  state.SetLabel(TEXT_COMMANDS[state.range(0)]);
+}
+BENCHMARK(BM_ParseTextCommand)->DenseRange(0, 5);
+
+// The same information as "RIGHT #1234" in a frame: command code + item id
+void BM_ParseBinaryCommand(benchmark::State &state) {
+  byte payload[3] = {CMD_RIGHT, 1234 & 0xFF, 1234 >> 8};
+  byte frame[FRAME_MAX_ENCODED];
+  int length = encodeFrame(0x10, payload, sizeof(payload), frame);
+  for (auto _ : state) {
+    byte type;
+    byte decoded[FRAME_MAX_PAYLOAD];
+    int n = decodeFrame(frame + 1, length - 2, type, decoded);  // Between FRAME_START and 0x00
+    CommandCode code = (n == 3) ? (CommandCode)decoded[0] : CMD_UNKNOWN;
+    unsigned int itemId = decoded[1] | (decoded[2] << 8);
+    benchmark::DoNotOptimize(code);
+    benchmark::DoNotOptimize(itemId);
+  }
+}
+BENCHMARK(BM_ParseBinaryCommand);
+
+// ============================================================================
+// COMMAND QUEUE
+// ============================================================================
+
+void BM_CommandQueueRoundTrip(benchmark::State &state) {
+  const String line = "LEFT #42";
+  String command;
+  byte priority;
+  for (auto _ : state) {
+    enqueueCommand(line);
+    dequeueCommand(command, priority);
+    benchmark::DoNotOptimize(command);
+  }
+}
+BENCHMARK(BM_CommandQueueRoundTrip);
+
+// ============================================================================
+// MOTION
+// ============================================================================
+
+// Whole LEFT -> RIGHT profile (91 setpoints)
+void BM_TrajectoryFullSweep(benchmark::State &state) {
+  for (auto _ : state) {
+    int steps = trajectoryStepCount(LEFT_POSITION, RIGHT_POSITION);
+    for (int i = 0; i < steps; i++) {
+      benchmark::DoNotOptimize(trajectoryPosition(LEFT_POSITION, RIGHT_POSITION, i));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * trajectoryStepCount(LEFT_POSITION, RIGHT_POSITION));
+}
+BENCHMARK(BM_TrajectoryFullSweep);
+
+// ============================================================================
+// STATUS
+// ============================================================================
+
+void BM_WriteSystemStatus(benchmark::State &state) {
+  NullPrint out;
+  for (auto _ : state) {
+    writeSystemStatus(out);
+  }
+  state.SetBytesProcessed(out.bytes);
+}
+BENCHMARK(BM_WriteSystemStatus);
+
+// ============================================================================
+// FRAMING
+// ============================================================================
+
+void BM_Crc16(benchmark::State &state) {
+  std::vector<byte> data = samplePayload(state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(crc16(data.data(), data.size()));
+  }
+  state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_Crc16)->Arg(8)->Arg(35)->Arg(FRAME_MAX_PAYLOAD);
+
+void BM_CobsEncode(benchmark::State &state) {
+  std::vector<byte> data = samplePayload(state.range(0));
+  byte out[FRAME_MAX_ENCODED];
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(cobsEncode(data.data(), data.size(), out));
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_CobsEncode)->Arg(8)->Arg(35)->Arg(FRAME_MAX_PAYLOAD);
+
+void BM_CobsDecode(benchmark::State &state) {
+  std::vector<byte> data = samplePayload(state.range(0));
+  byte encoded[FRAME_MAX_ENCODED];
+  int length = cobsEncode(data.data(), data.size(), encoded);
+  byte out[FRAME_MAX_ENCODED];
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(cobsDecode(encoded, length, out));
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_CobsDecode)->Arg(8)->Arg(35)->Arg(FRAME_MAX_PAYLOAD);
+
+// Telemetry-sized frame: CRC + COBS + delimiters, no Serial
+void BM_EncodeFrame(benchmark::State &state) {
+  std::vector<byte> payload = samplePayload(state.range(0));
+  byte frame[FRAME_MAX_ENCODED];
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(encodeFrame(FRAME_TYPE_TELEMETRY, payload.data(), payload.size(), frame));
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * payload.size());
+}
+BENCHMARK(BM_EncodeFrame)->Arg(35)->Arg(FRAME_MAX_PAYLOAD);
+
+void BM_DecodeFrame(benchmark::State &state) {
+  std::vector<byte> payload = samplePayload(state.range(0));
+  byte frame[FRAME_MAX_ENCODED];
+  int length = encodeFrame(FRAME_TYPE_TELEMETRY, payload.data(), payload.size(), frame);
+  byte decoded[FRAME_MAX_PAYLOAD];
+  for (auto _ : state) {
+    byte type;
+    benchmark::DoNotOptimize(decodeFrame(frame + 1, length - 2, type, decoded));
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * payload.size());
+}
+BENCHMARK(BM_DecodeFrame)->Arg(35)->Arg(FRAME_MAX_PAYLOAD);
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,295 @@
+/*
+ * ============================================================================
+ * SERIAL FAULT INJECTION
+ * ============================================================================
+ * Runs the host build of arduino.cxx behind a pseudo-terminal, paced to wall
+ * time, with faults on the link, so the unmodified host (ArduinoController
+ * in finalanalyze.py) opens it like a board on a serial port:
+ *
+ *   latency spikes  the link stalls for --stall-ms, --stalls times a minute
+ *   byte drops      each byte lost with probability --drop
+ *   corruption      each byte gets a flipped bit with probability --corrupt
+ *   device resets   --resets times a minute the board reboots the way a Mega
+ *                   behind its USB-serial chip does: the port stays open,
+ *                   bytes sent during the --boot-ms the bootloader takes are
+ *                   lost, then the firmware starts over with its banner
+ *
+ * The firmware runs in a child process forked from one that never ran it,
+ * so a reset kills the child and forks a new one: every global starts from
+ * its static initialiser and setup() runs as at power-up. The host end's
+ * rate is read from the terminal settings, so a firmware that reboots to
+ * its default rate under a host that negotiated another sees garbage, as
+ * on the real link.
+ *
+ * The terminal's path is the first line on stdout (--link also makes a
+ * symlink to it); on SIGINT/SIGTERM the reset count follows. Run
+ * tools/fault_bench.py for the throughput and latency report.
+ *
+ * Usage: fault_sim [--drop P] [--corrupt P] [--stalls PER_MIN] [--stall-ms MS]
+ *                  [--resets PER_MIN] [--boot-ms MS] [--link PATH] [--seed N]
+ *                  [--verbose]
+ * ============================================================================
+ */
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+
+#include <Arduino.h>
+
+#include "sim_runtime.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const uint64_t TICK_MICROS = 1000;      // How often the board's end of the terminal is serviced
+const size_t OUTPUT_LIMIT = 64 * 1024;  // Output nobody reads is dropped past this
+
+struct Options {
+  double dropRate = 0.0;
+  double corruptRate = 0.0;
+  double stallsPerMin = 0.0;
+  double stallMs = 1500.0;
+  double resetsPerMin = 0.0;
+  double bootMs = 1000.0;
+  std::string link;
+  unsigned long seed = 1;
+  bool verbose = false;
+};
+
+volatile sig_atomic_t stopRequested = 0;
+
+void requestStop(int) { stopRequested = 1; }
+
+// Baud rate of a termios speed; 0 for one it can't name (the host set it
+// with BOTHER), which the link model takes as matching the firmware
+unsigned long baudOf(speed_t speed) {
+  switch (speed) {
+    case B9600: return 9600;
+    case B19200: return 19200;
+    case B38400: return 38400;
+    case B57600: return 57600;
+    case B115200: return 115200;
+    case B230400: return 230400;
+#ifdef B500000
+    case B500000: return 500000;
+    case B1000000: return 1000000;
+    case B2000000: return 2000000;
+#endif
+    default: return 0;
+  }
+}
+
+// ============================================================================
+// PSEUDO-TERMINAL
+// ============================================================================
+
+// Opens a raw pseudo-terminal and returns its master end (non-blocking). The
+// slave end is held open too, so the host can close and reopen it without
+// the master seeing a hangup.
+int openTerminal(std::string &path, int &slave) {
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) return -1;
+  path = ptsname(master);
+  slave = open(path.c_str(), O_RDWR | O_NOCTTY);
+  if (slave < 0) return -1;
+
+  termios settings;
+  tcgetattr(slave, &settings);
+  cfmakeraw(&settings);
+  cfsetispeed(&settings, B115200);  // BAUD_RATE, until the host sets its own
+  cfsetospeed(&settings, B115200);
+  tcsetattr(slave, TCSANOW, &settings);
+  fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+  return master;
+}
+
+// ============================================================================
+// BOARD
+// ============================================================================
+
+// One boot of the firmware, in its own process. Every TICK_MICROS of virtual
+// time it waits for wall time to catch up, hands the host's bytes to the
+// firmware and writes the firmware's output to the terminal.
+class Board {
+public:
+  Board(const Options &options, int master, int slave, unsigned int boot)
+      : master_(master), slave_(slave), parent_(getppid()) {
+    sim::LinkFaults faults;
+    faults.dropRate = options.dropRate;
+    faults.corruptRate = options.corruptRate;
+    faults.stallsPerMin = options.stallsPerMin;
+    faults.stallMs = options.stallMs;
+    faults.seed = options.seed + boot;  // A rebooted board meets new faults
+    sim::setLinkFaults(faults);
+  }
+
+  [[noreturn]] void run() {
+    started_ = Clock::now();
+    sim::setOutputHandler([this](uint8_t value, uint64_t) { output_.push_back(static_cast<char>(value)); });
+    sim::setWakeHandler([this](uint64_t now) { service(now); });
+    sim::scheduleWake(TICK_MICROS);
+    setup();
+    for (;;) loop();
+  }
+
+private:
+  void service(uint64_t nowMicros) {
+    if (getppid() != parent_) _exit(0);  // fault_sim is gone
+    std::this_thread::sleep_until(started_ + std::chrono::microseconds(nowMicros));
+
+    termios settings;
+    if (tcgetattr(slave_, &settings) == 0) sim::setHostBaud(baudOf(cfgetospeed(&settings)));
+
+    char buffer[256];
+    ssize_t count;
+    while ((count = read(master_, buffer, sizeof(buffer))) > 0) {
+      sim::scheduleInput(std::string(buffer, static_cast<size_t>(count)), nowMicros);
+    }
+
+    if (!output_.empty()) {
+      count = write(master_, output_.data(), output_.size());
+      if (count > 0) output_.erase(0, static_cast<size_t>(count));
+      if (output_.size() > OUTPUT_LIMIT) output_.clear();
+    }
+    sim::scheduleWake(nowMicros + TICK_MICROS);
+  }
+
+  int master_;
+  int slave_;
+  pid_t parent_;
+  Clock::time_point started_;
+  std::string output_;
+};
+
+pid_t startBoard(const Options &options, int master, int slave, unsigned int boot) {
+  std::fflush(stdout);
+  std::fflush(stderr);
+  pid_t pid = fork();
+  if (pid == 0) Board(options, master, slave, boot).run();
+  return pid;
+}
+
+void stopBoard(pid_t pid) {
+  kill(pid, SIGKILL);
+  waitpid(pid, nullptr, 0);
+}
+
+// The bootloader: whatever the host sends while it runs is lost
+void boot(int master, double bootMs) {
+  Clock::time_point until = Clock::now() + std::chrono::microseconds(static_cast<int64_t>(bootMs * 1000.0));
+  char buffer[256];
+  while (Clock::now() < until && !stopRequested) {
+    while (read(master, buffer, sizeof(buffer)) > 0) {
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+}
+
+Clock::time_point nextReset(std::mt19937_64 &rng, double resetsPerMin) {
+  if (resetsPerMin <= 0) return Clock::time_point::max();
+  std::exponential_distribution<double> gap(resetsPerMin / 60e6);
+  return Clock::now() + std::chrono::microseconds(static_cast<int64_t>(gap(rng)));
+}
+
+void printUsage() {
+  std::fprintf(stderr,
+               "Usage: fault_sim [--drop P] [--corrupt P] [--stalls PER_MIN] [--stall-ms MS]\n"
+               "                 [--resets PER_MIN] [--boot-ms MS] [--link PATH] [--seed N]\n"
+               "                 [--verbose]\n");
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--drop" && hasValue) {
+      options.dropRate = std::atof(argv[++i]);
+    } else if (arg == "--corrupt" && hasValue) {
+      options.corruptRate = std::atof(argv[++i]);
+    } else if (arg == "--stalls" && hasValue) {
+      options.stallsPerMin = std::atof(argv[++i]);
+    } else if (arg == "--stall-ms" && hasValue) {
+      options.stallMs = std::atof(argv[++i]);
+    } else if (arg == "--resets" && hasValue) {
+      options.resetsPerMin = std::atof(argv[++i]);
+    } else if (arg == "--boot-ms" && hasValue) {
+      options.bootMs = std::atof(argv[++i]);
+    } else if (arg == "--link" && hasValue) {
+      options.link = argv[++i];
+    } else if (arg == "--seed" && hasValue) {
+      options.seed = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--verbose") {
+      options.verbose = true;
+    } else {
+      printUsage();
+      return arg == "--help" || arg == "-h" ? 0 : 2;
+    }
+  }
+
+  std::string path;
+  int slave = -1;
+  int master = openTerminal(path, slave);
+  if (master < 0) {
+    std::perror("fault_sim: pseudo-terminal");
+    return 1;
+  }
+  if (!options.link.empty()) {
+    unlink(options.link.c_str());
+    if (symlink(path.c_str(), options.link.c_str()) != 0) {
+      std::perror("fault_sim: --link");
+      return 1;
+    }
+  }
+  signal(SIGINT, requestStop);
+  signal(SIGTERM, requestStop);
+  std::printf("%s\n", path.c_str());
+  if (options.verbose) {
+    std::fprintf(stderr, "fault_sim: stalls %.1f/min x %.0f ms, drop %.4f, corrupt %.4f per byte, resets %.2f/min\n",
+                 options.stallsPerMin, options.stallMs, options.dropRate, options.corruptRate, options.resetsPerMin);
+  }
+
+  std::mt19937_64 rng(options.seed);
+  Clock::time_point start = Clock::now();
+  unsigned int boots = 0;
+  unsigned long resets = 0;
+  pid_t board = startBoard(options, master, slave, boots++);
+  Clock::time_point resetAt = nextReset(rng, options.resetsPerMin);
+  while (!stopRequested) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    if (waitpid(board, nullptr, WNOHANG) == board) {
+      std::fprintf(stderr, "fault_sim: firmware process exited\n");
+      board = -1;
+      break;
+    }
+    if (Clock::now() < resetAt) continue;
+
+    stopBoard(board);
+    resets++;
+    if (options.verbose) {
+      std::fprintf(stderr, "fault_sim: reset %lu at %.1f s\n", resets,
+                   std::chrono::duration<double>(Clock::now() - start).count());
+    }
+    boot(master, options.bootMs);
+    board = startBoard(options, master, slave, boots++);
+    resetAt = nextReset(rng, options.resetsPerMin);
+  }
+
+  if (board > 0) stopBoard(board);
+  if (!options.link.empty()) unlink(options.link.c_str());
+  std::printf("resets %lu\n", resets);
+  return 0;
+}
@@ -0,0 +1,36 @@
+/*
+ * Host build of the real firmware. arduino.cxx is compiled unchanged against
+ * the stand-in headers in shim/; this file only exports what the simulators
+ * need to read back from it.
+ */
+
+#include "../arduino.cxx"
+
+#include "sim_runtime.h"
+
+namespace sim {
+
+FirmwareConfig firmwareConfig() {
+  FirmwareConfig config;
+  config.servo1Pin = SERVO1_PIN;
+  config.servo2Pin = SERVO2_PIN;
+  config.leftPosition = LEFT_POSITION;
+  config.rightPosition = RIGHT_POSITION;
+  config.centerPosition = CENTER_POSITION;
+  config.moveTimeMs = MOVE_TIME;
+  config.holdTimeMs = HOLD_TIME;
+  config.stepDelayMs = STEP_DELAY;
+  config.servo2SettleTimeMs = Machine::HAS_FEEDER ? SERVO2_SETTLE_TIME : 0;  // No feeder, no settle
+  config.commandQueueSize = COMMAND_QUEUE_SIZE;
+  return config;
+}
+
+int firmwareQueueDepth() {
+  return commandQueueCount;
+}
+
+int firmwareTrajectorySteps(int fromPos, int toPos) {
+  return trajectoryStepCount(fromPos, toPos);
+}
+
+}  // namespace sim
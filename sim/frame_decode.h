@@ -0,0 +1,47 @@
+/*
+ * ============================================================================
+ * BINARY FRAME DECODER
+ * ============================================================================
+ * The receiving end of the firmware's binary frames (encodeFrame/cobsEncode
+ * in arduino.cxx). The firmware only sends frames, so the decoder lives here
+ * for the tests and benchmarks; finalanalyze.py has its own in Python.
+ *
+ * Include after arduino.cxx: it uses the firmware's crc16() and frame limits.
+ * ============================================================================
+ */
+
+#pragma once
+
+#include <cstring>
+
+// Returns the decoded length, -1 on a malformed block
+inline int cobsDecode(const byte *data, int length, byte *out) {
+  int n = 0;
+  int i = 0;
+  while (i < length) {
+    int code = data[i++];
+    if (code == 0 || i + code - 1 > length) return -1;
+    memcpy(out + n, data + i, code - 1);
+    n += code - 1;
+    i += code - 1;
+    if (code < 0xFF && i < length) out[n++] = 0;
+  }
+  return n;
+}
+
+// Reverse of encodeFrame: takes the bytes between FRAME_START and the 0x00
+// delimiter, checks the CRC and returns the payload length (-1 if corrupt).
+// payload must hold FRAME_MAX_PAYLOAD bytes.
+inline int decodeFrame(const byte *encoded, int length, byte &type, byte *payload) {
+  byte raw[FRAME_MAX_PAYLOAD + 3];
+  if (length > FRAME_MAX_PAYLOAD + 4) return -1;
+
+  int n = cobsDecode(encoded, length, raw);
+  if (n < 3) return -1;
+  unsigned int crc = raw[n - 2] | ((unsigned int)raw[n - 1] << 8);
+  if (crc16(raw, n - 2) != crc) return -1;
+
+  type = raw[0];
+  memcpy(payload, raw + 1, n - 3);
+  return n - 3;
+}
@@ -0,0 +1,560 @@
+/*
+ * ============================================================================
+ * DISCRETE-EVENT LINE SIMULATOR
+ * ============================================================================
+ * Drives the host build of arduino.cxx with a stochastic stream of items:
+ *
+ *   arrival --(ML latency)--> decision --(host backlog)--> sort command
+ *           --(firmware queue)--> gate at target pose --> DONE
+ *
+ * Arrivals are Poisson. ML latency is lognormal, either given directly or
+ * fitted from ml_sorting_system.log. Each item's safety_level is drawn from
+ * a class mix and maps to LEFT (Safe to Shred) or RIGHT (everything else),
+ * as in finalanalyze.py. Host events fire at their exact virtual time, even
+ * while the firmware is inside a movement.
+ *
+ * Reports throughput, missed-deadline rate (gate not at the item's pose
+ * within the deadline after arrival), decision-to-drop latency, gate
+ * utilization and queue occupancy.
+ *
+ * --prearm sends PREARM whenever an item's analysis starts while the
+ * firmware is idle, so the gate leans toward the likely side meanwhile.
+ *
+ * Usage: line_sim [--items N] [--rate ITEMS_PER_MIN]
+ *                 [--belt-speed M_PER_S --item-spacing M [--travel-m M]]
+ *                 [--deadline-s S] [--ml-log FILE | --ml-lognormal MU,SIGMA]
+ *                 [--ml-workers N] [--mix SAFE,PREPROCESS,DO_NOT_SHRED,DISCARD]
+ *                 [--host-mode lock|queue] [--prearm] [--seed N] [--verbose]
+ * ============================================================================
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <Arduino.h>
+
+#include "sim_runtime.h"
+
+namespace {
+
+const char *SAFETY_LEVELS[4] = {"Safe to Shred", "Requires Preprocessing", "Do Not Shred", "Discard"};
+const double SAMPLE_INTERVAL_MS = 10.0;
+
+// ============================================================================
+// ML LATENCY
+// ============================================================================
+
+struct Lognormal {
+  double mu = std::log(2.5);   // Median 2.5 s until a log is available
+  double sigma = 0.35;
+  int samples = 0;             // How many log entries the fit used (0 = default)
+};
+
+long daysFromCivil(int y, int m, int d) {
+  y -= m <= 2;
+  long era = (y >= 0 ? y : y - 399) / 400;
+  long yearOfEra = y - era * 400;
+  long dayOfYear = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  long dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+  return era * 146097 + dayOfEra - 719468;
+}
+
+// Python logging asctime: "2025-03-14 09:26:53,589 - INFO - message"
+bool parseLogTime(const std::string &line, double &seconds) {
+  int year, month, day, hour, minute, second, millis;
+  if (std::sscanf(line.c_str(), "%d-%d-%d %d:%d:%d,%d", &year, &month, &day, &hour, &minute, &second,
+                  &millis) != 7) {
+    return false;
+  }
+  seconds = daysFromCivil(year, month, day) * 86400.0 + hour * 3600 + minute * 60 + second + millis / 1000.0;
+  return true;
+}
+
+// Start time of the analysis of the image whose path begins text (followed
+// by ": "), taken out of started; false if no analysis of it is open
+bool takeStart(std::map<std::string, std::deque<double>> &started, const std::string &text, double &seconds) {
+  auto match = started.end();
+  for (auto it = started.begin(); it != started.end(); ++it) {
+    const std::string &path = it->first;
+    bool prefix = text.compare(0, path.size(), path) == 0 && text.compare(path.size(), 2, ": ") == 0;
+    if (prefix && (match == started.end() || path.size() > match->first.size())) match = it;
+  }
+  if (match == started.end()) return false;
+  seconds = match->second.front();
+  match->second.pop_front();
+  if (match->second.empty()) started.erase(match);
+  return true;
+}
+
+// Pairs "Analyzing image: <path>" with the "ML Analysis complete for <path>"
+// line of the same image (analyses overlap, so they finish out of order) and
+// fits a lognormal to the durations. Failed analyses are skipped.
+bool fitLatencyFromLog(const std::string &path, Lognormal &fit, std::string &error) {
+  const std::string startTag = "Analyzing image: ";
+  const std::string completeTag = "ML Analysis complete for ";
+  const std::string failedTag = "ML analysis failed for ";
+  std::ifstream file(path);
+  if (!file) {
+    error = "cannot open " + path;
+    return false;
+  }
+
+  std::map<std::string, std::deque<double>> started;  // Image path -> start times
+  std::vector<double> logDurations;
+  std::string line;
+  while (std::getline(file, line)) {
+    double seconds;
+    double startedAt;
+    if (!parseLogTime(line, seconds)) continue;
+    size_t at;
+    if ((at = line.find(startTag)) != std::string::npos) {
+      started[line.substr(at + startTag.size())].push_back(seconds);
+    } else if ((at = line.find(completeTag)) != std::string::npos) {
+      if (!takeStart(started, line.substr(at + completeTag.size()), startedAt)) continue;
+      double duration = seconds - startedAt;
+      if (duration > 0) logDurations.push_back(std::log(duration));
+    } else if ((at = line.find(failedTag)) != std::string::npos) {
+      takeStart(started, line.substr(at + failedTag.size()), startedAt);
+    }
+  }
+
+  if (logDurations.size() < 2) {
+    error = path + ": need at least 2 completed analyses to fit ML latency";
+    return false;
+  }
+
+  double mean = 0.0;
+  for (double x : logDurations) mean += x;
+  mean /= logDurations.size();
+  double variance = 0.0;
+  for (double x : logDurations) variance += (x - mean) * (x - mean);
+  variance /= logDurations.size() - 1;
+
+  fit.mu = mean;
+  fit.sigma = std::sqrt(variance);
+  fit.samples = static_cast<int>(logDurations.size());
+  return true;
+}
+
+// ============================================================================
+// SIMULATION STATE
+// ============================================================================
+
+struct Options {
+  int items = 200;
+  double ratePerMin = 12.0;
+  double deadlineS = 10.0;
+  Lognormal mlLatency;
+  int mlWorkers = 0;               // 0 = unbounded, like Flask's threaded server
+  double mix[4] = {0.55, 0.20, 0.15, 0.10};
+  bool queueMode = false;          // false = one command in flight (one queue credit)
+  bool prearm = false;
+  unsigned long seed = 1;
+  bool verbose = false;
+};
+
+struct Item {
+  int id = 0;
+  int safetyClass = 0;
+  bool left = false;
+  double arrivalMs = -1.0;
+  double mlDoneMs = -1.0;
+  double sentMs = -1.0;
+  double startMs = -1.0;
+  double gateMs = -1.0;            // servo 1 commanded to the item's pose
+  double doneMs = -1.0;
+  bool dropped = false;
+};
+
+enum EventType { EVENT_ARRIVAL, EVENT_ML_DONE, EVENT_SAMPLE };
+
+struct Event {
+  double timeMs;
+  EventType type;
+  int item;
+  bool operator>(const Event &other) const { return timeMs > other.timeMs; }
+};
+
+struct Occupancy {
+  double sum = 0.0;
+  int max = 0;
+  int samples = 0;
+  void add(int value) {
+    sum += value;
+    max = std::max(max, value);
+    samples++;
+  }
+  double mean() const { return samples ? sum / samples : 0.0; }
+};
+
+class LineSimulation {
+public:
+  LineSimulation(const Options &options)
+      : options_(options), rng_(options.seed), firmware_(sim::firmwareConfig()) {
+    items_.resize(options.items + 1);
+  }
+
+  void run();
+  void report() const;
+
+private:
+  double nowMs() const { return sim::nowMicros() / 1000.0; }
+  void schedule(double timeMs, EventType type, int item);
+  void wake(uint64_t nowMicros);
+  void onArrival(int id, double nowMs);
+  void onMlDone(int id, double nowMs);
+  void onSample();
+  void startMl(int id, double nowMs);
+  void trySend(double nowMs);
+  void onLine(const std::string &line, double nowMs);
+  bool finished() const { return finishedItems_ == options_.items; }
+
+  Options options_;
+  std::mt19937_64 rng_;
+  sim::FirmwareConfig firmware_;
+  std::vector<Item> items_;
+  std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events_;
+
+  int arrived_ = 0;
+  int mlBusy_ = 0;
+  std::deque<int> mlWaiting_;
+  std::deque<int> backlog_;        // Decided, not yet sent to the firmware
+  std::deque<int> sent_;           // Sent, not yet started by the firmware
+  int inFlight_ = 0;               // Sent, READY not yet seen
+  int current_ = 0;                // Item the firmware is executing (0 = PREARM)
+  int prearms_ = 0;
+  int inSystem_ = 0;
+  int finishedItems_ = 0;
+  size_t writeCursor_ = 0;
+  double firstArrivalMs_ = 0.0;
+  double lastArrivalMs_ = 0.0;
+  double busyMs_ = 0.0;
+
+  Occupancy itemsInSystem_;
+  Occupancy hostBacklog_;
+  Occupancy firmwareQueue_;
+  sim::LineCollector lines_;
+};
+
+void LineSimulation::schedule(double timeMs, EventType type, int item) {
+  events_.push({timeMs, type, item});
+  sim::scheduleWake(static_cast<uint64_t>(events_.top().timeMs * 1000.0));
+}
+
+void LineSimulation::wake(uint64_t nowMicros) {
+  double now = nowMicros / 1000.0;
+  while (!events_.empty() && events_.top().timeMs <= now) {
+    Event event = events_.top();
+    events_.pop();
+    switch (event.type) {
+      case EVENT_ARRIVAL: onArrival(event.item, now); break;
+      case EVENT_ML_DONE: onMlDone(event.item, now); break;
+      case EVENT_SAMPLE: onSample(); break;
+    }
+  }
+  if (!events_.empty()) sim::scheduleWake(static_cast<uint64_t>(events_.top().timeMs * 1000.0));
+}
+
+void LineSimulation::onArrival(int id, double nowMs) {
+  Item &item = items_[id];
+  item.id = id;
+  item.arrivalMs = nowMs;
+  lastArrivalMs_ = nowMs;
+
+  std::discrete_distribution<int> mix(options_.mix, options_.mix + 4);
+  item.safetyClass = mix(rng_);
+  item.left = item.safetyClass == 0;
+
+  arrived_++;
+  inSystem_++;
+  if (options_.mlWorkers > 0 && mlBusy_ >= options_.mlWorkers) {
+    mlWaiting_.push_back(id);
+  } else {
+    startMl(id, nowMs);
+  }
+
+  if (id < options_.items) {
+    std::exponential_distribution<double> gap(options_.ratePerMin / 60000.0);
+    schedule(nowMs + gap(rng_), EVENT_ARRIVAL, id + 1);
+  }
+}
+
+void LineSimulation::startMl(int id, double nowMs) {
+  std::lognormal_distribution<double> latency(options_.mlLatency.mu, options_.mlLatency.sigma);
+  mlBusy_++;
+  schedule(nowMs + latency(rng_) * 1000.0, EVENT_ML_DONE, id);
+
+  // Only an idle gate is worth leaning; a busy one returns to center anyway
+  if (options_.prearm && inFlight_ == 0 && backlog_.empty()) {
+    sent_.push_back(0);
+    inFlight_++;
+    prearms_++;
+    sim::scheduleInput("PREARM\n", sim::nowMicros());
+  }
+}
+
+void LineSimulation::onMlDone(int id, double nowMs) {
+  items_[id].mlDoneMs = nowMs;
+  mlBusy_--;
+  if (!mlWaiting_.empty()) {
+    int next = mlWaiting_.front();
+    mlWaiting_.pop_front();
+    startMl(next, nowMs);
+  }
+  backlog_.push_back(id);
+  trySend(nowMs);
+}
+
+void LineSimulation::onSample() {
+  itemsInSystem_.add(inSystem_);
+  hostBacklog_.add(static_cast<int>(backlog_.size()));
+  firmwareQueue_.add(sim::firmwareQueueDepth());
+  if (!finished()) schedule(nowMs() + SAMPLE_INTERVAL_MS, EVENT_SAMPLE, 0);
+}
+
+// Lock mode is ArduinoController with one queue credit (firmware without
+// HELLO): one command in flight. Queue mode uses the COMMAND_QUEUE_SIZE
+// credits HELLO reports, keeping that many commands outstanding.
+void LineSimulation::trySend(double nowMs) {
+  int limit = options_.queueMode ? firmware_.commandQueueSize : 1;
+  while (!backlog_.empty() && inFlight_ < limit) {
+    int id = backlog_.front();
+    backlog_.pop_front();
+    Item &item = items_[id];
+    item.sentMs = nowMs;
+    sent_.push_back(id);
+    inFlight_++;
+    sim::scheduleInput(std::string(item.left ? "LEFT" : "RIGHT") + " #" + std::to_string(id) + "\n",
+                       sim::nowMicros());
+  }
+}
+
+void LineSimulation::onLine(const std::string &line, double nowMs) {
+  if (options_.verbose) std::printf("[%10.3f ms] %s\n", nowMs, line.c_str());
+
+  if (line.rfind("Received command: ", 0) == 0) {
+    if (!sent_.empty()) {
+      current_ = sent_.front();
+      sent_.pop_front();
+      items_[current_].startMs = nowMs;
+    }
+  } else if (line.rfind("DONE ", 0) == 0) {
+    int id = std::atoi(line.c_str() + 5);
+    if (id <= 0 || id > options_.items) return;
+    Item &item = items_[id];
+    item.doneMs = nowMs;
+    busyMs_ += nowMs - item.startMs;
+
+    // When did servo 1 get commanded to this item's pose?
+    int target = item.left ? firmware_.leftPosition : firmware_.rightPosition;
+    const std::vector<sim::ServoWrite> &writes = sim::servoWrites();
+    for (; writeCursor_ < writes.size(); writeCursor_++) {
+      const sim::ServoWrite &w = writes[writeCursor_];
+      if (w.pin == firmware_.servo1Pin && w.angle == target && w.timeMicros / 1000.0 >= item.startMs) {
+        item.gateMs = w.timeMicros / 1000.0;
+        break;
+      }
+    }
+    inSystem_--;
+    finishedItems_++;
+  } else if (line.rfind("ERROR: Command queue full", 0) == 0) {
+    int id = std::atoi(line.c_str() + line.find('#') + 1);
+    if (id <= 0 || id > options_.items) return;
+    items_[id].dropped = true;
+    sent_.erase(std::remove(sent_.begin(), sent_.end(), id), sent_.end());
+    inFlight_--;
+    inSystem_--;
+    finishedItems_++;
+    trySend(nowMs);
+  } else if (line == "READY" && inFlight_ > 0) {
+    inFlight_--;
+    trySend(nowMs);
+  }
+}
+
+void LineSimulation::run() {
+  lines_.onLine = [this](const std::string &line, uint64_t timeMicros) { onLine(line, timeMicros / 1000.0); };
+  sim::setOutputHandler([this](uint8_t value, uint64_t timeMicros) { lines_.feed(value, timeMicros); });
+
+  setup();
+  sim::clearServoWrites();
+
+  sim::setWakeHandler([this](uint64_t nowMicros) { wake(nowMicros); });
+  firstArrivalMs_ = nowMs();
+  schedule(firstArrivalMs_, EVENT_ARRIVAL, 1);
+  schedule(firstArrivalMs_, EVENT_SAMPLE, 0);
+
+  // Give up on items still unfinished ten minutes after the last arrival
+  while (!finished() && (arrived_ < options_.items || nowMs() - lastArrivalMs_ < 600000.0)) {
+    loop();
+  }
+  sim::setWakeHandler(nullptr);
+}
+
+// ============================================================================
+// REPORT
+// ============================================================================
+
+double percentile(std::vector<double> values, double p) {
+  if (values.empty()) return 0.0;
+  std::sort(values.begin(), values.end());
+  size_t index = std::min(values.size() - 1, static_cast<size_t>(p * values.size()));
+  return values[index];
+}
+
+double mean(const std::vector<double> &values) {
+  double sum = 0.0;
+  for (double v : values) sum += v;
+  return values.empty() ? 0.0 : sum / values.size();
+}
+
+void LineSimulation::report() const {
+  std::vector<double> arrivalToGate;
+  std::vector<double> decisionToGate;
+  std::vector<double> actuationWait;
+  int missed = 0;
+  int dropped = 0;
+  int classCounts[4] = {0, 0, 0, 0};
+  double lastDoneMs = firstArrivalMs_;
+
+  for (int id = 1; id <= options_.items; id++) {
+    const Item &item = items_[id];
+    classCounts[item.safetyClass]++;
+    if (item.dropped || item.gateMs < 0) {
+      dropped += item.dropped;
+      missed++;
+      continue;
+    }
+    double latencyS = (item.gateMs - item.arrivalMs) / 1000.0;
+    arrivalToGate.push_back(latencyS);
+    decisionToGate.push_back((item.gateMs - item.mlDoneMs) / 1000.0);
+    actuationWait.push_back((item.startMs - item.mlDoneMs) / 1000.0);
+    if (latencyS > options_.deadlineS) missed++;
+    lastDoneMs = std::max(lastDoneMs, item.doneMs);
+  }
+
+  double spanMin = (lastDoneMs - firstArrivalMs_) / 60000.0;
+  double throughput = spanMin > 0 ? arrivalToGate.size() / spanMin : 0.0;
+
+  std::printf("Line simulation: %d items, Poisson arrivals at %.1f items/min, deadline %.1f s\n",
+              options_.items, options_.ratePerMin, options_.deadlineS);
+  std::printf("ML latency:      lognormal median %.2f s, p95 %.2f s (%s), %s\n",
+              std::exp(options_.mlLatency.mu), std::exp(options_.mlLatency.mu + 1.645 * options_.mlLatency.sigma),
+              options_.mlLatency.samples ? (std::to_string(options_.mlLatency.samples) + " log samples").c_str()
+                                         : "assumed",
+              options_.mlWorkers ? (std::to_string(options_.mlWorkers) + " workers").c_str() : "unbounded workers");
+  std::printf("Host mode:       %s\n", options_.queueMode ? "queue (pipelined commands)" : "lock (one command in flight)");
+  if (options_.prearm) std::printf("Prearm:          %d PREARM commands\n", prearms_);
+  std::printf("Class mix:      ");
+  for (int c = 0; c < 4; c++) std::printf(" %s %d%s", SAFETY_LEVELS[c], classCounts[c], c < 3 ? "," : "\n");
+  std::printf("\n");
+  std::printf("Throughput:        %.1f items/min (%.0f items/hour)\n", throughput, throughput * 60.0);
+  std::printf("Missed deadline:   %.1f %% (%d of %d, %d dropped)\n",
+              100.0 * missed / options_.items, missed, options_.items, dropped);
+  std::printf("Arrival to gate:   mean %.2f s, p50 %.2f s, p95 %.2f s, max %.2f s\n", mean(arrivalToGate),
+              percentile(arrivalToGate, 0.5), percentile(arrivalToGate, 0.95), percentile(arrivalToGate, 1.0));
+  std::printf("Decision to gate:  mean %.2f s, p95 %.2f s\n", mean(decisionToGate), percentile(decisionToGate, 0.95));
+  std::printf("Wait for gate:     mean %.2f s, p95 %.2f s\n", mean(actuationWait), percentile(actuationWait, 0.95));
+  std::printf("Gate utilization:  %.1f %%\n", spanMin > 0 ? 100.0 * busyMs_ / (spanMin * 60000.0) : 0.0);
+  std::printf("Items in system:   mean %.2f, max %d\n", itemsInSystem_.mean(), itemsInSystem_.max);
+  std::printf("Host backlog:      mean %.2f, max %d\n", hostBacklog_.mean(), hostBacklog_.max);
+  std::printf("Firmware queue:    mean %.2f, max %d (capacity %d)\n", firmwareQueue_.mean(), firmwareQueue_.max,
+              firmware_.commandQueueSize);
+}
+
+void printUsage() {
+  std::fprintf(stderr,
+               "Usage: line_sim [--items N] [--rate ITEMS_PER_MIN]\n"
+               "                [--belt-speed M_PER_S --item-spacing M [--travel-m M]]\n"
+               "                [--deadline-s S] [--ml-log FILE | --ml-lognormal MU,SIGMA]\n"
+               "                [--ml-workers N] [--mix SAFE,PREPROCESS,DO_NOT_SHRED,DISCARD]\n"
+               "                [--host-mode lock|queue] [--prearm] [--seed N] [--verbose]\n");
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  Options options;
+  std::string mlLog;
+  double beltSpeed = 0.0;
+  double itemSpacing = 0.0;
+  double travelM = 0.0;
+  bool deadlineGiven = false;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--items" && hasValue) {
+      options.items = std::atoi(argv[++i]);
+    } else if (arg == "--rate" && hasValue) {
+      options.ratePerMin = std::atof(argv[++i]);
+    } else if (arg == "--belt-speed" && hasValue) {
+      beltSpeed = std::atof(argv[++i]);
+    } else if (arg == "--item-spacing" && hasValue) {
+      itemSpacing = std::atof(argv[++i]);
+    } else if (arg == "--travel-m" && hasValue) {
+      travelM = std::atof(argv[++i]);
+    } else if (arg == "--deadline-s" && hasValue) {
+      options.deadlineS = std::atof(argv[++i]);
+      deadlineGiven = true;
+    } else if (arg == "--ml-log" && hasValue) {
+      mlLog = argv[++i];
+    } else if (arg == "--ml-lognormal" && hasValue) {
+      if (std::sscanf(argv[++i], "%lf,%lf", &options.mlLatency.mu, &options.mlLatency.sigma) != 2) {
+        printUsage();
+        return 2;
+      }
+    } else if (arg == "--ml-workers" && hasValue) {
+      options.mlWorkers = std::atoi(argv[++i]);
+    } else if (arg == "--mix" && hasValue) {
+      double *m = options.mix;
+      if (std::sscanf(argv[++i], "%lf,%lf,%lf,%lf", &m[0], &m[1], &m[2], &m[3]) != 4) {
+        printUsage();
+        return 2;
+      }
+    } else if (arg == "--host-mode" && hasValue) {
+      options.queueMode = std::string(argv[++i]) == "queue";
+    } else if (arg == "--prearm") {
+      options.prearm = true;
+    } else if (arg == "--seed" && hasValue) {
+      options.seed = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--verbose") {
+      options.verbose = true;
+    } else {
+      printUsage();
+      return arg == "--help" || arg == "-h" ? 0 : 2;
+    }
+  }
+
+  // Belt parameters set the arrival rate and, with a travel distance, the deadline
+  if (beltSpeed > 0 && itemSpacing > 0) {
+    options.ratePerMin = beltSpeed / itemSpacing * 60.0;
+    if (travelM > 0 && !deadlineGiven) options.deadlineS = travelM / beltSpeed;
+  }
+  if (options.items < 1 || options.items > 65535 || options.ratePerMin <= 0) {
+    std::fprintf(stderr, "line_sim: need 1-65535 items and a positive arrival rate\n");
+    return 2;
+  }
+
+  if (!mlLog.empty()) {
+    std::string error;
+    if (!fitLatencyFromLog(mlLog, options.mlLatency, error)) {
+      std::fprintf(stderr, "line_sim: %s\n", error.c_str());
+      return 2;
+    }
+  }
+
+  LineSimulation simulation(options);
+  simulation.run();
+  simulation.report();
+  return 0;
+}
@@ -0,0 +1,309 @@
+/*
+ * ============================================================================
+ * SERIAL SESSION REPLAY
+ * ============================================================================
+ * Replays a serial capture recorded by ArduinoController (set
+ * ARDUINO_CAPTURE_FILE) against the host build of arduino.cxx. Host commands
+ * are sent with their original inter-command timing; each command's response
+ * (from "Received command" through READY) is compared with what the real
+ * board answered, and the response times are compared too.
+ *
+ * --csv FILE writes this build's per-command response times, and
+ * --compare FILE lines them up against a CSV from another firmware build.
+ *
+ * Usage: replay_sim CAPTURE [--csv FILE] [--compare FILE] [--verbose]
+ * ============================================================================
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <Arduino.h>
+
+#include "sim_runtime.h"
+
+namespace {
+
+// Must match CAPTURE_* in finalanalyze.py
+const char CAPTURE_MAGIC[] = "CCCAP1\n";
+const uint8_t CAPTURE_TX = 0x01;
+const uint8_t CAPTURE_RX = 0x02;
+
+struct TimedLine {
+  double timeMs;
+  std::string text;
+};
+
+struct Exchange {
+  std::string command;
+  double sentMs = 0.0;
+  double readyMs = -1.0;
+  std::vector<std::string> lines;
+};
+
+// ============================================================================
+// CAPTURE FILE
+// ============================================================================
+
+bool readCapture(const std::string &path, std::vector<TimedLine> &commands, std::vector<TimedLine> &responses,
+                 std::string &error) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    error = "cannot open " + path;
+    return false;
+  }
+
+  char magic[sizeof(CAPTURE_MAGIC) - 1];
+  if (!file.read(magic, sizeof(magic)) || std::memcmp(magic, CAPTURE_MAGIC, sizeof(magic)) != 0) {
+    error = path + ": not a serial capture file";
+    return false;
+  }
+
+  double timeMs = 0.0;
+  std::string txLine;
+  sim::LineCollector rxLines;
+  rxLines.onLine = [&](const std::string &line, uint64_t timeMicros) {
+    if (!line.empty()) responses.push_back({timeMicros / 1000.0, line});
+  };
+
+  uint8_t header[7];
+  while (file.read(reinterpret_cast<char *>(header), sizeof(header))) {
+    uint8_t direction = header[0];
+    uint32_t deltaMicros = header[1] | (header[2] << 8) | (header[3] << 16) | (static_cast<uint32_t>(header[4]) << 24);
+    uint16_t length = header[5] | (header[6] << 8);
+    std::string data(length, '\0');
+    if (!file.read(&data[0], length)) {
+      error = path + ": truncated record";
+      return false;
+    }
+    timeMs += deltaMicros / 1000.0;
+
+    for (char c : data) {
+      if (direction == CAPTURE_RX) {
+        rxLines.feed(static_cast<uint8_t>(c), static_cast<uint64_t>(timeMs * 1000.0));
+      } else if (direction == CAPTURE_TX) {
+        if (c == '\n') {
+          commands.push_back({timeMs, txLine});
+          txLine.clear();
+        } else if (c != '\r') {
+          txLine += c;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+// ============================================================================
+// COMPARISON
+// ============================================================================
+
+// "READY", or "READY @<seq>" for a command the host tagged with a sequence id
+bool isReady(const std::string &line) {
+  return line == "READY" || line.rfind("READY @", 0) == 0;
+}
+
+// Drops or masks output that legitimately differs between runs
+bool normalize(const std::string &line, std::string &normalized) {
+  if (line.rfind("Free Memory:", 0) == 0) return false;
+  if (line.rfind("Uptime:", 0) == 0) {
+    normalized = "Uptime: *";
+  } else if (line.rfind("Line Clock:", 0) == 0) {
+    normalized = "Line Clock: *";
+  } else if (line.rfind("DONE ", 0) == 0) {
+    normalized = line.substr(0, line.find_last_of(' ')) + " *";  // Motion time varies
+  } else {
+    normalized = line;
+  }
+  return true;
+}
+
+// Splits responses into per-command exchanges: "Received command" through READY
+std::vector<Exchange> buildExchanges(const std::vector<TimedLine> &commands, const std::vector<TimedLine> &responses) {
+  std::vector<Exchange> exchanges;
+  for (const TimedLine &c : commands) {
+    Exchange e;
+    e.command = c.text;
+    e.sentMs = c.timeMs;
+    exchanges.push_back(e);
+  }
+
+  size_t next = 0;
+  bool collecting = false;
+  for (const TimedLine &r : responses) {
+    if (r.text.rfind("Received command: ", 0) == 0 && !collecting && next < exchanges.size()) {
+      collecting = true;
+    }
+    if (!collecting) continue;
+
+    std::string normalized;
+    if (normalize(r.text, normalized)) exchanges[next].lines.push_back(normalized);
+    if (isReady(r.text)) {
+      exchanges[next].readyMs = r.timeMs;
+      collecting = false;
+      next++;
+    }
+  }
+  return exchanges;
+}
+
+std::map<int, double> readBaseline(const std::string &path) {
+  std::map<int, double> baseline;
+  std::ifstream file(path);
+  std::string line;
+  std::getline(file, line);  // Header
+  while (std::getline(file, line)) {
+    int index;
+    double latency;
+    if (std::sscanf(line.c_str(), "%d,%*[^,],%lf", &index, &latency) == 2) baseline[index] = latency;
+  }
+  return baseline;
+}
+
+double responseMs(const Exchange &e) {
+  return e.readyMs >= 0 ? e.readyMs - e.sentMs : NAN;
+}
+
+void printUsage() {
+  std::fprintf(stderr, "Usage: replay_sim CAPTURE [--csv FILE] [--compare FILE] [--verbose]\n");
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  std::string capturePath;
+  std::string csvPath;
+  std::string comparePath;
+  bool verbose = false;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--csv" && i + 1 < argc) {
+      csvPath = argv[++i];
+    } else if (arg == "--compare" && i + 1 < argc) {
+      comparePath = argv[++i];
+    } else if (arg == "--verbose") {
+      verbose = true;
+    } else if (arg.rfind("--", 0) != 0 && capturePath.empty()) {
+      capturePath = arg;
+    } else {
+      printUsage();
+      return 2;
+    }
+  }
+  if (capturePath.empty()) {
+    printUsage();
+    return 2;
+  }
+
+  std::vector<TimedLine> commands;
+  std::vector<TimedLine> recordedResponses;
+  std::string error;
+  if (!readCapture(capturePath, commands, recordedResponses, error)) {
+    std::fprintf(stderr, "replay_sim: %s\n", error.c_str());
+    return 2;
+  }
+  if (commands.empty()) {
+    std::fprintf(stderr, "replay_sim: capture contains no host commands\n");
+    return 2;
+  }
+
+  // Replay the commands into the simulated firmware with the original spacing
+  std::vector<TimedLine> simulatedResponses;
+  sim::LineCollector lines;
+  int readyCount = 0;
+  lines.onLine = [&](const std::string &line, uint64_t timeMicros) {
+    if (verbose) std::printf("[%10.3f ms] %s\n", timeMicros / 1000.0, line.c_str());
+    if (line.empty()) return;
+    simulatedResponses.push_back({timeMicros / 1000.0, line});
+    if (isReady(line)) readyCount++;
+  };
+  sim::setOutputHandler([&](uint8_t value, uint64_t timeMicros) { lines.feed(value, timeMicros); });
+
+  setup();
+  simulatedResponses.clear();
+  readyCount = 0;
+
+  double offsetMs = sim::nowMicros() / 1000.0 - commands.front().timeMs;
+  std::vector<TimedLine> simulatedCommands;
+  for (const TimedLine &c : commands) {
+    simulatedCommands.push_back({c.timeMs + offsetMs, c.text});
+    sim::scheduleInput(c.text + "\n", static_cast<uint64_t>((c.timeMs + offsetMs) * 1000.0));
+  }
+
+  double giveUpMs = simulatedCommands.back().timeMs + 60000.0;
+  while (readyCount < static_cast<int>(commands.size()) && sim::nowMicros() / 1000.0 < giveUpMs) {
+    loop();
+  }
+
+  std::vector<Exchange> recorded = buildExchanges(commands, recordedResponses);
+  std::vector<Exchange> simulated = buildExchanges(simulatedCommands, simulatedResponses);
+  std::map<int, double> baseline;
+  if (!comparePath.empty()) baseline = readBaseline(comparePath);
+
+  // Report
+  int diverged = 0;
+  std::vector<double> deltas;
+  std::printf("%4s  %-18s %12s %12s %10s", "#", "command", "recorded_ms", "simulated_ms", "delta_ms");
+  if (!baseline.empty()) std::printf(" %12s %10s", "baseline_ms", "vs_base");
+  std::printf("  result\n");
+
+  for (size_t i = 0; i < recorded.size(); i++) {
+    const Exchange &r = recorded[i];
+    const Exchange &s = simulated[i];
+    double recordedMs = responseMs(r);
+    double simulatedMs = responseMs(s);
+    double delta = simulatedMs - recordedMs;
+    if (!std::isnan(delta)) deltas.push_back(delta);
+
+    std::string result = "ok";
+    size_t common = std::min(r.lines.size(), s.lines.size());
+    for (size_t k = 0; k < common && result == "ok"; k++) {
+      if (r.lines[k] != s.lines[k]) result = "DIVERGED: \"" + r.lines[k] + "\" vs \"" + s.lines[k] + "\"";
+    }
+    if (result == "ok" && r.lines.size() != s.lines.size()) {
+      result = "DIVERGED: " + std::to_string(r.lines.size()) + " vs " + std::to_string(s.lines.size()) + " lines";
+    }
+    diverged += result != "ok";
+
+    std::printf("%4zu  %-18s %12.1f %12.1f %10.1f", i + 1, r.command.c_str(), recordedMs, simulatedMs, delta);
+    if (!baseline.empty()) {
+      auto base = baseline.find(static_cast<int>(i + 1));
+      double baseMs = base != baseline.end() ? base->second : NAN;
+      std::printf(" %12.1f %10.1f", baseMs, simulatedMs - baseMs);
+    }
+    std::printf("  %s\n", result.c_str());
+  }
+
+  double meanDelta = 0.0;
+  double worstDelta = 0.0;
+  for (double d : deltas) {
+    meanDelta += d;
+    worstDelta = std::max(worstDelta, std::fabs(d));
+  }
+  if (!deltas.empty()) meanDelta /= deltas.size();
+  std::printf("\n%zu commands replayed, %d diverged, response time delta mean %.1f ms, worst %.1f ms\n",
+              recorded.size(), diverged, meanDelta, worstDelta);
+
+  if (!csvPath.empty()) {
+    FILE *file = std::fopen(csvPath.c_str(), "w");
+    if (!file) {
+      std::fprintf(stderr, "replay_sim: cannot write %s\n", csvPath.c_str());
+      return 2;
+    }
+    std::fprintf(file, "index,command,response_ms\n");
+    for (size_t i = 0; i < simulated.size(); i++) {
+      std::fprintf(file, "%zu,%s,%.3f\n", i + 1, simulated[i].command.c_str(), responseMs(simulated[i]));
+    }
+    std::fclose(file);
+  }
+
+  return diverged > 0 ? 1 : 0;
+}
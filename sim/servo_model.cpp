@@ -0,0 +1,249 @@
+#include "servo_model.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+namespace sim {
+
+namespace {
+
+const double RAD_TO_DEG = 180.0 / M_PI;
+
+std::string trimmed(const std::string &text) {
+  size_t first = text.find_first_not_of(" \t\r");
+  if (first == std::string::npos) return "";
+  size_t last = text.find_last_not_of(" \t\r");
+  return text.substr(first, last - first + 1);
+}
+
+bool setParam(ServoParams &p, const std::string &key, double value) {
+  if (key == "max_speed_dps") p.maxSpeedDps = value;
+  else if (key == "stall_torque_nm") p.stallTorqueNm = value;
+  else if (key == "kp_nm_per_deg") p.kpNmPerDeg = value;
+  else if (key == "kd_nm_per_dps") p.kdNmPerDps = value;
+  else if (key == "rotor_inertia") p.rotorInertia = value;
+  else if (key == "load_inertia") p.loadInertia = value;
+  else if (key == "deadband_deg") p.deadbandDeg = value;
+  else if (key == "settle_budget_ms") p.settleBudgetMs = value;
+  else return false;
+  return true;
+}
+
+bool setParam(AnalysisParams &p, const std::string &key, double value) {
+  if (key == "dt_seconds") p.dtSeconds = value;
+  else if (key == "sample_ms") p.sampleMs = value;
+  else if (key == "segment_gap_ms") p.segmentGapMs = value;
+  else if (key == "settle_tolerance_deg") p.settleToleranceDeg = value;
+  else if (key == "overshoot_tolerance_deg") p.overshootToleranceDeg = value;
+  else return false;
+  return true;
+}
+
+}  // namespace
+
+// ============================================================================
+// SERVO MODEL
+// ============================================================================
+
+ServoModel::ServoModel(const ServoParams &params, double initialAngle)
+    : params_(params), setpoint_(initialAngle), angle_(initialAngle) {}
+
+void ServoModel::step(double dt) {
+  double error = setpoint_ - angle_;
+  double torque;
+  if (std::fabs(error) <= params_.deadbandDeg) {
+    // Motor off inside the deadband: only back-EMF braking acts
+    torque = -params_.kdNmPerDps * velocity_;
+  } else {
+    torque = params_.kpNmPerDeg * error - params_.kdNmPerDps * velocity_;
+  }
+  torque = std::max(-params_.stallTorqueNm, std::min(params_.stallTorqueNm, torque));
+
+  double accelerationDps2 = torque / (params_.rotorInertia + params_.loadInertia) * RAD_TO_DEG;
+  velocity_ += accelerationDps2 * dt;
+  velocity_ = std::max(-params_.maxSpeedDps, std::min(params_.maxSpeedDps, velocity_));
+  angle_ += velocity_ * dt;
+}
+
+// ============================================================================
+// SIMULATION AND ANALYSIS
+// ============================================================================
+
+SimulationResult simulateServos(const std::vector<ServoWrite> &writes,
+                                const std::map<int, ServoParams> &params,
+                                const std::map<int, double> &settleBudgetMs,
+                                const AnalysisParams &analysis,
+                                double endMs) {
+  SimulationResult result;
+  const double dtMs = analysis.dtSeconds * 1000.0;
+
+  // Split the stream per pin
+  std::map<int, std::vector<ServoWrite>> byPin;
+  for (const ServoWrite &w : writes) {
+    if (w.pin >= 0) byPin[w.pin].push_back(w);
+  }
+
+  for (const auto &entry : byPin) {
+    int pin = entry.first;
+    const std::vector<ServoWrite> &pinWrites = entry.second;
+
+    ServoParams p;
+    auto found = params.find(pin);
+    if (found != params.end()) p = found->second;
+    double budget = p.settleBudgetMs;
+    if (budget < 0) {
+      auto defaultBudget = settleBudgetMs.find(pin);
+      budget = defaultBudget != settleBudgetMs.end() ? defaultBudget->second : 0.0;
+    }
+
+    // Group writes into moves: a move starts with a setpoint change and
+    // continues while each next write follows within segmentGapMs without
+    // reversing direction (so a ramp of small steps counts as one move)
+    std::vector<MoveSegment> moves;
+    int setpoint = pinWrites.front().angle;
+    double lastWriteMs = pinWrites.front().timeMicros / 1000.0;
+    bool grouping = false;
+    for (size_t i = 1; i < pinWrites.size(); i++) {
+      const ServoWrite &w = pinWrites[i];
+      double timeMs = w.timeMicros / 1000.0;
+      bool sameDirection = grouping &&
+                           (w.angle - setpoint) * (moves.back().targetDeg - moves.back().fromDeg) >= 0;
+      if (grouping && sameDirection && timeMs - lastWriteMs < analysis.segmentGapMs) {
+        moves.back().targetDeg = w.angle;
+        moves.back().finalWriteMs = timeMs;
+      } else if (w.angle != setpoint) {
+        MoveSegment m = {};
+        m.pin = pin;
+        m.startMs = timeMs;
+        m.fromDeg = setpoint;
+        m.targetDeg = w.angle;
+        m.finalWriteMs = timeMs;
+        moves.push_back(m);
+        grouping = true;
+      } else {
+        grouping = false;
+      }
+      lastWriteMs = timeMs;
+      setpoint = w.angle;
+    }
+
+    // Integrate the model over the whole stream at dt resolution
+    double startMs = pinWrites.front().timeMicros / 1000.0;
+    ServoModel model(p, pinWrites.front().angle);
+    std::vector<double> angles;
+    size_t nextWrite = 0;
+    double nextSampleMs = startMs;
+    for (size_t k = 0; startMs + k * dtMs <= endMs; k++) {
+      double t = startMs + k * dtMs;
+      while (nextWrite < pinWrites.size() && pinWrites[nextWrite].timeMicros / 1000.0 <= t) {
+        model.setSetpoint(pinWrites[nextWrite].angle);
+        nextWrite++;
+      }
+      angles.push_back(model.angle());
+      if (t >= nextSampleMs) {
+        result.trajectory.push_back({t, pin, model.setpoint(), model.angle()});
+        nextSampleMs += analysis.sampleMs;
+      }
+      model.step(analysis.dtSeconds);
+    }
+
+    // Measure each move over its window (until the next move on this pin starts)
+    for (size_t i = 0; i < moves.size(); i++) {
+      MoveSegment &m = moves[i];
+      double windowEndMs = (i + 1 < moves.size()) ? moves[i + 1].startMs : endMs;
+      size_t first = static_cast<size_t>((m.startMs - startMs) / dtMs);
+      size_t finalWrite = static_cast<size_t>((m.finalWriteMs - startMs) / dtMs);
+      size_t last = std::min(angles.size(), static_cast<size_t>((windowEndMs - startMs) / dtMs));
+      double direction = m.targetDeg >= m.fromDeg ? 1.0 : -1.0;
+
+      m.deadlineMs = m.finalWriteMs + budget;
+      m.settledMs = -1.0;
+      for (size_t k = first; k < last; k++) {
+        m.overshootDeg = std::max(m.overshootDeg, direction * (angles[k] - m.targetDeg));
+      }
+
+      // Settled = just after the last sample outside the band, if the window ends inside it
+      if (last > first && std::fabs(angles[last - 1] - m.targetDeg) <= analysis.settleToleranceDeg) {
+        size_t k = last - 1;
+        while (k > finalWrite && std::fabs(angles[k - 1] - m.targetDeg) <= analysis.settleToleranceDeg) {
+          k--;
+        }
+        m.settledMs = startMs + k * dtMs;
+      }
+
+      m.overshoot = m.overshootDeg > analysis.overshootToleranceDeg;
+      m.late = m.settledMs < 0 || m.settledMs > m.deadlineMs;
+      result.moves.push_back(m);
+    }
+  }
+
+  std::sort(result.moves.begin(), result.moves.end(),
+            [](const MoveSegment &a, const MoveSegment &b) { return a.startMs < b.startMs; });
+  return result;
+}
+
+// ============================================================================
+// CONFIG FILE
+// ============================================================================
+
+bool loadModelConfig(const std::string &path,
+                     std::map<int, ServoParams> &params,
+                     AnalysisParams &analysis,
+                     std::string &error) {
+  std::ifstream file(path);
+  if (!file) {
+    error = "cannot open " + path;
+    return false;
+  }
+
+  ServoParams *servo = nullptr;
+  bool inAnalysis = false;
+  std::string line;
+  int lineNumber = 0;
+
+  while (std::getline(file, line)) {
+    lineNumber++;
+    line = trimmed(line.substr(0, line.find('#')));
+    if (line.empty()) continue;
+
+    if (line.front() == '[') {
+      std::istringstream header(line.substr(1, line.find(']') - 1));
+      std::string section;
+      header >> section;
+      if (section == "servo") {
+        int pin;
+        if (!(header >> pin)) {
+          error = path + ":" + std::to_string(lineNumber) + ": expected [servo <pin>]";
+          return false;
+        }
+        servo = &params[pin];
+        inAnalysis = false;
+      } else if (section == "analysis") {
+        servo = nullptr;
+        inAnalysis = true;
+      } else {
+        error = path + ":" + std::to_string(lineNumber) + ": unknown section " + section;
+        return false;
+      }
+      continue;
+    }
+
+    size_t equals = line.find('=');
+    if (equals == std::string::npos || (!servo && !inAnalysis)) {
+      error = path + ":" + std::to_string(lineNumber) + ": expected key = value inside a section";
+      return false;
+    }
+    std::string key = trimmed(line.substr(0, equals));
+    double value = std::atof(trimmed(line.substr(equals + 1)).c_str());
+    bool known = servo ? setParam(*servo, key, value) : setParam(analysis, key, value);
+    if (!known) {
+      error = path + ":" + std::to_string(lineNumber) + ": unknown key " + key;
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace sim
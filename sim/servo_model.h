@@ -0,0 +1,103 @@
+/*
+ * ============================================================================
+ * SERVO DYNAMICS MODEL
+ * ============================================================================
+ * Second-order model of a hobby servo: the internal position loop produces
+ * torque = kp * error - kd * velocity, clamped to the stall torque, which
+ * accelerates the rotor plus the load hanging off the horn. Speed saturates
+ * at the no-load speed and the motor is off inside the deadband.
+ * ============================================================================
+ */
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "sim_runtime.h"
+
+namespace sim {
+
+struct ServoParams {
+  double maxSpeedDps = 430.0;       // No-load speed (MG996R: ~0.14 s / 60 deg)
+  double stallTorqueNm = 0.9;
+  double kpNmPerDeg = 0.0092;       // Position loop stiffness
+  double kdNmPerDps = 0.00023;      // Position loop damping
+  double rotorInertia = 2.0e-5;     // kg*m^2, reflected through the gearbox
+  double loadInertia = 3.2e-4;      // kg*m^2, gate flap or arm on this horn
+  double deadbandDeg = 1.0;
+  double settleBudgetMs = -1.0;     // Time allowed after the final setpoint; < 0 = firmware default
+};
+
+class ServoModel {
+public:
+  ServoModel(const ServoParams &params, double initialAngle);
+
+  void setSetpoint(double angle) { setpoint_ = angle; }
+  void step(double dtSeconds);
+
+  double angle() const { return angle_; }
+  double velocity() const { return velocity_; }
+  double setpoint() const { return setpoint_; }
+
+private:
+  ServoParams params_;
+  double setpoint_;
+  double angle_;
+  double velocity_ = 0.0;  // deg/s
+};
+
+// ============================================================================
+// MOVE ANALYSIS
+// ============================================================================
+
+struct AnalysisParams {
+  double dtSeconds = 0.0001;        // Integration step
+  double sampleMs = 1.0;            // Trajectory output resolution
+  double segmentGapMs = 50.0;       // Setpoint writes closer than this belong to one move
+  double settleToleranceDeg = 2.0;
+  double overshootToleranceDeg = 2.0;
+};
+
+struct TrajectorySample {
+  double timeMs;
+  int pin;
+  double setpoint;
+  double angle;
+};
+
+struct MoveSegment {
+  int pin;
+  double startMs;
+  double fromDeg;
+  double targetDeg;
+  double finalWriteMs;      // Last setpoint write of the move
+  double deadlineMs;        // finalWriteMs + settle budget
+  double settledMs;         // When the horn entered the tolerance band for good; < 0 = never
+  double overshootDeg;
+  bool overshoot;
+  bool late;
+};
+
+struct SimulationResult {
+  std::vector<TrajectorySample> trajectory;
+  std::vector<MoveSegment> moves;
+};
+
+// Drives one model per pin with the logged setpoint stream and measures each move.
+// settleBudgetMs gives the default budget per pin when ServoParams leaves it unset.
+SimulationResult simulateServos(const std::vector<ServoWrite> &writes,
+                                const std::map<int, ServoParams> &params,
+                                const std::map<int, double> &settleBudgetMs,
+                                const AnalysisParams &analysis,
+                                double endMs);
+
+// Reads "[servo <pin>]" and "[analysis]" sections of key = value lines.
+// Returns false with a message in error on a malformed file.
+bool loadModelConfig(const std::string &path,
+                     std::map<int, ServoParams> &params,
+                     AnalysisParams &analysis,
+                     std::string &error);
+
+}  // namespace sim
@@ -0,0 +1,147 @@
+/*
+ * ============================================================================
+ * SERVO DYNAMICS SIMULATOR
+ * ============================================================================
+ * Runs the host build of arduino.cxx, sends it sorting commands and feeds
+ * the resulting setpoint stream into a second-order servo model per gate.
+ * Reports the horn angle over time and flags moves that overshoot or are
+ * not settled by the time the firmware assumes they are (final setpoint
+ * write + MOVE_TIME for servo 1, + SERVO2_SETTLE_TIME for servo 2).
+ *
+ * Usage: servo_sim [--config FILE] [--csv FILE] [--idle-ms N] [--strict]
+ *                  [--verbose] [COMMAND ...]
+ * Commands default to LEFT RIGHT and are sent one at a time on READY.
+ * ============================================================================
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <Arduino.h>
+
+#include "servo_model.h"
+#include "sim_runtime.h"
+
+namespace {
+
+void printUsage() {
+  std::fprintf(stderr,
+               "Usage: servo_sim [--config FILE] [--csv FILE] [--idle-ms N] [--strict] [--verbose] [COMMAND ...]\n");
+}
+
+bool writeTrajectoryCsv(const std::string &path, const sim::SimulationResult &result) {
+  FILE *file = std::fopen(path.c_str(), "w");
+  if (!file) return false;
+  std::fprintf(file, "time_ms,pin,setpoint_deg,angle_deg\n");
+  for (const sim::TrajectorySample &s : result.trajectory) {
+    std::fprintf(file, "%.3f,%d,%.1f,%.3f\n", s.timeMs, s.pin, s.setpoint, s.angle);
+  }
+  std::fclose(file);
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  std::string configPath;
+  std::string csvPath;
+  double idleMs = 500.0;
+  bool strict = false;
+  bool verbose = false;
+  std::vector<std::string> commands;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--config" && i + 1 < argc) {
+      configPath = argv[++i];
+    } else if (arg == "--csv" && i + 1 < argc) {
+      csvPath = argv[++i];
+    } else if (arg == "--idle-ms" && i + 1 < argc) {
+      idleMs = std::atof(argv[++i]);
+    } else if (arg == "--strict") {
+      strict = true;
+    } else if (arg == "--verbose") {
+      verbose = true;
+    } else if (arg == "--help" || arg == "-h") {
+      printUsage();
+      return 0;
+    } else if (arg.rfind("--", 0) == 0) {
+      printUsage();
+      return 2;
+    } else {
+      commands.push_back(arg);
+    }
+  }
+  if (commands.empty()) commands = {"LEFT", "RIGHT"};
+
+  std::map<int, sim::ServoParams> params;
+  sim::AnalysisParams analysis;
+  if (!configPath.empty()) {
+    std::string error;
+    if (!sim::loadModelConfig(configPath, params, analysis, error)) {
+      std::fprintf(stderr, "servo_sim: %s\n", error.c_str());
+      return 2;
+    }
+  }
+
+  // Run the firmware, sending the next command each time it reports READY
+  bool ready = false;
+  sim::LineCollector lines;
+  lines.onLine = [&](const std::string &line, uint64_t timeMicros) {
+    if (verbose) std::printf("[%10.3f ms] %s\n", timeMicros / 1000.0, line.c_str());
+    if (line == "READY") ready = true;
+  };
+  sim::setOutputHandler([&](uint8_t value, uint64_t timeMicros) { lines.feed(value, timeMicros); });
+
+  setup();
+  size_t nextCommand = 0;
+  while (nextCommand < commands.size() || !ready) {
+    if (ready && nextCommand < commands.size()) {
+      ready = false;
+      sim::sendLine(commands[nextCommand++]);
+    }
+    loop();
+  }
+  sim::runUntil(sim::nowMicros() + static_cast<uint64_t>(idleMs * 1000.0));
+
+  // Feed the setpoint stream through the servo models
+  sim::FirmwareConfig firmware = sim::firmwareConfig();
+  std::map<int, double> budgets = {
+    {firmware.servo1Pin, static_cast<double>(firmware.moveTimeMs)},
+    {firmware.servo2Pin, static_cast<double>(firmware.servo2SettleTimeMs)},
+  };
+  sim::SimulationResult result =
+      sim::simulateServos(sim::servoWrites(), params, budgets, analysis, sim::nowMicros() / 1000.0);
+
+  if (!csvPath.empty() && !writeTrajectoryCsv(csvPath, result)) {
+    std::fprintf(stderr, "servo_sim: cannot write %s\n", csvPath.c_str());
+    return 2;
+  }
+
+  int late = 0;
+  int overshoot = 0;
+  std::printf("%10s %4s %12s %12s %12s %12s %10s  %s\n",
+              "start_ms", "pin", "from->to", "final_ms", "deadline_ms", "settled_ms", "overshoot", "flags");
+  for (const sim::MoveSegment &m : result.moves) {
+    char move[32];
+    std::snprintf(move, sizeof(move), "%.0f->%.0f", m.fromDeg, m.targetDeg);
+    char settled[32];
+    if (m.settledMs >= 0) {
+      std::snprintf(settled, sizeof(settled), "%.1f", m.settledMs);
+    } else {
+      std::snprintf(settled, sizeof(settled), "never");
+    }
+    std::printf("%10.1f %4d %12s %12.1f %12.1f %12s %9.2f°  %s%s\n",
+                m.startMs, m.pin, move, m.finalWriteMs, m.deadlineMs, settled, m.overshootDeg,
+                m.late ? "LATE " : "", m.overshoot ? "OVERSHOOT" : "");
+    late += m.late;
+    overshoot += m.overshoot;
+  }
+  std::printf("%zu moves, %d late, %d overshoot\n", result.moves.size(), late, overshoot);
+
+  return (strict && (late > 0 || overshoot > 0)) ? 1 : 0;
+}
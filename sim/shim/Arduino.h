@@ -0,0 +1,158 @@
+/*
+ * ============================================================================
+ * HOST STAND-IN FOR Arduino.h
+ * ============================================================================
+ * Just enough of the Arduino core to compile arduino.cxx on a PC.
+ * Time is virtual: it only moves when the firmware calls delay(), or by a
+ * small fixed cost on every millis()/micros() call so busy-wait loops finish.
+ * ============================================================================
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+typedef uint8_t byte;
+
+#define HIGH 0x1
+#define LOW 0x0
+#define OUTPUT 0x1
+#define INPUT 0x0
+#define INPUT_PULLUP 0x2
+#define LED_BUILTIN 13
+
+// Sketch entry points
+void setup();
+void loop();
+
+// Virtual clock (implemented in sim_runtime.cpp)
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+#define constrain(value, low, high) ((value) < (low) ? (low) : ((value) > (high) ? (high) : (value)))
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);  // HIGH unless set with sim::setDigitalInput()
+
+// External interrupts: the handler runs from sim::setDigitalInput() on a
+// matching edge. There is nothing to mask on the host.
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+inline int digitalPinToInterrupt(uint8_t pin) { return pin; }
+void attachInterrupt(uint8_t interrupt, void (*handler)(), int mode);
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+// Flash (PROGMEM) data is ordinary memory on the host
+#define PROGMEM
+inline void *memcpy_P(void *dest, const void *src, size_t length) { return std::memcpy(dest, src, length); }
+inline char *strcpy_P(char *dest, const char *src) { return std::strcpy(dest, src); }
+inline int strcmp_P(const char *a, const char *b) { return std::strcmp(a, b); }
+inline uint16_t pgm_read_word(const void *address) {
+  uint16_t value;
+  std::memcpy(&value, address, sizeof(value));
+  return value;
+}
+
+// ============================================================================
+// String
+// ============================================================================
+
+class String {
+public:
+  String(const char *text = "") : text_(text ? text : "") {}
+  String(const std::string &text) : text_(text) {}
+  explicit String(char c) : text_(1, c) {}
+  explicit String(int value) : text_(std::to_string(value)) {}
+  explicit String(unsigned int value) : text_(std::to_string(value)) {}
+  explicit String(long value) : text_(std::to_string(value)) {}
+  explicit String(unsigned long value) : text_(std::to_string(value)) {}
+  explicit String(double value, unsigned char decimals = 2);
+
+  unsigned int length() const { return text_.size(); }
+  void reserve(unsigned int size) { text_.reserve(size); }
+  const char *c_str() const { return text_.c_str(); }
+  char charAt(unsigned int index) const { return index < text_.size() ? text_[index] : 0; }
+
+  void trim();
+  void toUpperCase();
+  bool startsWith(const String &prefix) const { return text_.compare(0, prefix.text_.size(), prefix.text_) == 0; }
+  int indexOf(char c) const;
+  int indexOf(const String &text) const;
+  String substring(unsigned int from) const;
+  String substring(unsigned int from, unsigned int to) const;
+  long toInt() const { return std::strtol(text_.c_str(), nullptr, 10); }
+
+  String &operator+=(const String &other) { text_ += other.text_; return *this; }
+  String &operator+=(const char *other) { text_ += other; return *this; }
+  String &operator+=(char c) { text_ += c; return *this; }
+
+  bool operator==(const String &other) const { return text_ == other.text_; }
+  bool operator==(const char *other) const { return text_ == other; }
+  bool operator!=(const String &other) const { return text_ != other.text_; }
+  bool operator!=(const char *other) const { return text_ != other; }
+
+  const std::string &str() const { return text_; }
+
+private:
+  std::string text_;
+};
+
+inline String operator+(const String &a, const String &b) { return String(a.str() + b.str()); }
+inline String operator+(const String &a, const char *b) { return String(a.str() + b); }
+inline String operator+(const char *a, const String &b) { return String(a + b.str()); }
+
+// ============================================================================
+// Serial
+// ============================================================================
+
+// Base of everything printable (Serial, or a buffer in the benchmarks)
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t value) = 0;
+  virtual size_t write(const uint8_t *data, size_t length) {
+    for (size_t i = 0; i < length; i++) write(data[i]);
+    return length;
+  }
+
+  size_t print(const String &text) { return write(reinterpret_cast<const uint8_t *>(text.c_str()), text.length()); }
+  size_t print(const char *text) { return write(reinterpret_cast<const uint8_t *>(text), std::strlen(text)); }
+  size_t println(const String &text) { return print(text) + print("\r\n"); }
+  size_t println(const char *text = "") { return print(text) + print("\r\n"); }
+};
+
+// Serial is port 0, Serial1-Serial3 the Mega's other UARTs. The simulated
+// host link is the port the firmware runs its protocol on (PROTOCOL_UART)
+class HardwareSerial : public Print {
+public:
+  explicit HardwareSerial(int port) : port_(port) {}
+  void begin(unsigned long baud) { baud_ = baud; }
+  void end() {}
+  void setTimeout(unsigned long) {}
+  unsigned long baud() const { return baud_; }
+
+  int available();
+  int read();
+  int peek();
+
+  size_t write(uint8_t value) override;
+  size_t write(const uint8_t *data, size_t length) override;
+  void flush() {}
+
+private:
+  int port_;
+  unsigned long baud_ = 0;
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+extern HardwareSerial Serial2;
+extern HardwareSerial Serial3;
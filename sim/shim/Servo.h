@@ -0,0 +1,30 @@
+/*
+ * ============================================================================
+ * HOST STAND-IN FOR Servo.h
+ * ============================================================================
+ * Every write() or writeMicroseconds() is logged with its virtual timestamp so the simulator can
+ * replay the firmware's setpoint stream into a servo model.
+ * ============================================================================
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+#define INVALID_SERVO 255  // attach() result when no timer channel is free
+#define MIN_PULSE_WIDTH 544   // Pulse widths write() maps 0 and 180 degrees to
+#define MAX_PULSE_WIDTH 2400
+
+class Servo {
+public:
+  uint8_t attach(int pin) { pin_ = pin; return 0; }
+  void detach() { pin_ = -1; }
+  bool attached() const { return pin_ >= 0; }
+  void write(int angle);
+  void writeMicroseconds(int pulseUs);  // Logged as the angle that write() maps to this pulse
+  int read() const { return angle_; }
+
+private:
+  int pin_ = -1;
+  int angle_ = 0;
+};
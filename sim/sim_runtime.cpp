@@ -0,0 +1,318 @@
+#include "sim_runtime.h"
+
+#include <Arduino.h>
+#include <Servo.h>
+
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <random>
+
+HardwareSerial Serial(0);
+HardwareSerial Serial1(1);
+HardwareSerial Serial2(2);
+HardwareSerial Serial3(3);
+
+// Must match the firmware build (set for both by SIM_PROTOCOL_UART in CMakeLists.txt)
+#ifndef PROTOCOL_UART
+#define PROTOCOL_UART 0
+#endif
+
+namespace {
+
+struct ScheduledByte {
+  uint64_t atMicros;
+  uint8_t value;
+};
+
+uint64_t clockMicros = 0;
+uint32_t callCostMicros = 4;
+std::deque<ScheduledByte> inputQueue;
+std::function<void(uint8_t, uint64_t)> outputHandler;
+std::function<void(uint8_t, uint64_t)> debugOutputHandler;
+std::function<void(uint64_t)> wakeHandler;
+uint64_t wakeAtMicros = UINT64_MAX;
+std::vector<sim::ServoWrite> writes;
+std::map<int, int> inputLevels;
+std::map<int, std::pair<void (*)(), int>> interruptHandlers;
+std::function<void(int, int, uint64_t)> digitalOutputHandler;
+unsigned long hostBaud = 0;
+unsigned long linkMaxBaud = 0;
+
+sim::LinkFaults linkFaults;
+sim::LinkFaultCounts faultCounts;
+std::mt19937_64 faultRng;
+uint64_t nextStallMicros = UINT64_MAX;
+uint64_t stallUntilMicros = 0;
+std::deque<uint8_t> heldOutput;  // Firmware output written during a stall
+
+bool chance(double p) {
+  return p > 0 && std::uniform_real_distribution<double>(0.0, 1.0)(faultRng) < p;
+}
+
+// Drops or corrupts a byte on the link; false if it is lost
+bool applyByteFaults(uint8_t &value) {
+  if (chance(linkFaults.dropRate)) {
+    faultCounts.dropped++;
+    return false;
+  }
+  if (chance(linkFaults.corruptRate)) {
+    value ^= 1 << std::uniform_int_distribution<int>(0, 7)(faultRng);
+    faultCounts.corrupted++;
+  }
+  return true;
+}
+
+uint64_t drawNextStall(uint64_t fromMicros) {
+  if (linkFaults.stallsPerMin <= 0) return UINT64_MAX;
+  std::exponential_distribution<double> gap(linkFaults.stallsPerMin / 60e6);
+  return fromMicros + static_cast<uint64_t>(gap(faultRng));
+}
+
+void deliverOutput(uint8_t value) {
+  if (outputHandler) outputHandler(value, clockMicros);
+}
+
+void advanceClock(uint64_t us) {
+  clockMicros += us;
+  if (clockMicros >= nextStallMicros) {
+    stallUntilMicros = clockMicros + static_cast<uint64_t>(linkFaults.stallMs * 1000.0);
+    nextStallMicros = drawNextStall(stallUntilMicros);
+    faultCounts.stalls++;
+  }
+  if (!heldOutput.empty() && clockMicros >= stallUntilMicros) {
+    std::deque<uint8_t> burst;
+    burst.swap(heldOutput);
+    for (uint8_t value : burst) deliverOutput(value);
+  }
+  if (clockMicros >= wakeAtMicros) {
+    wakeAtMicros = UINT64_MAX;
+    if (wakeHandler) wakeHandler(clockMicros);
+  }
+}
+
+bool linkGarbled(unsigned long portBaud) {
+  return (hostBaud != 0 && portBaud != hostBaud) || (linkMaxBaud != 0 && portBaud > linkMaxBaud);
+}
+
+bool inputReady() {
+  return !inputQueue.empty() && inputQueue.front().atMicros <= clockMicros && clockMicros >= stallUntilMicros;
+}
+
+}  // namespace
+
+// ============================================================================
+// ARDUINO CORE STAND-INS
+// ============================================================================
+
+unsigned long micros() {
+  advanceClock(callCostMicros);
+  return static_cast<unsigned long>(static_cast<uint32_t>(clockMicros));
+}
+
+unsigned long millis() {
+  advanceClock(callCostMicros);
+  return static_cast<unsigned long>(static_cast<uint32_t>(clockMicros / 1000));
+}
+
+void delay(unsigned long ms) { advanceClock(static_cast<uint64_t>(ms) * 1000); }
+void delayMicroseconds(unsigned int us) { advanceClock(us); }
+void pinMode(uint8_t, uint8_t) {}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  if (digitalOutputHandler) digitalOutputHandler(pin, value, clockMicros);
+}
+
+int digitalRead(uint8_t pin) {
+  auto level = inputLevels.find(pin);
+  return level != inputLevels.end() ? level->second : HIGH;
+}
+
+void attachInterrupt(uint8_t interrupt, void (*handler)(), int mode) {
+  interruptHandlers[interrupt] = std::make_pair(handler, mode);  // digitalPinToInterrupt() is the pin
+}
+
+String::String(double value, unsigned char decimals) {
+  char buffer[40];
+  std::snprintf(buffer, sizeof(buffer), "%.*f", decimals, value);
+  text_ = buffer;
+}
+
+void String::trim() {
+  const char *whitespace = " \t\r\n";
+  size_t first = text_.find_first_not_of(whitespace);
+  if (first == std::string::npos) {
+    text_.clear();
+    return;
+  }
+  size_t last = text_.find_last_not_of(whitespace);
+  text_ = text_.substr(first, last - first + 1);
+}
+
+void String::toUpperCase() {
+  for (char &c : text_) {
+    if (c >= 'a' && c <= 'z') c = c - 'a' + 'A';
+  }
+}
+
+int String::indexOf(char c) const {
+  size_t position = text_.find(c);
+  return position == std::string::npos ? -1 : static_cast<int>(position);
+}
+
+int String::indexOf(const String &text) const {
+  size_t position = text_.find(text.text_);
+  return position == std::string::npos ? -1 : static_cast<int>(position);
+}
+
+String String::substring(unsigned int from) const {
+  return from >= text_.size() ? String("") : String(text_.substr(from));
+}
+
+String String::substring(unsigned int from, unsigned int to) const {
+  if (from > to) std::swap(from, to);
+  return from >= text_.size() ? String("") : String(text_.substr(from, to - from));
+}
+
+int HardwareSerial::available() {
+  if (port_ != PROTOCOL_UART || clockMicros < stallUntilMicros) return 0;
+  int count = 0;
+  for (const ScheduledByte &b : inputQueue) {
+    if (b.atMicros > clockMicros) break;
+    count++;
+  }
+  return count;
+}
+
+int HardwareSerial::read() {
+  if (port_ != PROTOCOL_UART || !inputReady()) return -1;
+  uint8_t value = inputQueue.front().value;
+  inputQueue.pop_front();
+  return linkGarbled(baud_) ? 0xFF : value;
+}
+
+int HardwareSerial::peek() {
+  if (port_ != PROTOCOL_UART || !inputReady()) return -1;
+  return linkGarbled(baud_) ? 0xFF : inputQueue.front().value;
+}
+
+size_t HardwareSerial::write(uint8_t value) {
+  if (port_ == PROTOCOL_UART) {
+    value = linkGarbled(baud_) ? 0xFF : value;
+    if (!applyByteFaults(value)) return 1;
+    if (clockMicros < stallUntilMicros || !heldOutput.empty()) {
+      heldOutput.push_back(value);
+    } else {
+      deliverOutput(value);
+    }
+  } else if (debugOutputHandler) {
+    debugOutputHandler(value, clockMicros);
+  }
+  return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t *data, size_t length) {
+  for (size_t i = 0; i < length; i++) write(data[i]);
+  return length;
+}
+
+void Servo::write(int angle) {
+  if (angle < 0) angle = 0;
+  if (angle > 180) angle = 180;
+  angle_ = angle;
+  writes.push_back({clockMicros, pin_, angle});
+}
+
+// Inverse of write()'s degrees-to-pulse map(), rounding up where it truncated
+void Servo::writeMicroseconds(int pulseUs) {
+  const long range = MAX_PULSE_WIDTH - MIN_PULSE_WIDTH;
+  write(static_cast<int>(((pulseUs - MIN_PULSE_WIDTH) * 180L + range - 1) / range));
+}
+
+// ============================================================================
+// SIMULATION API
+// ============================================================================
+
+namespace sim {
+
+uint64_t nowMicros() { return clockMicros; }
+void advanceMicros(uint64_t us) { advanceClock(us); }
+void setCallCostMicros(uint32_t us) { callCostMicros = us; }
+
+void setWakeHandler(std::function<void(uint64_t)> handler) { wakeHandler = std::move(handler); }
+
+void scheduleWake(uint64_t atMicros) {
+  if (atMicros < wakeAtMicros) wakeAtMicros = atMicros;
+}
+
+void scheduleInput(const std::string &bytes, uint64_t atMicros) {
+  // Keep the queue ordered by release time; a later schedule never jumps ahead
+  if (!inputQueue.empty() && atMicros < inputQueue.back().atMicros) {
+    atMicros = inputQueue.back().atMicros;
+  }
+  for (char c : bytes) {
+    uint8_t value = static_cast<uint8_t>(c);
+    if (applyByteFaults(value)) inputQueue.push_back({atMicros, value});
+  }
+}
+
+void sendLine(const std::string &line) { scheduleInput(line + "\n", clockMicros); }
+size_t pendingInput() { return inputQueue.size(); }
+
+void setOutputHandler(std::function<void(uint8_t, uint64_t)> handler) {
+  outputHandler = std::move(handler);
+}
+
+void setLinkFaults(const LinkFaults &faults) {
+  linkFaults = faults;
+  faultCounts = LinkFaultCounts();
+  faultRng.seed(faults.seed);
+  nextStallMicros = drawNextStall(clockMicros);
+}
+
+LinkFaultCounts linkFaultCounts() { return faultCounts; }
+
+void setHostBaud(unsigned long baud) { hostBaud = baud; }
+void setLinkMaxBaud(unsigned long baud) { linkMaxBaud = baud; }
+
+void setDebugOutputHandler(std::function<void(uint8_t, uint64_t)> handler) {
+  debugOutputHandler = std::move(handler);
+}
+
+void LineCollector::feed(uint8_t value, uint64_t timeMicros) {
+  // Binary frames run from 0xA5 to the next 0x00 (see FRAME_START in arduino.cxx)
+  if (inFrame_) {
+    if (value == 0x00) inFrame_ = false;
+    return;
+  }
+  if (value == 0xA5) {
+    inFrame_ = true;
+  } else if (value == '\n') {
+    if (onLine) onLine(line_, timeMicros);
+    line_.clear();
+  } else if (value != '\r') {
+    line_ += static_cast<char>(value);
+  }
+}
+
+void setDigitalInput(int pin, int level) {
+  int previous = digitalRead(pin);
+  inputLevels[pin] = level;
+  auto attached = interruptHandlers.find(pin);
+  if (attached == interruptHandlers.end() || previous == level) return;
+  int mode = attached->second.second;
+  if (mode == CHANGE || (mode == RISING) == (level == HIGH)) attached->second.first();
+}
+
+void setDigitalOutputHandler(std::function<void(int, int, uint64_t)> handler) {
+  digitalOutputHandler = std::move(handler);
+}
+
+const std::vector<ServoWrite> &servoWrites() { return writes; }
+void clearServoWrites() { writes.clear(); }
+
+void runUntil(uint64_t timeMicros) {
+  while (clockMicros < timeMicros) loop();
+}
+
+}  // namespace sim
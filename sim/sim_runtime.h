@@ -0,0 +1,146 @@
+/*
+ * ============================================================================
+ * HOST SIMULATION RUNTIME
+ * ============================================================================
+ * Virtual clock, scripted serial input and logged servo setpoints for the
+ * host build of arduino.cxx. One firmware instance per process.
+ * ============================================================================
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace sim {
+
+// ============================================================================
+// VIRTUAL CLOCK
+// ============================================================================
+
+uint64_t nowMicros();
+void advanceMicros(uint64_t us);
+
+// Virtual time charged for every millis()/micros() call (default 4 us).
+// Stands in for the CPU time of the code between calls so polling loops end.
+void setCallCostMicros(uint32_t us);
+
+// Call handler(now) once the clock reaches atMicros, even in the middle of a
+// firmware delay or movement. The handler may schedule input and call
+// scheduleWake() again but must not call into the firmware.
+void setWakeHandler(std::function<void(uint64_t)> handler);
+void scheduleWake(uint64_t atMicros);
+
+// ============================================================================
+// SERIAL
+// ============================================================================
+
+// Queue bytes that become readable by the firmware at the given virtual time
+void scheduleInput(const std::string &bytes, uint64_t atMicros);
+void sendLine(const std::string &line);  // Readable immediately, '\n' appended
+size_t pendingInput();                   // Bytes queued but not yet read
+
+// Called for every byte the firmware writes, with the virtual time of the write
+void setOutputHandler(std::function<void(uint8_t, uint64_t)> handler);
+
+// Link rate model for baud negotiation: the host end runs at hostBaud and the
+// cable carries at most maxBaud. Bytes arrive garbled (as 0xFF) in both
+// directions unless the firmware's protocol port runs at hostBaud and that is
+// within maxBaud. 0 = follow the firmware / no limit (the default).
+void setHostBaud(unsigned long baud);
+void setLinkMaxBaud(unsigned long baud);
+
+// Same for USB Serial when the protocol runs on a UART (PROTOCOL_UART != 0);
+// otherwise debug output is part of the host link. Dropped if unset.
+void setDebugOutputHandler(std::function<void(uint8_t, uint64_t)> handler);
+
+// Splits firmware output into text lines (binary frames are skipped).
+// Handy as an output handler: lines.feed(byte, time)
+class LineCollector {
+public:
+  void feed(uint8_t value, uint64_t timeMicros);
+  std::function<void(const std::string &, uint64_t)> onLine;
+
+private:
+  std::string line_;
+  bool inFrame_ = false;
+};
+
+// ============================================================================
+// LINK FAULTS
+// ============================================================================
+
+// Faults on the host link (the protocol port), in both directions. A stall
+// holds every byte on the link for stallMs, like a USB hiccup: host input
+// waits and firmware output comes out in one burst when it ends. Off by
+// default; setLinkFaults() restarts the counts.
+struct LinkFaults {
+  double dropRate = 0.0;       // Chance a byte is lost
+  double corruptRate = 0.0;    // Chance a byte arrives with one bit flipped
+  double stallsPerMin = 0.0;   // Poisson rate of stalls
+  double stallMs = 0.0;
+  unsigned long seed = 1;
+};
+
+struct LinkFaultCounts {
+  unsigned long dropped = 0;
+  unsigned long corrupted = 0;
+  unsigned long stalls = 0;
+};
+
+void setLinkFaults(const LinkFaults &faults);
+LinkFaultCounts linkFaultCounts();
+
+// ============================================================================
+// DIGITAL INPUTS
+// ============================================================================
+
+// Level digitalRead() returns for a pin from now on (pins start HIGH, as
+// with INPUT_PULLUP and nothing connected). Runs an interrupt handler the
+// firmware attached to the pin if this is a matching edge.
+void setDigitalInput(int pin, int level);
+
+// Called for every digitalWrite(), with the virtual time of the write
+void setDigitalOutputHandler(std::function<void(int, int, uint64_t)> handler);
+
+// ============================================================================
+// SERVO SETPOINTS
+// ============================================================================
+
+struct ServoWrite {
+  uint64_t timeMicros;
+  int pin;
+  int angle;
+};
+
+const std::vector<ServoWrite> &servoWrites();
+void clearServoWrites();
+
+// ============================================================================
+// FIRMWARE CONSTANTS (exported by firmware.cpp)
+// ============================================================================
+
+struct FirmwareConfig {
+  int servo1Pin;
+  int servo2Pin;
+  int leftPosition;
+  int rightPosition;
+  int centerPosition;
+  int moveTimeMs;
+  int holdTimeMs;
+  int stepDelayMs;
+  int servo2SettleTimeMs;
+  int commandQueueSize;
+};
+
+FirmwareConfig firmwareConfig();
+int firmwareQueueDepth();  // Commands waiting in the firmware queue right now
+int firmwareTrajectorySteps(int fromPos, int toPos);  // Setpoints moveServoSmoothly() steps through
+
+// Run loop() until the virtual clock reaches the given time.
+// A single loop() call may overshoot it while a movement is in progress.
+void runUntil(uint64_t timeMicros);
+
+}  // namespace sim
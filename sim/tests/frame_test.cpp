@@ -0,0 +1,129 @@
+/*
+ * ============================================================================
+ * BINARY FRAME TESTS
+ * ============================================================================
+ * Round trips through the firmware's encodeFrame and the decoder in
+ * frame_decode.h: every payload length, payloads full of zeros (the bytes
+ * COBS removes) and corrupted frames, which must be rejected. Registered
+ * with ctest; exits non-zero if a check fails.
+ *
+ * Usage: frame_test
+ * ============================================================================
+ */
+
+// Compiled into this binary (rather than linked from firmware_host) so the
+// tests can call the firmware's frame encoder directly
+#include "../../arduino.cxx"
+
+#include <cstdio>
+#include <cstring>
+
+#include "frame_decode.h"
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(condition)                                                  \
+  do {                                                                    \
+    if (!(condition)) {                                                   \
+      std::printf("FAILED %s:%d: %s\n", __FILE__, __LINE__, #condition);  \
+      failures++;                                                         \
+    }                                                                     \
+  } while (0)
+
+// Encodes payload, checks the frame's shape and decodes it again; returns
+// the decoded length (-1 if decodeFrame rejected it)
+int roundTrip(byte type, const byte *payload, int length, byte &decodedType, byte *decoded) {
+  byte frame[FRAME_MAX_ENCODED];
+  int n = encodeFrame(type, payload, length, frame);
+  CHECK(n > 0 && n <= FRAME_MAX_ENCODED);
+  CHECK(frame[0] == FRAME_START);
+  CHECK(frame[n - 1] == 0x00);
+  CHECK(std::memchr(frame + 1, 0, n - 2) == nullptr);  // The delimiter is the only zero
+  return decodeFrame(frame + 1, n - 2, decodedType, decoded);
+}
+
+// ============================================================================
+// ROUND TRIPS
+// ============================================================================
+
+void testEveryPayloadLengthRoundTrips() {
+  byte payload[FRAME_MAX_PAYLOAD];
+  byte decoded[FRAME_MAX_PAYLOAD];
+  for (int length = 0; length <= FRAME_MAX_PAYLOAD; length++) {
+    for (int i = 0; i < length; i++) payload[i] = (byte)(i * 37 + length);
+    byte type = 0;
+    CHECK(roundTrip(FRAME_TYPE_TELEMETRY, payload, length, type, decoded) == length);
+    CHECK(type == FRAME_TYPE_TELEMETRY);
+    CHECK(std::memcmp(payload, decoded, length) == 0);
+  }
+}
+
+void testZeroBytesRoundTrip() {
+  byte payload[FRAME_MAX_PAYLOAD];
+  byte decoded[FRAME_MAX_PAYLOAD];
+  std::memset(payload, 0, sizeof(payload));
+  byte type = 0xFF;
+  CHECK(roundTrip(0x00, payload, FRAME_MAX_PAYLOAD, type, decoded) == FRAME_MAX_PAYLOAD);
+  CHECK(type == 0x00);
+  CHECK(std::memcmp(payload, decoded, FRAME_MAX_PAYLOAD) == 0);
+
+  const byte edges[] = {0x00, 0x01, 0x00, 0x00, 0xFF};
+  CHECK(roundTrip(0x10, edges, sizeof(edges), type, decoded) == (int)sizeof(edges));
+  CHECK(std::memcmp(edges, decoded, sizeof(edges)) == 0);
+}
+
+void testOverlongPayloadIsNotEncoded() {
+  byte payload[FRAME_MAX_PAYLOAD + 1] = {0};
+  byte frame[FRAME_MAX_ENCODED + 1];
+  CHECK(encodeFrame(FRAME_TYPE_TELEMETRY, payload, FRAME_MAX_PAYLOAD + 1, frame) == 0);
+}
+
+// ============================================================================
+// CORRUPTION
+// ============================================================================
+
+// Any single flipped bit between the delimiters fails the COBS structure or
+// the CRC
+void testFlippedBitIsRejected() {
+  byte payload[35];
+  for (int i = 0; i < (int)sizeof(payload); i++) payload[i] = (byte)(i * 11);
+  byte frame[FRAME_MAX_ENCODED];
+  int n = encodeFrame(FRAME_TYPE_TELEMETRY, payload, sizeof(payload), frame);
+  byte decoded[FRAME_MAX_PAYLOAD];
+  for (int at = 1; at < n - 1; at++) {
+    for (int bit = 0; bit < 8; bit++) {
+      byte corrupted[FRAME_MAX_ENCODED];
+      std::memcpy(corrupted, frame, n);
+      corrupted[at] ^= (byte)(1 << bit);
+      byte type;
+      int length = decodeFrame(corrupted + 1, n - 2, type, decoded);
+      CHECK(length < 0);
+    }
+  }
+}
+
+void testTruncatedFrameIsRejected() {
+  byte payload[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+  byte frame[FRAME_MAX_ENCODED];
+  int n = encodeFrame(FRAME_TYPE_TELEMETRY, payload, sizeof(payload), frame);
+  byte decoded[FRAME_MAX_PAYLOAD];
+  byte type;
+  for (int length = 0; length < n - 2; length++) {
+    CHECK(decodeFrame(frame + 1, length, type, decoded) < 0);
+  }
+}
+
+}  // namespace
+
+int main() {
+  testEveryPayloadLengthRoundTrips();
+  testZeroBytesRoundTrip();
+  testOverlongPayloadIsNotEncoded();
+  testFlippedBitIsRejected();
+  testTruncatedFrameIsRejected();
+
+  std::printf("%s\n", failures == 0 ? "frame_test: all checks passed" : "frame_test: FAILED");
+  return failures == 0 ? 0 : 1;
+}
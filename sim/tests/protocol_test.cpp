@@ -0,0 +1,345 @@
+/*
+ * ============================================================================
+ * FIRMWARE PROTOCOL TESTS
+ * ============================================================================
+ * Line-level checks of arduino.cxx's serial protocol on the host build: what
+ * the firmware answers to a given command line. Registered with ctest; exits
+ * non-zero if a check fails.
+ *
+ * Usage: protocol_test
+ * ============================================================================
+ */
+
+// Compiled into this binary (rather than linked from firmware_host) so the
+// tests can use the firmware's own limits and helpers
+#include "../../arduino.cxx"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "sim_runtime.h"
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(condition)                                                  \
+  do {                                                                    \
+    if (!(condition)) {                                                   \
+      std::printf("FAILED %s:%d: %s\n", __FILE__, __LINE__, #condition);  \
+      failures++;                                                         \
+    }                                                                     \
+  } while (0)
+
+std::vector<std::string> output;
+
+void runFor(unsigned long ms) {
+  uint64_t until = sim::nowMicros() + ms * 1000ULL;
+  while (sim::nowMicros() < until) loop();
+}
+
+// Sends one line and returns what the firmware printed in the next 200 ms
+std::vector<std::string> exchange(const std::string &line) {
+  output.clear();
+  sim::sendLine(line);
+  runFor(200);
+  return output;
+}
+
+bool contains(const std::vector<std::string> &lines, const std::string &text) {
+  for (const std::string &line : lines) {
+    if (line == text) return true;
+  }
+  return false;
+}
+
+bool anyStartsWith(const std::vector<std::string> &lines, const std::string &prefix) {
+  for (const std::string &line : lines) {
+    if (line.rfind(prefix, 0) == 0) return true;
+  }
+  return false;
+}
+
+// Index of the first line starting with prefix, -1 if none
+int indexOf(const std::vector<std::string> &lines, const std::string &prefix) {
+  for (size_t i = 0; i < lines.size(); i++) {
+    if (lines[i].rfind(prefix, 0) == 0) return (int)i;
+  }
+  return -1;
+}
+
+// Starts a LEFT and has the given lines arrive 100 ms apart while it runs,
+// so they queue behind it; returns everything printed in the next 10 s
+std::vector<std::string> queueBehindSort(const std::vector<std::string> &lines) {
+  output.clear();
+  sim::sendLine("LEFT");
+  uint64_t at = sim::nowMicros();
+  for (const std::string &line : lines) {
+    at += 100000;
+    sim::scheduleInput(line + "\n", at);
+  }
+  runFor(10000);
+  return output;
+}
+
+// "ECHO <hex> <crc>" for a payload of the given length, as the host builds it
+std::string echoLine(int length) {
+  byte payload[ECHO_MAX_BYTES + 1];
+  std::string hex;
+  char digits[3];
+  for (int i = 0; i < length; i++) {
+    payload[i] = (byte)(0xA5 ^ (i * 37));
+    std::snprintf(digits, sizeof(digits), "%02X", payload[i]);
+    hex += digits;
+  }
+  char crc[5];
+  std::snprintf(crc, sizeof(crc), "%04X", crc16(payload, length));
+  return "ECHO " + hex + " " + crc;
+}
+
+std::string crcOf(const std::string &echo) {
+  return echo.substr(echo.size() - 4);
+}
+
+// ============================================================================
+// LINE LENGTH
+// ============================================================================
+
+void testLongestEchoFitsWithFiveDigitSequence() {
+  std::string echo = echoLine(ECHO_MAX_BYTES);
+  std::string wire = echo + " @65535";
+  CHECK((int)wire.size() <= MAX_COMMAND_LENGTH);
+  std::vector<std::string> lines = exchange(wire);
+  CHECK(contains(lines, "OK ECHO " + crcOf(echo)));
+  CHECK(contains(lines, "READY @65535"));
+}
+
+void testOverlongLineIsRejected() {
+  std::string echo = echoLine(ECHO_MAX_BYTES);
+  std::string wire = echo + " @1";
+  wire.append(MAX_COMMAND_LENGTH + 1 - wire.size(), '2');  // One character over
+  std::vector<std::string> lines = exchange(wire);
+  CHECK(contains(lines, "ERROR: Command too long - " + wire.substr(0, MAX_COMMAND_LENGTH)));
+  CHECK(!anyStartsWith(lines, "OK ECHO"));
+  CHECK(!anyStartsWith(lines, "READY"));
+
+  // The next line starts clean
+  lines = exchange(echo + " @12");
+  CHECK(contains(lines, "OK ECHO " + crcOf(echo)));
+  CHECK(contains(lines, "READY @12"));
+}
+
+// ============================================================================
+// COMMAND QUEUE
+// ============================================================================
+
+void testStopJumpsAQueuedSort() {
+  std::vector<std::string> lines = queueBehindSort({"RIGHT", "STOP"});
+  CHECK(contains(lines, "ERROR: Cancelled by STOP - RIGHT"));
+  CHECK(contains(lines, "OK STOPPED CANCELLED 1"));
+  CHECK(!contains(lines, "RIGHT movement completed"));
+  CHECK(contains(exchange("RESUME"), "OK RESUMED"));
+}
+
+void testDiagnosticsWaitForQueuedSorts() {
+  std::vector<std::string> lines = queueBehindSort({"STATUS", "RIGHT"});
+  int sorted = indexOf(lines, "RIGHT movement completed");
+  int status = indexOf(lines, "=== ARDUINO SYSTEM STATUS ===");
+  CHECK(sorted >= 0 && status >= 0);
+  CHECK(sorted < status);
+}
+
+void testFullDiagnosticQueueDoesNotBlockASort() {
+  std::vector<std::string> diagnostics(DIAGNOSTIC_QUEUE_SIZE + 1, "STATUS");
+  diagnostics.push_back("RIGHT");
+  std::vector<std::string> lines = queueBehindSort(diagnostics);
+  CHECK(contains(lines, "ERROR: Command queue full - STATUS"));
+  CHECK(!anyStartsWith(lines, "ERROR: Command queue full - RIGHT"));
+  CHECK(contains(lines, "RIGHT movement completed"));
+}
+
+// STOP empties the sort class only: a queued diagnostic (here an ECHO, as
+// in a rate switch) still gets its answer
+void testStopCancelsOnlyTheSortClass() {
+  std::string echo = echoLine(4);
+  std::vector<std::string> lines = queueBehindSort({echo, "RIGHT", "STOP"});
+  CHECK(contains(lines, "OK STOPPED CANCELLED 1"));
+  CHECK(contains(lines, "OK ECHO " + crcOf(echo)));
+  CHECK(contains(exchange("RESUME"), "OK RESUMED"));
+}
+
+// ============================================================================
+// RESENT COMMANDS
+// ============================================================================
+
+// A host that missed the reply resends with the same @seq: it gets the first
+// run's result again, and the gate doesn't move a second time
+void testResentSortIsReplayed() {
+  std::vector<std::string> lines = exchange("LEFT #7 @40");
+  CHECK(contains(lines, "Executing sorting movement: LEFT"));
+  CHECK(anyStartsWith(lines, "DONE 7 LEFT "));
+  unsigned long moves = totalMoves;
+
+  lines = exchange("LEFT #7 @40");
+  CHECK(contains(lines, "DUPLICATE @40"));
+  CHECK(anyStartsWith(lines, "DONE 7 LEFT "));
+  CHECK(contains(lines, "READY @40"));
+  CHECK(!contains(lines, "Executing sorting movement: LEFT"));
+  CHECK(totalMoves == moves);
+}
+
+// HELLO starts a new host session whose sequence ids start over
+void testHelloClearsRecentResults() {
+  exchange("RIGHT @41");
+  exchange("HELLO");
+  std::vector<std::string> lines = exchange("RIGHT @41");
+  CHECK(!contains(lines, "DUPLICATE @41"));
+  CHECK(contains(lines, "Executing sorting movement: RIGHT"));
+}
+
+// ============================================================================
+// BAUD NEGOTIATION
+// ============================================================================
+
+// The CONFIRM reply is lost on its way to the host: the host finds the
+// firmware still answering HELLO at the new rate and confirms again, and
+// the rate stays past BAUD_VERIFY_TIMEOUT
+void testLostConfirmReplyCanBeConfirmedAgain() {
+  const std::string startRate = std::to_string(protocolBaud);
+  CHECK(contains(exchange("BAUD 500000"), "OK BAUD 500000"));
+  sim::setHostBaud(500000);
+  std::string echo = echoLine(8);
+  CHECK(contains(exchange(echo), "OK ECHO " + crcOf(echo)));
+  exchange("BAUD CONFIRM");  // Reply dropped
+
+  CHECK(anyStartsWith(exchange("HELLO"), "HELLO LANE"));
+  CHECK(contains(exchange("BAUD CONFIRM"), "OK BAUD 500000 CONFIRMED"));
+  runFor(BAUD_VERIFY_TIMEOUT + 500);
+  CHECK(protocolBaud == 500000);
+  CHECK(contains(exchange("BAUD CONFIRM"), "OK BAUD 500000 CONFIRMED"));
+
+  // Back to the starting rate for the tests that follow
+  CHECK(contains(exchange("BAUD " + startRate), "OK BAUD " + startRate));
+  sim::setHostBaud(std::stoul(startRate));
+  CHECK(contains(exchange("BAUD CONFIRM"), "OK BAUD " + startRate + " CONFIRMED"));
+  sim::setHostBaud(0);
+}
+
+// ============================================================================
+// HEALTH CHECK
+// ============================================================================
+
+// Fresh check: HEALTH NOW, then the idle gap it waits for, then the report
+std::vector<std::string> freshHealth() {
+  exchange("HEALTH NOW");
+  runFor(HEALTH_IDLE_TIME + 1000);
+  return exchange("HEALTH");
+}
+
+void testHealthFlagsAClearSensorThatNeverSeesAnItem() {
+  if (!Machine::HAS_CLEAR_SENSOR) return;
+  CHECK(anyStartsWith(freshHealth(), "HEALTH STATE OK FAULTS NONE"));
+
+  for (int i = 0; i < HEALTH_SILENT_SORTS; i++) {
+    exchange("LEFT");
+    runFor(5000);
+  }
+  std::vector<std::string> lines = freshHealth();
+  CHECK(anyStartsWith(lines, "HEALTH STATE DEGRADED FAULTS BEAM_SILENT"));
+
+  // One sort with an item through the beam clears it. The sort runs inside
+  // a single loop(), so the beam is broken from the wake handler.
+  uint64_t itemAt = sim::nowMicros() + 1000000;
+  sim::setWakeHandler([itemAt](uint64_t now) {
+    sim::setDigitalInput(CLEAR_SENSOR_PIN, now < itemAt + 100000 ? LOW : HIGH);
+    if (now < itemAt + 100000) sim::scheduleWake(itemAt + 100000);
+  });
+  sim::scheduleWake(itemAt);
+  exchange("LEFT");
+  runFor(5000);
+  sim::setWakeHandler(nullptr);
+  CHECK(anyStartsWith(freshHealth(), "HEALTH STATE OK FAULTS NONE"));
+}
+
+void testHealthFlagsABlockedClearSensor() {
+  if (!Machine::HAS_CLEAR_SENSOR) return;
+  sim::setDigitalInput(CLEAR_SENSOR_PIN, LOW);
+  CHECK(anyStartsWith(freshHealth(), "HEALTH STATE DEGRADED FAULTS BEAM"));
+  sim::setDigitalInput(CLEAR_SENSOR_PIN, HIGH);
+  CHECK(anyStartsWith(freshHealth(), "HEALTH STATE OK FAULTS NONE"));
+}
+
+// A layout without a clear sensor has nothing for the check to observe, so
+// it must not report a pass
+void testHealthIsUncheckedWithoutAClearSensor() {
+  if (Machine::HAS_CLEAR_SENSOR) return;
+  CHECK(anyStartsWith(freshHealth(), "HEALTH STATE UNCHECKED FAULTS UNCHECKED"));
+}
+
+// Polling HEALTH must not keep the check from running
+void testHealthPollsDoNotPostponeTheCheck() {
+  exchange("HEALTH NOW");
+  std::vector<std::string> lines;
+  for (unsigned long waited = 0; waited < HEALTH_IDLE_TIME + 2000; waited += 1000) {
+    lines = exchange("HEALTH");
+    runFor(800);
+  }
+  unsigned int checks = 0;
+  for (const std::string &line : lines) {
+    size_t at = line.find(" CHECKS ");
+    if (at != std::string::npos) checks = std::strtoul(line.c_str() + at + 8, nullptr, 10);
+  }
+  CHECK(checks > 0);
+}
+
+// ============================================================================
+// LINE CLOCK
+// ============================================================================
+
+// A SYNC that waits behind a sort is taken at its own arrival time, not at
+// that of a later SYNC the full diagnostic queue turned away
+void testQueuedSyncKeepsItsArrivalTime() {
+  output.clear();
+  sim::sendLine("LEFT");
+  uint64_t start = sim::nowMicros();
+  const unsigned long hostMs = 100000;
+  sim::scheduleInput("SYNC " + std::to_string(hostMs) + "\n", start + 500000);
+  sim::scheduleInput("STATUS\n", start + 600000);
+  sim::scheduleInput("SYNC " + std::to_string(hostMs + 1000) + "\n", start + 1500000);
+  runFor(6000);
+  CHECK(anyStartsWith(output, "ERROR: Command queue full - SYNC"));
+  CHECK(anyStartsWith(output, "OK SYNC"));
+
+  long expectedMs = (long)(hostMs + (sim::nowMicros() - (start + 500000)) / 1000);
+  long errorMs = (long)lineMillis() - expectedMs;
+  CHECK(errorMs >= -5 && errorMs <= 5);
+}
+
+}  // namespace
+
+int main() {
+  sim::LineCollector lines;
+  lines.onLine = [](const std::string &line, uint64_t) { output.push_back(line); };
+  sim::setOutputHandler([&](uint8_t value, uint64_t timeMicros) { lines.feed(value, timeMicros); });
+  setup();
+
+  testLongestEchoFitsWithFiveDigitSequence();
+  testOverlongLineIsRejected();
+  testLostConfirmReplyCanBeConfirmedAgain();
+  testHealthPollsDoNotPostponeTheCheck();
+  testHealthFlagsABlockedClearSensor();
+  testHealthFlagsAClearSensorThatNeverSeesAnItem();
+  testHealthIsUncheckedWithoutAClearSensor();
+  testQueuedSyncKeepsItsArrivalTime();
+  testStopJumpsAQueuedSort();
+  testDiagnosticsWaitForQueuedSorts();
+  testFullDiagnosticQueueDoesNotBlockASort();
+  testStopCancelsOnlyTheSortClass();
+  testResentSortIsReplayed();
+  testHelloClearsRecentResults();
+
+  std::printf("%s\n", failures == 0 ? "protocol_test: all checks passed" : "protocol_test: FAILED");
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,225 @@
+/*
+ * ============================================================================
+ * ANALYTICAL THROUGHPUT MODEL
+ * ============================================================================
+ * Answers "how many items per hour at these settings?" from the firmware's
+ * own timing constants (MOVE_TIME, HOLD_TIME, STEP_DELAY, SERVO2_SETTLE_TIME,
+ * gate positions and the step profile, read from the compiled arduino.cxx)
+ * and a class mix:
+ *
+ *   cycle(dir) = servo2 settle + move out + hold + return
+ *   move(a, b) = steps(a, b) * STEP_DELAY + MOVE_TIME   (0 if a == b)
+ *
+ * Throughput is given for commands queued back to back, for a host that
+ * waits for READY before sending the next command (plus a host overhead per
+ * item), and, as a what-if, for coalescing runs of same-direction items so
+ * the gate holds its pose instead of returning to center between them (the
+ * firmware does not do this today).
+ *
+ * The first two figures are then checked against the host build of the
+ * firmware running the same mix (skip with --no-validate).
+ *
+ * Usage: throughput_model [--mix SAFE,PREPROCESS,DO_NOT_SHRED,DISCARD]
+ *                         [--host-overhead-ms MS] [--items N] [--seed N]
+ *                         [--no-validate]
+ * ============================================================================
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <Arduino.h>
+
+#include "sim_runtime.h"
+
+namespace {
+
+const char *const DIRECTIONS[3] = {"LEFT", "RIGHT", "CENTER"};
+
+struct Options {
+  double mix[4] = {0.55, 0.20, 0.15, 0.10};  // Same default as line_sim
+  double hostOverheadMs = 0.0;
+  int items = 100;
+  unsigned long seed = 1;
+  bool validate = true;
+};
+
+// ============================================================================
+// MODEL
+// ============================================================================
+
+struct Cycle {
+  double settleMs = 0.0;
+  double moveOutMs = 0.0;
+  double holdMs = 0.0;
+  double returnMs = 0.0;
+  double totalMs() const { return settleMs + moveOutMs + holdMs + returnMs; }
+};
+
+double moveMs(const sim::FirmwareConfig &fw, int fromPos, int toPos) {
+  if (fromPos == toPos) return 0.0;  // moveServoSmoothly() returns early
+  return sim::firmwareTrajectorySteps(fromPos, toPos) * fw.stepDelayMs + fw.moveTimeMs;
+}
+
+// Mirrors executeSortingMovement(): the gate starts and ends at center
+Cycle modelCycle(const sim::FirmwareConfig &fw, int direction) {
+  int target = direction == 0 ? fw.leftPosition : direction == 1 ? fw.rightPosition : fw.centerPosition;
+  Cycle cycle;
+  if (direction != 2) cycle.settleMs = fw.servo2SettleTimeMs;
+  cycle.moveOutMs = moveMs(fw, fw.centerPosition, target);
+  cycle.holdMs = fw.holdTimeMs;
+  cycle.returnMs = moveMs(fw, target, fw.centerPosition);
+  return cycle;
+}
+
+double itemsPerHour(double cycleMs) {
+  return cycleMs > 0 ? 3600000.0 / cycleMs : NAN;
+}
+
+// Coalesced: an item that continues a same-direction run only holds; the
+// settle, move out and return are paid once per run. With independent items
+// a direction-d item starts a new run with probability 1 - p(d).
+double coalescedCycleMs(const Cycle cycles[2], double pLeft) {
+  double p[2] = {pLeft, 1.0 - pLeft};
+  double ms = cycles[0].holdMs * p[0] + cycles[1].holdMs * p[1];
+  for (int d = 0; d < 2; d++) {
+    ms += p[d] * (1.0 - p[d]) * (cycles[d].settleMs + cycles[d].moveOutMs + cycles[d].returnMs);
+  }
+  return ms;
+}
+
+// ============================================================================
+// VALIDATION AGAINST THE HOST FIRMWARE BUILD
+// ============================================================================
+
+// Sends the commands to the simulated firmware and returns the time from the
+// first command to the last READY. Back to back keeps the firmware queue full;
+// otherwise each command goes out hostOverheadMs after the previous READY.
+double simulateMs(const std::vector<std::string> &commands, bool backToBack, double hostOverheadMs,
+                  int queueSize) {
+  size_t sent = 0;
+  size_t ready = 0;
+  double startMs = sim::nowMicros() / 1000.0;
+  double endMs = startMs;
+
+  sim::LineCollector lines;
+  lines.onLine = [&](const std::string &line, uint64_t timeMicros) {
+    if (line != "READY") return;
+    ready++;
+    endMs = timeMicros / 1000.0;
+    if (sent < commands.size()) {
+      double delayMs = backToBack ? 0.0 : hostOverheadMs;
+      sim::scheduleInput(commands[sent++] + "\n", timeMicros + static_cast<uint64_t>(delayMs * 1000.0));
+    }
+  };
+  sim::setOutputHandler([&](uint8_t value, uint64_t timeMicros) { lines.feed(value, timeMicros); });
+
+  size_t initial = backToBack ? std::min(commands.size(), static_cast<size_t>(queueSize)) : 1;
+  for (; sent < initial; sent++) sim::sendLine(commands[sent]);
+
+  double giveUpMs = startMs + commands.size() * 60000.0;
+  while (ready < commands.size() && sim::nowMicros() / 1000.0 < giveUpMs) loop();
+  sim::setOutputHandler(nullptr);
+  return ready == commands.size() ? endMs - startMs : NAN;
+}
+
+double errorPercent(double model, double simulated) {
+  if (!(simulated > 0)) return NAN;
+  double error = (model - simulated) / simulated * 100.0;
+  return std::fabs(error) < 0.005 ? 0.0 : error;  // No "-0.00%"
+}
+
+void printUsage() {
+  std::fprintf(stderr,
+               "Usage: throughput_model [--mix SAFE,PREPROCESS,DO_NOT_SHRED,DISCARD] [--host-overhead-ms MS]\n"
+               "                        [--items N] [--seed N] [--no-validate]\n");
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--mix" && hasValue) {
+      double *m = options.mix;
+      if (std::sscanf(argv[++i], "%lf,%lf,%lf,%lf", &m[0], &m[1], &m[2], &m[3]) != 4) {
+        printUsage();
+        return 2;
+      }
+    } else if (arg == "--host-overhead-ms" && hasValue) {
+      options.hostOverheadMs = std::atof(argv[++i]);
+    } else if (arg == "--items" && hasValue) {
+      options.items = std::atoi(argv[++i]);
+    } else if (arg == "--seed" && hasValue) {
+      options.seed = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--no-validate") {
+      options.validate = false;
+    } else {
+      printUsage();
+      return arg == "--help" || arg == "-h" ? 0 : 2;
+    }
+  }
+
+  double mixTotal = options.mix[0] + options.mix[1] + options.mix[2] + options.mix[3];
+  if (mixTotal <= 0 || options.items < 1) {
+    std::fprintf(stderr, "throughput_model: need a non-zero class mix and at least 1 item\n");
+    return 2;
+  }
+  // Safe to Shred goes LEFT, every other safety level RIGHT (as in finalanalyze.py)
+  double pLeft = options.mix[0] / mixTotal;
+
+  sim::FirmwareConfig fw = sim::firmwareConfig();
+  Cycle cycles[3];
+  for (int d = 0; d < 3; d++) cycles[d] = modelCycle(fw, d);
+
+  double queuedMs = pLeft * cycles[0].totalMs() + (1.0 - pLeft) * cycles[1].totalMs();
+  double lockstepMs = queuedMs + options.hostOverheadMs;
+  double coalescedMs = coalescedCycleMs(cycles, pLeft);
+
+  // Simulated figures (NAN when not validating)
+  double simCycleMs[3] = {NAN, NAN, NAN};
+  double simQueuedMs = NAN;
+  double simLockstepMs = NAN;
+  if (options.validate) {
+    setup();
+    for (int d = 0; d < 3; d++) simCycleMs[d] = simulateMs({DIRECTIONS[d]}, false, 0.0, fw.commandQueueSize);
+
+    std::mt19937_64 rng(options.seed);
+    std::discrete_distribution<int> mix(options.mix, options.mix + 4);
+    std::vector<std::string> commands;
+    for (int i = 0; i < options.items; i++) commands.push_back(mix(rng) == 0 ? "LEFT" : "RIGHT");
+
+    simQueuedMs = simulateMs(commands, true, 0.0, fw.commandQueueSize) / options.items;
+    simLockstepMs = simulateMs(commands, false, options.hostOverheadMs, fw.commandQueueSize) / options.items;
+  }
+
+  std::printf("Firmware: MOVE_TIME %d ms, HOLD_TIME %d ms, STEP_DELAY %d ms, SERVO2_SETTLE_TIME %d ms\n",
+              fw.moveTimeMs, fw.holdTimeMs, fw.stepDelayMs, fw.servo2SettleTimeMs);
+  std::printf("Positions: left %d, center %d, right %d deg\n\n", fw.leftPosition, fw.centerPosition,
+              fw.rightPosition);
+
+  std::printf("%-8s %10s %10s %10s %10s %10s %10s %8s\n", "command", "settle_ms", "move_ms", "hold_ms", "return_ms",
+              "model_ms", "sim_ms", "error");
+  for (int d = 0; d < 3; d++) {
+    const Cycle &c = cycles[d];
+    std::printf("%-8s %10.0f %10.0f %10.0f %10.0f %10.0f %10.1f %7.2f%%\n", DIRECTIONS[d], c.settleMs, c.moveOutMs,
+                c.holdMs, c.returnMs, c.totalMs(), simCycleMs[d], errorPercent(c.totalMs(), simCycleMs[d]));
+  }
+
+  std::printf("\nClass mix: %.0f%% LEFT, %.0f%% RIGHT\n\n", pLeft * 100.0, (1.0 - pLeft) * 100.0);
+  std::printf("%-32s %10s %12s %12s %8s\n", "mode", "cycle_ms", "items/hour", "sim_items/h", "error");
+  std::printf("%-32s %10.1f %12.0f %12.0f %7.2f%%\n", "queued back to back", queuedMs, itemsPerHour(queuedMs),
+              itemsPerHour(simQueuedMs), errorPercent(itemsPerHour(queuedMs), itemsPerHour(simQueuedMs)));
+  std::string lockstep = "wait for READY (+" + std::to_string(static_cast<int>(options.hostOverheadMs)) + " ms)";
+  std::printf("%-32s %10.1f %12.0f %12.0f %7.2f%%\n", lockstep.c_str(), lockstepMs, itemsPerHour(lockstepMs),
+              itemsPerHour(simLockstepMs), errorPercent(itemsPerHour(lockstepMs), itemsPerHour(simLockstepMs)));
+  std::printf("%-32s %10.1f %12.0f %12s %8s\n", "coalesced runs (what-if)", coalescedMs, itemsPerHour(coalescedMs),
+              "-", "-");
+  return 0;
+}
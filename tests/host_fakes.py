@@ -0,0 +1,103 @@
+"""
+Loads finalanalyze.py for the host tests without its hardware and cloud
+dependencies: packages that are not installed (pyserial, Flask, dotenv,
+google-generativeai) are replaced by empty stand-ins, and the log file the
+module opens on import goes to a temporary directory.
+"""
+
+import importlib
+import importlib.util
+import os
+import sys
+import tempfile
+import threading
+import types
+from pathlib import Path
+
+REPO = Path(__file__).resolve().parent.parent
+
+
+def _stub_missing_modules():
+    for name in ('serial', 'flask', 'dotenv', 'google.generativeai'):
+        try:
+            importlib.import_module(name)
+        except ImportError:
+            parent, _, child = name.rpartition('.')
+            module = types.ModuleType(name)
+            sys.modules[name] = module
+            if parent:
+                sys.modules.setdefault(parent, types.ModuleType(parent))
+                setattr(sys.modules[parent], child, module)
+    flask = sys.modules['flask']
+    if not hasattr(flask, 'Flask'):
+        flask.Flask = lambda *args, **kwargs: types.SimpleNamespace(route=lambda *a, **k: (lambda f: f))
+        flask.request = None
+        flask.jsonify = None
+    dotenv = sys.modules['dotenv']
+    if not hasattr(dotenv, 'load_dotenv'):
+        dotenv.load_dotenv = lambda *args, **kwargs: None
+    genai = sys.modules['google.generativeai']
+    if not hasattr(genai, 'configure'):
+        genai.configure = lambda **kwargs: None
+    serial = sys.modules['serial']
+    if not hasattr(serial, 'SerialException'):
+        serial.SerialException = OSError
+
+
+def load_host():
+    """Import finalanalyze.py once and return the module"""
+    if 'finalanalyze' in sys.modules:
+        return sys.modules['finalanalyze']
+    _stub_missing_modules()
+    os.environ.setdefault('GOOGLE_API_KEY', 'unused-in-tests')
+    cwd = os.getcwd()
+    os.chdir(tempfile.mkdtemp(prefix='host-tests-'))
+    try:
+        spec = importlib.util.spec_from_file_location('finalanalyze', REPO / 'finalanalyze.py')
+        module = importlib.util.module_from_spec(spec)
+        sys.modules['finalanalyze'] = module
+        spec.loader.exec_module(module)
+    finally:
+        os.chdir(cwd)
+    module.logging.disable(module.logging.CRITICAL)  # Keep test output readable
+    return module
+
+
+class FakePort:
+    """Serial port stand-in: records writes, fails them on request, never returns data"""
+
+    def __init__(self):
+        self.written = []
+        self.fail_writes = False
+        self.closed = threading.Event()
+
+    def write(self, data: bytes):
+        if self.fail_writes:
+            raise OSError("write failed (injected)")
+        self.written.append(data.decode())
+        return len(data)
+
+    def flush(self):
+        pass
+
+    @property
+    def in_waiting(self):
+        return 0
+
+    def read(self, size: int = 1) -> bytes:
+        self.closed.wait(0.05)
+        return b''
+
+    def close(self):
+        self.closed.set()
+
+
+def fake_lane(host, lane_id: int = 1, credits: int = 4, protocol: int = 4):
+    """A connected ArduinoController on a FakePort, as HELLO would leave it"""
+    lane = host.ArduinoController(f"fake{lane_id}", 115200)
+    lane.connection = FakePort()
+    lane.connected = True
+    lane.lane_id = lane_id
+    lane.credits = credits
+    lane.protocol = protocol
+    return lane
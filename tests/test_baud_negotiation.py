@@ -0,0 +1,70 @@
+"""
+Baud negotiation when a reply is lost: the host must not leave the firmware
+committed at a rate it has gone back from, and must not send the next BAUD
+while the firmware may still be waiting for a confirmation.
+"""
+
+import unittest
+from unittest import mock
+
+from host_fakes import fake_lane, load_host
+
+host = load_host()
+
+
+class ScriptedLane:
+    """Answers send_command like the firmware would, with chosen replies lost"""
+
+    def __init__(self, lane, lose):
+        self.lane = lane
+        self.lose = list(lose)  # Commands whose next reply never arrives
+        self.sent = []
+        lane.send_command = self.send_command
+
+    def send_command(self, command, wait_for_ready=True, timeout=host.COMMAND_TIMEOUT):
+        self.sent.append(command)
+        name = command.split()[0]
+        if command in self.lose:
+            self.lose.remove(command)
+            return None
+        if name == 'BAUD' and command != 'BAUD CONFIRM':
+            return f"OK {command}\nREADY"
+        if command == 'BAUD CONFIRM':
+            return f"OK BAUD {self.lane.connection.baudrate} CONFIRMED\nREADY"
+        if name == 'ECHO':
+            return f"OK ECHO {command.split()[2]}\nREADY"
+        if name == 'HELLO':
+            return f"HELLO LANE 1 QUEUE 4 PROTOCOL 4 BAUD {self.lane.connection.baudrate} BAUDS 500000\nREADY"
+        return "READY"
+
+
+class BaudNegotiationTest(unittest.TestCase):
+    def setUp(self):
+        self.lane = fake_lane(host)
+        self.lane.connection.baudrate = 115200
+        self.lane.connection.reset_input_buffer = lambda: None
+        self.lane.baud_rates = [500000]
+
+    def tearDown(self):
+        self.lane.connection.close()
+
+    def test_lost_confirm_reply_is_confirmed_again(self):
+        script = ScriptedLane(self.lane, lose=['BAUD CONFIRM'])
+        with mock.patch.object(host.time, 'sleep') as sleep:
+            self.assertEqual(self.lane.negotiate_baud(500000), 500000)
+        self.assertEqual(self.lane.connection.baudrate, 500000)
+        self.assertEqual(script.sent[-2:], ['HELLO', 'BAUD CONFIRM'])
+        sleep.assert_not_called()
+
+    def test_lost_baud_reply_waits_out_the_revert(self):
+        script = ScriptedLane(self.lane, lose=['BAUD 500000'])
+        with mock.patch.object(host.time, 'sleep') as sleep:
+            self.assertEqual(self.lane.negotiate_baud(500000), 115200)
+        self.assertEqual(self.lane.connection.baudrate, 115200)
+        self.assertEqual(script.sent, ['BAUD 500000', 'HELLO'])
+        waited = sum(call.args[0] for call in sleep.call_args_list)
+        self.assertGreaterEqual(waited, host.BAUD_VERIFY_TIMEOUT)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,31 @@
+"""
+Reply lines that a noisy link garbled: the host must skip what it cannot
+parse rather than raise in the reader or actuation thread.
+"""
+
+import unittest
+
+from host_fakes import fake_lane, load_host
+
+host = load_host()
+
+
+class GarbledReplyTest(unittest.TestCase):
+    def setUp(self):
+        self.lane = fake_lane(host)
+
+    def tearDown(self):
+        self.lane.connection.close()
+
+    def test_garbled_motion_time_is_skipped(self):
+        trace = host.ItemTrace(7)
+        pending = self.lane.start_move('LEFT', trace)
+        self.lane._handle_line(f"Received command: {pending.wire}")
+        self.lane._handle_line("DONE 7 LEFT 37\x180")
+        self.lane._handle_line(f"READY @{pending.sequence}")
+        self.assertTrue(self.lane.finish_move('LEFT', pending, trace))
+        self.assertEqual(trace.stages['motion'], 0.0)
+
+
+if __name__ == '__main__':
+    unittest.main()
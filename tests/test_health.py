@@ -0,0 +1,36 @@
+"""
+HEALTH replies: a machine without a clear sensor reports UNCHECKED, which
+is neither a pass nor a fault.
+"""
+
+import unittest
+
+from host_fakes import fake_lane, load_host
+
+host = load_host()
+
+
+class HealthReplyTest(unittest.TestCase):
+    def setUp(self):
+        self.lane = fake_lane(host)
+
+    def tearDown(self):
+        self.lane.connection.close()
+
+    def parse(self, state: str, faults: str) -> dict:
+        return self.lane._parse_health(f"HEALTH STATE {state} FAULTS {faults} CHECKS 1 DEGRADED 0 "
+                                       f"CANCELLED 0 SILENT_SORTS 0 AGE_S 0\nREADY")
+
+    def test_unchecked_is_not_ok_and_has_no_faults(self):
+        health = self.parse('UNCHECKED', 'UNCHECKED')
+        self.assertEqual(health['state'], 'UNCHECKED')
+        self.assertEqual(health['faults'], [])
+
+    def test_degraded_lists_its_faults(self):
+        health = self.parse('DEGRADED', 'BEAM,BEAM_SILENT')
+        self.assertEqual(health['state'], 'DEGRADED')
+        self.assertEqual(health['faults'], ['BEAM', 'BEAM_SILENT'])
+
+
+if __name__ == '__main__':
+    unittest.main()
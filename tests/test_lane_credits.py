@@ -0,0 +1,80 @@
+"""
+LaneRegistry credits around failed sends: a credit the actuation loop
+reserves for a command must come back exactly once, whether the command
+finishes or could not be written at all.
+"""
+
+import os
+import tempfile
+import time
+import unittest
+
+from host_fakes import fake_lane, load_host
+
+host = load_host()
+
+
+def wait_until(condition, timeout: float = 2.0) -> bool:
+    deadline = time.time() + timeout
+    while time.time() < deadline:
+        if condition():
+            return True
+        time.sleep(0.01)
+    return condition()
+
+
+class FailedSendTest(unittest.TestCase):
+    def setUp(self):
+        self.lane = fake_lane(host)
+        self.registry = host.LaneRegistry()
+        self.registry.lanes.append(self.lane)
+        self.registry.outstanding[self.lane] = 0
+        host.lanes = self.registry
+        host.item_traces = host.ItemTraceLog(os.path.join(tempfile.mkdtemp(), 'items.jsonl'))
+        self.pipeline = host.SortingPipeline(ml_workers=0, queue_size=4)
+        self.pipeline.start()
+
+    def tearDown(self):
+        self.pipeline.stop()
+        self.lane.connection.close()
+        host.lanes = None
+
+    def new_item(self) -> 'host.SortingItem':
+        return host.SortingItem(host.item_traces.new_item(), 'item.jpg', 'item.jpg')
+
+    def test_send_returns_none_without_finishing_the_command(self):
+        self.lane.connection.fail_writes = True
+        calls = []
+        self.assertIsNone(self.lane.prearm(on_done=calls.append))
+        self.assertEqual(calls, [])
+        self.assertFalse(self.lane.connected)
+
+    def test_failed_prearm_releases_its_credit_once(self):
+        self.lane.connection.fail_writes = True
+        self.pipeline.events.put(('analyzing', self.new_item()))
+        self.assertTrue(wait_until(lambda: not self.lane.connected))
+        time.sleep(0.1)  # Let the actuation loop finish its pass
+        self.assertEqual(self.registry.outstanding[self.lane], 0)
+
+    def test_failed_sort_releases_its_credit_once(self):
+        self.lane.connection.fail_writes = True
+        item = self.new_item()
+        item.direction = 'LEFT'
+        item.decided_at = time.time()
+        self.pipeline.events.put(('decided', item))
+        self.assertTrue(wait_until(lambda: item.status == 'servo_error'))
+        time.sleep(0.1)
+        self.assertEqual(self.registry.outstanding[self.lane], 0)
+
+    def test_sent_prearm_releases_its_credit_on_ready(self):
+        self.pipeline.events.put(('analyzing', self.new_item()))
+        self.assertTrue(wait_until(lambda: self.lane.in_flight))
+        self.assertEqual(self.registry.outstanding[self.lane], 1)
+        pending = self.lane.in_flight[0]
+        self.lane._handle_line(f"Received command: {pending.wire}")
+        self.lane._handle_line(f"READY @{pending.sequence}")
+        self.assertTrue(wait_until(lambda: self.registry.outstanding[self.lane] == 0))
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,70 @@
+"""
+An item that is decided while every lane is full waits in the actuation
+loop's backlog; once LANE_WAIT_TIMEOUT passes without a free credit it
+fails as lane_timeout instead of waiting forever.
+"""
+
+import os
+import tempfile
+import time
+import unittest
+from unittest import mock
+
+from host_fakes import fake_lane, load_host
+
+host = load_host()
+
+
+def wait_until(condition, timeout: float = 2.0) -> bool:
+    deadline = time.time() + timeout
+    while time.time() < deadline:
+        if condition():
+            return True
+        time.sleep(0.01)
+    return condition()
+
+
+class LaneWaitTest(unittest.TestCase):
+    def setUp(self):
+        self.lane = fake_lane(host, credits=1)
+        self.registry = host.LaneRegistry()
+        self.registry.lanes.append(self.lane)
+        self.registry.outstanding[self.lane] = 1  # Its only credit is taken
+        host.lanes = self.registry
+        host.item_traces = host.ItemTraceLog(os.path.join(tempfile.mkdtemp(), 'items.jsonl'))
+        self.pipeline = host.SortingPipeline(ml_workers=0, queue_size=4)
+        self.pipeline.start()
+
+    def tearDown(self):
+        self.pipeline.stop()
+        self.lane.connection.close()
+        host.lanes = None
+
+    def decided_item(self) -> 'host.SortingItem':
+        item = host.SortingItem(host.item_traces.new_item(), 'item.jpg', 'item.jpg')
+        item.direction = 'LEFT'
+        item.status = 'waiting_for_lane'
+        item.decided_at = time.time()
+        return item
+
+    def test_item_without_a_lane_times_out(self):
+        item = self.decided_item()
+        with mock.patch.object(host, 'LANE_WAIT_TIMEOUT', 0.2):
+            self.pipeline.events.put(('decided', item))
+            self.assertTrue(wait_until(lambda: item.status == 'lane_timeout'))
+        self.assertIsNotNone(item.record)
+        self.assertIsNone(item.lane)
+        self.assertEqual(self.lane.connection.written, [])
+        self.assertEqual(self.registry.outstanding[self.lane], 1)
+
+    def test_item_takes_a_credit_freed_in_time(self):
+        item = self.decided_item()
+        self.pipeline.events.put(('decided', item))
+        time.sleep(0.1)
+        self.registry.release(self.lane)
+        self.assertTrue(wait_until(lambda: item.status == 'sorting'))
+        self.assertIs(item.lane, self.lane)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,41 @@
+"""
+Command lines must fit the firmware's MAX_COMMAND_LENGTH with the longest
+sequence tag, or the firmware cuts them short.
+"""
+
+import unittest
+
+from host_fakes import fake_lane, load_host
+
+host = load_host()
+
+
+class LineLengthTest(unittest.TestCase):
+    def setUp(self):
+        self.lane = fake_lane(host)
+
+    def tearDown(self):
+        self.lane.connection.close()
+
+    def test_echo_fits_at_a_five_digit_sequence_id(self):
+        self.lane.next_sequence = host.SEQUENCE_MAX
+        payload = 'A5' * host.BAUD_ECHO_BYTES
+        pending = self.lane._send(f"ECHO {payload} FFFF")
+        self.assertIsNotNone(pending)
+        self.assertTrue(pending.wire.endswith(f" @{host.SEQUENCE_MAX}"))
+        self.assertLessEqual(len(pending.wire), host.COMMAND_MAX_LENGTH)
+
+    def test_overlong_command_is_not_sent(self):
+        self.assertIsNone(self.lane._send('ECHO ' + 'A5' * 40 + ' FFFF'))
+        self.assertEqual(self.lane.connection.written, [])
+
+    def test_too_long_reply_fails_the_command(self):
+        pending = self.lane._send('STATUS')
+        self.lane._handle_line(host.TOO_LONG_PREFIX + pending.wire[:4])
+        self.assertTrue(pending.done.is_set())
+        self.assertTrue(pending.failed)
+        self.assertNotIn(pending, self.lane.in_flight)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,81 @@
+"""
+PREARM while an item is analyzed: only the lane the item will most likely
+go to leans, and the decided item then goes to that lane.
+"""
+
+import os
+import tempfile
+import time
+import unittest
+
+from host_fakes import fake_lane, load_host
+
+host = load_host()
+
+
+def wait_until(condition, timeout: float = 2.0) -> bool:
+    deadline = time.time() + timeout
+    while time.time() < deadline:
+        if condition():
+            return True
+        time.sleep(0.01)
+    return condition()
+
+
+class PrearmLaneTest(unittest.TestCase):
+    def setUp(self):
+        self.lanes = [fake_lane(host, lane_id=1), fake_lane(host, lane_id=2)]
+        self.registry = host.LaneRegistry()
+        for lane in self.lanes:
+            self.registry.lanes.append(lane)
+            self.registry.outstanding[lane] = 0
+        host.lanes = self.registry
+        host.item_traces = host.ItemTraceLog(os.path.join(tempfile.mkdtemp(), 'items.jsonl'))
+        self.pipeline = host.SortingPipeline(ml_workers=0, queue_size=4)
+        self.pipeline.start()
+
+    def tearDown(self):
+        self.pipeline.stop()
+        for lane in self.lanes:
+            lane.connection.close()
+        host.lanes = None
+
+    def new_item(self) -> 'host.SortingItem':
+        return host.SortingItem(host.item_traces.new_item(), 'item.jpg', 'item.jpg')
+
+    def sent(self, lane) -> list:
+        return [line.split()[0] for line in lane.connection.written]
+
+    def test_only_one_idle_lane_leans(self):
+        self.pipeline.events.put(('analyzing', self.new_item()))
+        self.assertTrue(wait_until(lambda: any(lane.in_flight for lane in self.lanes)))
+        time.sleep(0.1)  # Let the actuation loop finish its pass
+        self.assertEqual([self.sent(lane) for lane in self.lanes], [['PREARM'], []])
+
+    def test_decided_item_goes_to_the_leaning_lane(self):
+        item = self.new_item()
+        self.pipeline.events.put(('analyzing', item))
+        self.assertTrue(wait_until(lambda: self.lanes[0].in_flight))
+        item.direction = 'LEFT'
+        item.decided_at = time.time()
+        self.pipeline.events.put(('decided', item))  # Before the PREARM's READY
+        self.assertTrue(wait_until(lambda: item.lane is not None))
+        self.assertIs(item.lane, self.lanes[0])
+        self.assertEqual(self.sent(self.lanes[0]), ['PREARM', 'LEFT'])
+        self.assertEqual(self.sent(self.lanes[1]), [])
+
+    def test_second_analysis_leans_the_next_lane(self):
+        self.pipeline.events.put(('analyzing', self.new_item()))
+        self.assertTrue(wait_until(lambda: self.lanes[0].in_flight))
+        pending = self.lanes[0].in_flight[0]
+        self.lanes[0]._handle_line(f"Received command: {pending.wire}")
+        self.lanes[0]._handle_line(f"READY @{pending.sequence}")
+        self.assertTrue(wait_until(lambda: self.registry.outstanding[self.lanes[0]] == 0))
+
+        self.pipeline.events.put(('analyzing', self.new_item()))
+        self.assertTrue(wait_until(lambda: self.lanes[1].in_flight))
+        self.assertEqual(self.sent(self.lanes[0]), ['PREARM'])
+
+
+if __name__ == '__main__':
+    unittest.main()
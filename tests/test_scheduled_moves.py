@@ -0,0 +1,49 @@
+"""
+Deadlines of movements with an AT start time: the firmware holds such a
+move for up to SYNC_INTERVAL before it runs, longer than COMMAND_TIMEOUT,
+so the hold counts toward its own deadline and those queued behind it.
+"""
+
+import unittest
+
+from host_fakes import fake_lane, load_host
+
+host = load_host()
+
+LEAD_MS = 9000
+
+
+class ScheduledMoveTest(unittest.TestCase):
+    def setUp(self):
+        self.lane = fake_lane(host)
+
+    def tearDown(self):
+        self.lane.connection.close()
+
+    def test_lead_extends_the_move_deadline(self):
+        pending = self.lane.start_move('LEFT', start_at=host.line_ms() + LEAD_MS)
+        self.assertIn(' AT ', pending.wire)
+        self.assertGreater(pending.timeout_at - pending.sent_at, host.COMMAND_TIMEOUT + LEAD_MS / 1000 - 0.5)
+
+        # Started: the hold still lies ahead
+        self.lane._handle_line(f"Received command: {pending.wire}")
+        self.assertGreater(pending.timeout_at - pending.started_at, host.COMMAND_TIMEOUT + LEAD_MS / 1000 - 0.5)
+
+    def test_lead_extends_the_deadline_of_commands_behind_it(self):
+        self.lane.start_move('LEFT', start_at=host.line_ms() + LEAD_MS)
+        behind = self.lane.start_move('RIGHT')
+        self.assertGreater(behind.timeout_at - behind.sent_at, 2 * host.COMMAND_TIMEOUT + LEAD_MS / 1000 - 0.5)
+
+    def test_past_start_time_adds_nothing(self):
+        pending = self.lane.start_move('LEFT', start_at=host.line_ms() - LEAD_MS)
+        self.assertAlmostEqual(pending.timeout, host.COMMAND_TIMEOUT)
+
+    def test_older_firmware_ignores_the_start_time(self):
+        self.lane.protocol = 3
+        pending = self.lane.start_move('LEFT', start_at=host.line_ms() + LEAD_MS)
+        self.assertNotIn(' AT ', pending.wire)
+        self.assertAlmostEqual(pending.timeout, host.COMMAND_TIMEOUT)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,256 @@
+"""
+================================================================================
+SERIAL FAULT BENCH
+================================================================================
+Measures what an unreliable link costs the sorting pipeline. Each scenario
+starts sim/fault_sim (the host build of the firmware on a pseudo-terminal,
+with faults injected on the link) and runs the real host against it:
+LaneRegistry finds the lane with HELLO, SortingPipeline takes the items from
+a stand-in ML analyzer, and ArduinoController's deadlines, resends and
+reply handling do the recovery.
+
+The fault-free run, each fault on its own and all of them together run in
+parallel, one process each (the host keeps its lanes and pipeline in module
+globals), in real time. The report shows items/min, failed items and
+upload-to-finish latency percentiles next to the fault-free run.
+
+Device resets keep the port open, as on a Mega behind its USB-serial chip:
+the host sees the boot banner, and the commands the reboot lost time out
+and are sent again. The host stays at ARDUINO_BAUD unless --max-baud is
+raised; a board rebooted under a negotiated rate comes back at its default
+rate and the link stays garbled.
+
+Needs the host's packages (pyserial, Flask, python-dotenv,
+google-generativeai); no API key is used.
+
+Usage:
+    python tools/fault_bench.py --fault-sim build/fault_sim
+    python tools/fault_bench.py --items 100 --rate 12 --resets 1 --boot-ms 1000
+================================================================================
+"""
+
+import os
+import sys
+import json
+import time
+import random
+import signal
+import argparse
+import tempfile
+import subprocess
+from pathlib import Path
+from typing import Dict, List
+
+REPO = Path(__file__).resolve().parent.parent
+
+LEFT_SHARE = 0.55     # Safe to Shred in line_sim's default mix
+FINISH_GRACE = 600    # Seconds after the last upload before unfinished items count as failed
+BOOT_WAIT = 4.0       # Seconds for the board's first setup(); a pseudo-terminal has no DTR auto-reset
+
+
+def load_host(verbose: bool):
+    """Import finalanalyze.py with its log file in a scratch directory"""
+    os.environ.setdefault('GOOGLE_API_KEY', 'unused-by-fault-bench')
+    sys.path.insert(0, str(REPO))
+    os.chdir(tempfile.mkdtemp(prefix='fault-bench-'))
+    import finalanalyze
+    if not verbose:
+        finalanalyze.logger.setLevel('WARNING')
+    return finalanalyze
+
+
+class BenchAnalyzer:
+    """Stands in for MLSortingAnalyzer: a fixed delay, then LEFT or RIGHT at LEFT_SHARE"""
+
+    def __init__(self, seed: int, seconds: float):
+        self.rng = random.Random(seed)
+        self.seconds = seconds
+
+    def analyze_image_for_sorting(self, image_path: str, item_trace=None, on_decision=None) -> Dict:
+        time.sleep(self.seconds)
+        left = self.rng.random() < LEFT_SHARE
+        return {
+            'item_name': 'bench item',
+            'safety_level': 'Safe to Shred' if left else 'Do Not Shred',
+            'sorting_direction': 'LEFT' if left else 'RIGHT',
+            'confidence': 0.9,
+            'hazards': [],
+            'notes': ''
+        }
+
+
+# ============================================================================
+# ONE SCENARIO (child process)
+# ============================================================================
+
+def fault_args(args) -> List[str]:
+    return ['--drop', str(args.drop), '--corrupt', str(args.corrupt),
+            '--stalls', str(args.stalls), '--stall-ms', str(args.stall_ms),
+            '--resets', str(args.resets), '--boot-ms', str(args.boot_ms), '--seed', str(args.seed)]
+
+
+def run_scenario(args) -> Dict:
+    bridge = subprocess.Popen([args.fault_sim, *fault_args(args)], stdout=subprocess.PIPE, text=True)
+    port = bridge.stdout.readline().strip()
+    time.sleep(BOOT_WAIT)  # Opening the port then flushes the banner, as after a reset on open
+    result = {'lane': False, 'succeeded': 0, 'failed': args.items, 'latency': [], 'span': 0.0, 'resets': 0}
+    try:
+        host = load_host(args.verbose)
+        host.ARDUINO_MAX_BAUD = args.max_baud or host.ARDUINO_BAUD
+        host.item_traces = host.ItemTraceLog('items.jsonl')
+        host.ml_analyzer = BenchAnalyzer(args.seed, args.ml_s)
+        host.lanes = host.LaneRegistry()
+        if not host.lanes.discover([port], host.ARDUINO_BAUD):
+            return result
+        result['lane'] = True
+
+        pipeline = host.SortingPipeline(host.ML_WORKERS, args.items)
+        pipeline.start()
+        arrivals = random.Random(args.seed)
+        items = []
+        for _ in range(args.items):
+            item = host.SortingItem(host.item_traces.new_item(), 'bench.jpg', 'bench.jpg')
+            pipeline.submit(item)
+            items.append(item)
+            if args.rate > 0:
+                time.sleep(arrivals.expovariate(args.rate / 60.0))
+
+        deadline = time.time() + FINISH_GRACE
+        while time.time() < deadline and any(item.record is None for item in items):
+            time.sleep(0.1)
+        pipeline.stop()
+        host.lanes.disconnect_all()
+
+        finished = [item for item in items if item.record is not None]
+        succeeded = [item for item in finished if item.status == 'success']
+        result['succeeded'] = len(succeeded)
+        result['failed'] = args.items - len(succeeded)
+        result['latency'] = [item.record['total_seconds'] for item in succeeded]
+        if finished:
+            first = min(item.trace.started for item in items)
+            result['span'] = max(item.trace.started + item.record['total_seconds'] for item in finished) - first
+        return result
+    finally:
+        bridge.terminate()
+        output, _ = bridge.communicate()
+        for line in output.splitlines():
+            if line.startswith('resets '):
+                result['resets'] = int(line.split()[1])
+
+
+# ============================================================================
+# REPORT
+# ============================================================================
+
+def build_scenarios(args) -> List[tuple]:
+    """(name, overrides) per scenario; every fault is off unless overridden"""
+    off = {'drop': 0.0, 'corrupt': 0.0, 'stalls': 0.0, 'resets': 0.0}
+    single = []
+    if args.stalls > 0 and args.stall_ms > 0:
+        single.append(('latency spikes', {**off, 'stalls': args.stalls}))
+    if args.drop > 0:
+        single.append(('byte drops', {**off, 'drop': args.drop}))
+    if args.corrupt > 0:
+        single.append(('corruption', {**off, 'corrupt': args.corrupt}))
+    if args.resets > 0:
+        single.append(('device resets', {**off, 'resets': args.resets}))
+    scenarios = [('no faults', off)] + single
+    if len(single) > 1:
+        scenarios.append(('all of the above', {}))
+    return scenarios
+
+
+def percentile(values: List[float], p: float) -> float:
+    if not values:
+        return float('nan')
+    values = sorted(values)
+    return values[min(len(values) - 1, int(p * len(values)))]
+
+
+def scenario_command(args, overrides: Dict, name: str) -> List[str]:
+    command = [sys.executable, str(Path(__file__).resolve()), '--scenario', name,
+               '--fault-sim', args.fault_sim, '--items', str(args.items), '--rate', str(args.rate),
+               '--ml-s', str(args.ml_s), '--max-baud', str(args.max_baud),
+               *fault_args(argparse.Namespace(**{**vars(args), **overrides}))]
+    if args.verbose:
+        command.append('--verbose')
+    return command
+
+
+def run_all(args) -> int:
+    log_dir = tempfile.mkdtemp(prefix='fault-bench-logs-')
+    print(f"Fault bench: {args.items} items at {args.rate:.1f} items/min, real host against {args.fault_sim}")
+    print(f"Faults: stalls {args.stalls:.1f}/min x {args.stall_ms:.0f} ms, drop {args.drop:.4f}, "
+          f"corrupt {args.corrupt:.4f} per byte, resets {args.resets:.2f}/min "
+          f"(port stays open, {args.boot_ms:.0f} ms boot)\n")
+
+    runs = []
+    for name, overrides in build_scenarios(args):
+        log = open(os.path.join(log_dir, name.replace(' ', '_') + '.log'), 'w')
+        process = subprocess.Popen(scenario_command(args, overrides, name), stdout=subprocess.PIPE,
+                                   stderr=log, text=True)
+        runs.append((name, process, log))
+
+    print(f"{'scenario':<18} {'items/min':>10} {'ok':>6} {'failed':>6} {'p50_s':>8} {'p95_s':>8} "
+          f"{'p99_s':>8} {'max_s':>8} {'resets':>6}")
+    baseline = 0.0
+    for name, process, log in runs:
+        output, _ = process.communicate()
+        log.close()
+        lines = output.strip().splitlines()
+        if process.returncode != 0 or not lines:
+            print(f"{name:<18} did not finish (see {log.name})")
+            continue
+        r = json.loads(lines[-1])
+        if not r['lane']:
+            print(f"{name:<18} no lane answered HELLO (see {log.name})")
+            continue
+        per_min = r['succeeded'] / (r['span'] / 60.0) if r['span'] > 0 else 0.0
+        if name == 'no faults':
+            baseline = per_min
+        latency = r['latency']
+        row = (f"{name:<18} {per_min:>10.2f} {r['succeeded']:>6} {r['failed']:>6} "
+               f"{percentile(latency, 0.5):>8.2f} {percentile(latency, 0.95):>8.2f} "
+               f"{percentile(latency, 0.99):>8.2f} {percentile(latency, 1.0):>8.2f} {r['resets']:>6}")
+        if baseline > 0 and name != 'no faults':
+            row += f"  {(per_min - baseline) / baseline * 100.0:+.1f}%"
+        print(row, flush=True)
+    print(f"\nHost logs: {log_dir}")
+    return 0
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description="Sorting throughput of the real host over a faulty serial link")
+    parser.add_argument('--fault-sim', default=str(REPO / 'build' / 'fault_sim'),
+                        help="fault_sim binary (cmake -S sim -B build)")
+    parser.add_argument('--items', type=int, default=60)
+    parser.add_argument('--rate', type=float, default=12.0, help="Uploads per minute (0 = all at once)")
+    parser.add_argument('--ml-s', type=float, default=0.5, help="Seconds the stand-in ML analysis takes")
+    parser.add_argument('--drop', type=float, default=1e-3, help="Chance a byte is lost")
+    parser.add_argument('--corrupt', type=float, default=1e-3, help="Chance a byte gets a flipped bit")
+    parser.add_argument('--stalls', type=float, default=2.0, help="Link stalls per minute")
+    parser.add_argument('--stall-ms', type=float, default=1500.0)
+    parser.add_argument('--resets', type=float, default=0.5, help="Device resets per minute")
+    parser.add_argument('--boot-ms', type=float, default=1000.0, help="Bootloader time after a reset")
+    parser.add_argument('--max-baud', type=int, default=0,
+                        help="ARDUINO_MAX_BAUD for the host (0 = stay at ARDUINO_BAUD)")
+    parser.add_argument('--seed', type=int, default=1)
+    parser.add_argument('--verbose', action='store_true', help="Host INFO logging into the scenario logs")
+    parser.add_argument('--scenario', help=argparse.SUPPRESS)  # Run one scenario and print its result
+    args = parser.parse_args()
+
+    if args.items < 1 or args.rate < 0:
+        parser.error("need at least one item and a non-negative rate")
+    args.fault_sim = str(Path(args.fault_sim).resolve())
+    if not os.access(args.fault_sim, os.X_OK):
+        parser.error(f"{args.fault_sim} not found; build it with cmake -S sim -B build && cmake --build build")
+
+    if args.scenario:
+        signal.signal(signal.SIGTERM, lambda *_: sys.exit(1))  # Still stop fault_sim
+        print(json.dumps(run_scenario(args)))
+        return 0
+    return run_all(args)
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,117 @@
+"""
+================================================================================
+TRACE TO CHROME TRACE CONVERTER
+================================================================================
+Turns the output of GET /api/trace (firmware events from TRACE DUMP plus
+host-side Flask/ML spans) into Chrome trace JSON. Open the result in
+chrome://tracing or https://ui.perfetto.dev to see both on one timeline.
+
+Usage:
+    python tools/trace_to_chrome.py --url http://localhost:5000/api/trace -o trace.json
+    python tools/trace_to_chrome.py saved_trace.json -o trace.json
+================================================================================
+"""
+
+import sys
+import json
+import argparse
+import urllib.request
+from typing import Dict, List
+
+FIRMWARE_PID = 1
+HOST_PID = 2
+
+
+def to_micros(seconds: float, origin: float) -> float:
+    return round((seconds - origin) * 1e6, 1)
+
+
+def convert(dump: Dict) -> Dict:
+    """Build a Chrome trace document from an /api/trace response"""
+    firmware_events = dump.get('firmware_events', [])
+    host_spans = dump.get('host_spans', [])
+    
+    # Shift everything so the timeline starts at zero
+    times = [e['time'] for e in firmware_events] + [s['start'] for s in host_spans]
+    origin = min(times) if times else 0.0
+    
+    trace_events: List[Dict] = [
+        {'name': 'process_name', 'ph': 'M', 'pid': FIRMWARE_PID, 'args': {'name': 'Arduino firmware'}},
+        {'name': 'process_name', 'ph': 'M', 'pid': HOST_PID, 'args': {'name': 'Host (Flask / ML)'}},
+    ]
+    
+    # One firmware track per sorting lane
+    lane_ids = {}
+    for event in firmware_events:
+        entry = {
+            'name': event['name'],
+            'ph': event['phase'],
+            'ts': to_micros(event['time'], origin),
+            'pid': FIRMWARE_PID,
+            'tid': lane_ids.setdefault(event.get('lane', 'lane'), len(lane_ids) + 1),
+            'args': {'arg': event['arg']}
+        }
+        if event['phase'] == 'i':
+            entry['s'] = 't'
+        trace_events.append(entry)
+    
+    for lane_name, tid in lane_ids.items():
+        trace_events.append({'name': 'thread_name', 'ph': 'M', 'pid': FIRMWARE_PID, 'tid': tid,
+                             'args': {'name': lane_name}})
+    
+    # Host spans are complete events; one track per Python thread
+    thread_ids = {}
+    for span in host_spans:
+        tid = thread_ids.setdefault(span.get('thread', 'main'), len(thread_ids) + 1)
+        trace_events.append({
+            'name': span['name'],
+            'ph': 'X',
+            'ts': to_micros(span['start'], origin),
+            'dur': to_micros(span['end'], span['start']),
+            'pid': HOST_PID,
+            'tid': tid,
+            'args': span.get('args', {})
+        })
+    
+    for thread_name, tid in thread_ids.items():
+        trace_events.append({'name': 'thread_name', 'ph': 'M', 'pid': HOST_PID, 'tid': tid,
+                             'args': {'name': thread_name}})
+    
+    return {
+        'traceEvents': trace_events,
+        'displayTimeUnit': 'ms',
+        'otherData': {
+            'firmware_overwritten': dump.get('firmware_overwritten', 0),
+            'captured': dump.get('timestamp')
+        }
+    }
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description='Convert /api/trace output to Chrome trace JSON')
+    parser.add_argument('input', nargs='?', help='Saved /api/trace JSON file')
+    parser.add_argument('--url', help='Fetch directly from a running system, e.g. http://localhost:5000/api/trace')
+    parser.add_argument('-o', '--output', default='trace.json', help='Output file (default: trace.json)')
+    args = parser.parse_args()
+    
+    if args.url:
+        with urllib.request.urlopen(args.url) as response:
+            dump = json.load(response)
+    elif args.input:
+        with open(args.input, 'r') as f:
+            dump = json.load(f)
+    else:
+        parser.error('Give an input file or --url')
+    
+    chrome_trace = convert(dump)
+    with open(args.output, 'w') as f:
+        json.dump(chrome_trace, f)
+    
+    print(f"Wrote {len(chrome_trace['traceEvents'])} events to {args.output}")
+    if chrome_trace['otherData']['firmware_overwritten']:
+        print(f"Warning: firmware ring overwrote {chrome_trace['otherData']['firmware_overwritten']} events")
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())